@@ -0,0 +1,33 @@
+#include "cpu_all.h"
+#include "cpu_topology.h"
+#include "cpu_tlb.h"
+#include "cpu_rdt.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Initialization
+#if !defined(ISA_arm64)
+void cpu_all_init_from_snapshot(const struct cpuid_snapshot* snapshot)
+{
+  cpu_specs_init_from_snapshot(snapshot);
+  cpu_specs_init_hybrid_from_snapshot(snapshot);
+  cpu_identity_init_from_snapshot(snapshot);
+  cpu_topology_init_from_snapshot(snapshot);
+  cpu_tlb_init_from_snapshot(snapshot);
+  cpu_rdt_init_from_snapshot(snapshot);
+}
+#endif
+
+void cpu_all_init(void)
+{
+#if defined(ISA_arm64)
+  cpu_specs_init();
+  cpu_identity_init();
+  cpu_topology_init();
+  cpu_tlb_init();
+  cpu_rdt_init();
+#else
+  struct cpuid_snapshot snapshot;
+  cpuid_snapshot_init(&snapshot);
+  cpu_all_init_from_snapshot(&snapshot);
+#endif
+}
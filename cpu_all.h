@@ -0,0 +1,22 @@
+#pragma once
+
+#include "cpu_specs.h"
+
+// Initialization of every module decoding CPUID from a single snapshot, so that each CPUID
+// function is executed once, rather than once per module's own initializer
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Implementation
+// Initialize or refresh cpu_specs, cpu_identity, cpu_topology, cpu_tlb_specs and cpu_rdt_specs,
+// as their own initializers would. On x86, a single snapshot is taken with cpuid_snapshot_init()
+// and decoded by each module, including the hybrid pass of cpu_specs_init(). On ARM64, each
+// module's initializer is called
+void cpu_all_init(void);
+
+#if !defined(ISA_arm64)
+// Same as cpu_all_init(), from a snapshot. No CPUID instruction is executed but those of
+// cpu_specs_init_hybrid_from_snapshot() and cpu_topology_init_from_snapshot(), which read each
+// logical processor. A snapshot of another machine, such as a replayed dump (see is_local), leaves
+// cpu_topology empty, and cpu_specs only describes the core type it was taken on
+void cpu_all_init_from_snapshot(const struct cpuid_snapshot* snapshot);
+#endif
@@ -0,0 +1,426 @@
+#pragma once
+
+#include "isa.h"
+#include "cpu_specs.h"
+
+// Instructions guaranteed by the compiler's target, such as /arch:AVX2 with MSVC or -mavx2 and
+// -march=x86-64-v3 with GCC and Clang: code built this way already requires them to run at all.
+// CPU_BASELINE_<flag> is either the instruction flag or 0, and CPU_BASELINE_INSTRUCTIONS combines
+// them all. cpu_has() then folds to a compile-time constant for instructions in the baseline
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// MSVC
+// MSVC only defines __AVX__, __AVX2__ and the __AVX512*__ macros of /arch:AVX512. Each /arch
+// option lets the compiler use the other instructions of the matching x86-64 level, so they are
+// deduced from it
+#if defined(_MSC_VER) && !defined(__clang__)
+#  if defined(__AVX__)
+#    define CPU_BASELINE_MSVC_AVX 1
+#  endif
+#  if defined(__AVX2__)
+#    define CPU_BASELINE_MSVC_AVX2 1
+#  endif
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// ARM64 instructions
+// GCC, Clang and MSVC define the ACLE __ARM_FEATURE_* macros of the -march or /arch target. NEON is
+// part of the ARMv8-A baseline
+#if defined(ISA_arm64)
+#  define CPU_BASELINE_NEON NEON
+#  if defined(__ARM_FEATURE_FP16_VECTOR_ARITHMETIC)
+#    define CPU_BASELINE_FP16 FP16
+#  else
+#    define CPU_BASELINE_FP16 0
+#  endif
+#  if defined(__ARM_FEATURE_DOTPROD)
+#    define CPU_BASELINE_DOTPROD DOTPROD
+#  else
+#    define CPU_BASELINE_DOTPROD 0
+#  endif
+#  if defined(__ARM_FEATURE_MATMUL_INT8)
+#    define CPU_BASELINE_I8MM I8MM
+#  else
+#    define CPU_BASELINE_I8MM 0
+#  endif
+#  if defined(__ARM_FEATURE_BF16)
+#    define CPU_BASELINE_BF16 BF16
+#  else
+#    define CPU_BASELINE_BF16 0
+#  endif
+#  if defined(__ARM_FEATURE_SVE)
+#    define CPU_BASELINE_SVE SVE
+#  else
+#    define CPU_BASELINE_SVE 0
+#  endif
+#  if defined(__ARM_FEATURE_SVE2)
+#    define CPU_BASELINE_SVE2 SVE2
+#  else
+#    define CPU_BASELINE_SVE2 0
+#  endif
+#  if defined(__ARM_FEATURE_ATOMICS)
+#    define CPU_BASELINE_LSE LSE
+#  else
+#    define CPU_BASELINE_LSE 0
+#  endif
+#  if defined(__ARM_FEATURE_CRC32)
+#    define CPU_BASELINE_CRC32 CRC32
+#  else
+#    define CPU_BASELINE_CRC32 0
+#  endif
+// __ARM_FEATURE_AES covers PMULL, and __ARM_FEATURE_SHA2 covers SHA1
+#  if defined(__ARM_FEATURE_AES)
+#    define CPU_BASELINE_AES (AES | PMULL)
+#  else
+#    define CPU_BASELINE_AES 0
+#  endif
+#  if defined(__ARM_FEATURE_SHA2)
+#    define CPU_BASELINE_SHA2 (SHA1 | SHA2)
+#  else
+#    define CPU_BASELINE_SHA2 0
+#  endif
+#  if defined(__ARM_FEATURE_SHA3)
+#    define CPU_BASELINE_SHA3 SHA3
+#  else
+#    define CPU_BASELINE_SHA3 0
+#  endif
+#  if defined(__ARM_FEATURE_SHA512)
+#    define CPU_BASELINE_SHA512 SHA512
+#  else
+#    define CPU_BASELINE_SHA512 0
+#  endif
+
+#define CPU_BASELINE_INSTRUCTIONS \
+  ( CPU_BASELINE_NEON \
+  | CPU_BASELINE_FP16 \
+  | CPU_BASELINE_DOTPROD \
+  | CPU_BASELINE_I8MM \
+  | CPU_BASELINE_BF16 \
+  | CPU_BASELINE_SVE \
+  | CPU_BASELINE_SVE2 \
+  | CPU_BASELINE_LSE \
+  | CPU_BASELINE_CRC32 \
+  | CPU_BASELINE_AES \
+  | CPU_BASELINE_SHA2 \
+  | CPU_BASELINE_SHA3 \
+  | CPU_BASELINE_SHA512)
+#else
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// x86 instructions
+#if defined(ISA_x64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#  define CPU_BASELINE_SSE1 SSE1
+#  define CPU_BASELINE_SSE2 SSE2
+#elif (defined(_M_IX86_FP) && (_M_IX86_FP >= 1)) || defined(__SSE__)
+#  define CPU_BASELINE_SSE1 SSE1
+#  define CPU_BASELINE_SSE2 0
+#else
+#  define CPU_BASELINE_SSE1 0
+#  define CPU_BASELINE_SSE2 0
+#endif
+#if defined(__SSE3__) || defined(CPU_BASELINE_MSVC_AVX)
+#  define CPU_BASELINE_SSE3 SSE3
+#else
+#  define CPU_BASELINE_SSE3 0
+#endif
+#if defined(__SSSE3__) || defined(CPU_BASELINE_MSVC_AVX)
+#  define CPU_BASELINE_SSSE3 SSSE3
+#else
+#  define CPU_BASELINE_SSSE3 0
+#endif
+#if defined(__SSE4_1__) || defined(CPU_BASELINE_MSVC_AVX)
+#  define CPU_BASELINE_SSE4_1 SSE4_1
+#else
+#  define CPU_BASELINE_SSE4_1 0
+#endif
+#if defined(__SSE4_2__) || defined(CPU_BASELINE_MSVC_AVX)
+#  define CPU_BASELINE_SSE4_2 SSE4_2
+#else
+#  define CPU_BASELINE_SSE4_2 0
+#endif
+#if defined(__POPCNT__) || defined(CPU_BASELINE_MSVC_AVX)
+#  define CPU_BASELINE_POPCNT POPCNT
+#else
+#  define CPU_BASELINE_POPCNT 0
+#endif
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16) || defined(CPU_BASELINE_MSVC_AVX)
+#  define CPU_BASELINE_CX16 CX16
+#else
+#  define CPU_BASELINE_CX16 0
+#endif
+#if defined(__LAHF_SAHF__) || defined(CPU_BASELINE_MSVC_AVX)
+#  define CPU_BASELINE_LAHF_SAHF LAHF_SAHF
+#else
+#  define CPU_BASELINE_LAHF_SAHF 0
+#endif
+#if defined(__AVX__)
+#  define CPU_BASELINE_AVX1 AVX1
+#else
+#  define CPU_BASELINE_AVX1 0
+#endif
+#if defined(__AVX2__)
+#  define CPU_BASELINE_AVX2 AVX2
+#else
+#  define CPU_BASELINE_AVX2 0
+#endif
+#if defined(__FMA__) || defined(CPU_BASELINE_MSVC_AVX2)
+#  define CPU_BASELINE_FMA3 FMA3
+#else
+#  define CPU_BASELINE_FMA3 0
+#endif
+#if defined(__F16C__) || defined(CPU_BASELINE_MSVC_AVX2)
+#  define CPU_BASELINE_F16C F16C
+#else
+#  define CPU_BASELINE_F16C 0
+#endif
+#if defined(__BMI__) || defined(CPU_BASELINE_MSVC_AVX2)
+#  define CPU_BASELINE_BMI1 BMI1
+#else
+#  define CPU_BASELINE_BMI1 0
+#endif
+#if defined(__BMI__) || defined(CPU_BASELINE_MSVC_AVX2)
+#  define CPU_BASELINE_TZCNT TZCNT
+#else
+#  define CPU_BASELINE_TZCNT 0
+#endif
+#if defined(__BMI2__) || defined(CPU_BASELINE_MSVC_AVX2)
+#  define CPU_BASELINE_BMI2 BMI2
+#else
+#  define CPU_BASELINE_BMI2 0
+#endif
+#if defined(__LZCNT__) || defined(CPU_BASELINE_MSVC_AVX2)
+#  define CPU_BASELINE_LZCNT LZCNT
+#else
+#  define CPU_BASELINE_LZCNT 0
+#endif
+#if defined(__MOVBE__) || defined(CPU_BASELINE_MSVC_AVX2)
+#  define CPU_BASELINE_MOVBE MOVBE
+#else
+#  define CPU_BASELINE_MOVBE 0
+#endif
+#if defined(__TBM__)
+#  define CPU_BASELINE_TBM TBM
+#else
+#  define CPU_BASELINE_TBM 0
+#endif
+#if defined(__AVX512F__)
+#  define CPU_BASELINE_AVX512F AVX512F
+#else
+#  define CPU_BASELINE_AVX512F 0
+#endif
+#if defined(__AVX512CD__)
+#  define CPU_BASELINE_AVX512CD AVX512CD
+#else
+#  define CPU_BASELINE_AVX512CD 0
+#endif
+#if defined(__AVX512BW__)
+#  define CPU_BASELINE_AVX512BW AVX512BW
+#else
+#  define CPU_BASELINE_AVX512BW 0
+#endif
+#if defined(__AVX512DQ__)
+#  define CPU_BASELINE_AVX512DQ AVX512DQ
+#else
+#  define CPU_BASELINE_AVX512DQ 0
+#endif
+#if defined(__AVX512VL__)
+#  define CPU_BASELINE_AVX512VL AVX512VL
+#else
+#  define CPU_BASELINE_AVX512VL 0
+#endif
+#if defined(__AVX512VNNI__)
+#  define CPU_BASELINE_AVX512VNNI AVX512VNNI
+#else
+#  define CPU_BASELINE_AVX512VNNI 0
+#endif
+#if defined(__AVX512BF16__)
+#  define CPU_BASELINE_AVX512BF16 AVX512BF16
+#else
+#  define CPU_BASELINE_AVX512BF16 0
+#endif
+#if defined(__AVX512FP16__)
+#  define CPU_BASELINE_AVX512FP16 AVX512FP16
+#else
+#  define CPU_BASELINE_AVX512FP16 0
+#endif
+#if defined(__AVX512VBMI__)
+#  define CPU_BASELINE_AVX512VBMI AVX512VBMI
+#else
+#  define CPU_BASELINE_AVX512VBMI 0
+#endif
+#if defined(__AVX512VBMI2__)
+#  define CPU_BASELINE_AVX512VBMI2 AVX512VBMI2
+#else
+#  define CPU_BASELINE_AVX512VBMI2 0
+#endif
+#if defined(__AVX512IFMA__)
+#  define CPU_BASELINE_AVX512IFMA AVX512IFMA
+#else
+#  define CPU_BASELINE_AVX512IFMA 0
+#endif
+#if defined(__AVX512VPOPCNTDQ__)
+#  define CPU_BASELINE_AVX512VPOPCNTDQ AVX512VPOPCNTDQ
+#else
+#  define CPU_BASELINE_AVX512VPOPCNTDQ 0
+#endif
+#if defined(__AVXVNNI__)
+#  define CPU_BASELINE_AVX_VNNI AVX_VNNI
+#else
+#  define CPU_BASELINE_AVX_VNNI 0
+#endif
+#if defined(__AMX_TILE__)
+#  define CPU_BASELINE_AMX_TILE AMX_TILE
+#else
+#  define CPU_BASELINE_AMX_TILE 0
+#endif
+#if defined(__AMX_INT8__)
+#  define CPU_BASELINE_AMX_INT8 AMX_INT8
+#else
+#  define CPU_BASELINE_AMX_INT8 0
+#endif
+#if defined(__AMX_BF16__)
+#  define CPU_BASELINE_AMX_BF16 AMX_BF16
+#else
+#  define CPU_BASELINE_AMX_BF16 0
+#endif
+#if defined(__GFNI__)
+#  define CPU_BASELINE_GFNI GFNI
+#else
+#  define CPU_BASELINE_GFNI 0
+#endif
+#if defined(__VAES__)
+#  define CPU_BASELINE_VAES VAES
+#else
+#  define CPU_BASELINE_VAES 0
+#endif
+#if defined(__VPCLMULQDQ__)
+#  define CPU_BASELINE_VPCLMULQDQ VPCLMULQDQ
+#else
+#  define CPU_BASELINE_VPCLMULQDQ 0
+#endif
+#if defined(__SHA__)
+#  define CPU_BASELINE_SHA SHA
+#else
+#  define CPU_BASELINE_SHA 0
+#endif
+#if defined(__ADX__)
+#  define CPU_BASELINE_ADX ADX
+#else
+#  define CPU_BASELINE_ADX 0
+#endif
+#if defined(__RDPID__)
+#  define CPU_BASELINE_RDPID RDPID
+#else
+#  define CPU_BASELINE_RDPID 0
+#endif
+#if defined(__PRFCHW__)
+#  define CPU_BASELINE_PREFETCHW PREFETCHW
+#else
+#  define CPU_BASELINE_PREFETCHW 0
+#endif
+#if defined(__PREFETCHWT1__)
+#  define CPU_BASELINE_PREFETCHWT1 PREFETCHWT1
+#else
+#  define CPU_BASELINE_PREFETCHWT1 0
+#endif
+#if defined(__CLFLUSHOPT__)
+#  define CPU_BASELINE_CLFLUSHOPT CLFLUSHOPT
+#else
+#  define CPU_BASELINE_CLFLUSHOPT 0
+#endif
+#if defined(__CLWB__)
+#  define CPU_BASELINE_CLWB CLWB
+#else
+#  define CPU_BASELINE_CLWB 0
+#endif
+#if defined(__CLDEMOTE__)
+#  define CPU_BASELINE_CLDEMOTE CLDEMOTE
+#else
+#  define CPU_BASELINE_CLDEMOTE 0
+#endif
+#if defined(__MOVDIRI__)
+#  define CPU_BASELINE_MOVDIRI MOVDIRI
+#else
+#  define CPU_BASELINE_MOVDIRI 0
+#endif
+#if defined(__MOVDIR64B__)
+#  define CPU_BASELINE_MOVDIR64B MOVDIR64B
+#else
+#  define CPU_BASELINE_MOVDIR64B 0
+#endif
+
+#define CPU_BASELINE_INSTRUCTIONS \
+  ( CPU_BASELINE_SSE1 \
+  | CPU_BASELINE_SSE2 \
+  | CPU_BASELINE_SSE3 \
+  | CPU_BASELINE_SSSE3 \
+  | CPU_BASELINE_SSE4_1 \
+  | CPU_BASELINE_SSE4_2 \
+  | CPU_BASELINE_POPCNT \
+  | CPU_BASELINE_CX16 \
+  | CPU_BASELINE_LAHF_SAHF \
+  | CPU_BASELINE_AVX1 \
+  | CPU_BASELINE_AVX2 \
+  | CPU_BASELINE_FMA3 \
+  | CPU_BASELINE_F16C \
+  | CPU_BASELINE_BMI1 \
+  | CPU_BASELINE_TZCNT \
+  | CPU_BASELINE_BMI2 \
+  | CPU_BASELINE_LZCNT \
+  | CPU_BASELINE_MOVBE \
+  | CPU_BASELINE_TBM \
+  | CPU_BASELINE_AVX512F \
+  | CPU_BASELINE_AVX512CD \
+  | CPU_BASELINE_AVX512BW \
+  | CPU_BASELINE_AVX512DQ \
+  | CPU_BASELINE_AVX512VL \
+  | CPU_BASELINE_AVX512VNNI \
+  | CPU_BASELINE_AVX512BF16 \
+  | CPU_BASELINE_AVX512FP16 \
+  | CPU_BASELINE_AVX512VBMI \
+  | CPU_BASELINE_AVX512VBMI2 \
+  | CPU_BASELINE_AVX512IFMA \
+  | CPU_BASELINE_AVX512VPOPCNTDQ \
+  | CPU_BASELINE_AVX_VNNI \
+  | CPU_BASELINE_AMX_TILE \
+  | CPU_BASELINE_AMX_INT8 \
+  | CPU_BASELINE_AMX_BF16 \
+  | CPU_BASELINE_GFNI \
+  | CPU_BASELINE_VAES \
+  | CPU_BASELINE_VPCLMULQDQ \
+  | CPU_BASELINE_SHA \
+  | CPU_BASELINE_ADX \
+  | CPU_BASELINE_RDPID \
+  | CPU_BASELINE_PREFETCHW \
+  | CPU_BASELINE_PREFETCHWT1 \
+  | CPU_BASELINE_CLFLUSHOPT \
+  | CPU_BASELINE_CLWB \
+  | CPU_BASELINE_CLDEMOTE \
+  | CPU_BASELINE_MOVDIRI \
+  | CPU_BASELINE_MOVDIR64B)
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Checks
+#define CPU_BASELINE_HAS_ALL(flags) ((CPU_BASELINE_INSTRUCTIONS & (flags)) == (flags))
+
+// x86-64 microarchitecture level guaranteed by the compiler's target, from 1 to 4, or 0 for 32-bit
+// and ARM64 builds. This is a constant expression, but can't be used in #if directives
+#if defined(ISA_x64)
+#  define CPU_BASELINE_X86_64_LEVEL \
+  (1 + CPU_BASELINE_HAS_ALL(X86_64_V2_INSTRUCTIONS) \
+     + CPU_BASELINE_HAS_ALL(X86_64_V2_INSTRUCTIONS | X86_64_V3_INSTRUCTIONS) \
+     + CPU_BASELINE_HAS_ALL(X86_64_V2_INSTRUCTIONS | X86_64_V3_INSTRUCTIONS | X86_64_V4_INSTRUCTIONS))
+#else
+#  define CPU_BASELINE_X86_64_LEVEL 0
+#endif
+
+// Whether all the given instruction flags are available. Flags in the baseline are known to be
+// available without reading cpu_specs, so for instance cpu_has(AVX2 | FMA3) is the constant 1 in
+// x86-64-v3 builds. Other flags are tested at runtime in cpu_specs.instructions, which requires
+// cpu_specs_init() to be called beforehand
+#define cpu_has(flags) \
+  (CPU_BASELINE_HAS_ALL(flags) || ((cpu_specs.instructions & (flags)) == (flags)))
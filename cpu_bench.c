@@ -0,0 +1,400 @@
+#include "cpu_bench.h"
+#include "cpu_topology.h"
+#include "cpu_intrinsics.h"
+#include "os.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Helpers
+#define MiB(x) ((u64)(x) * 1024 * 1024)
+
+// Count of dependent loads timed per latency measurement
+#define CPU_BENCH_CHASE_STEP_COUNT (1 << 21)
+
+// Count of bytes streamed per thread and per bandwidth measurement
+#define CPU_BENCH_STREAM_BYTE_COUNT MiB(256)
+
+// Count of round trips timed per ping-pong measurement, after a few untimed ones
+#define CPU_BENCH_PING_PONG_WARMUP_COUNT     1000
+#define CPU_BENCH_PING_PONG_ROUND_TRIP_COUNT 50000
+
+// Results are stored here rather than discarded, so that the measured loops aren't optimized away
+static void* volatile cpu_bench_pointer_sink;
+static volatile u64   cpu_bench_value_sink;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Globals
+struct cpu_bench cpu_bench =
+{
+  .thread_count = 0
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Latency
+// Link all cache lines of the working set in a single random cycle, with Sattolo's algorithm. The
+// permutation is first stored as line indices in the lines themselves, then turned into pointers
+static void cpu_bench_build_chase(u8* working_set, u32 line_count, s32 line_size)
+{
+  for (u32 i = 0; i < line_count; i++)
+  {
+    *(u32*)(working_set + (u64)i * line_size) = i;
+  }
+
+  // xorshift32, which is good enough to defeat hardware prefetchers
+  u32 random = 0x9E3779B9;
+  for (u32 i = line_count - 1; i > 0; i--)
+  {
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+
+    u32* line_i = (u32*)(working_set + (u64)i * line_size);
+    u32* line_j = (u32*)(working_set + (u64)(random % i) * line_size);
+    u32  next_i = *line_i;
+    *line_i = *line_j;
+    *line_j = next_i;
+  }
+
+  for (u32 i = 0; i < line_count; i++)
+  {
+    u8* line = working_set + (u64)i * line_size;
+    *(void**)line = working_set + (u64)(*(u32*)line) * line_size;
+  }
+}
+
+static u64 cpu_bench_measure_latency(u8* working_set, u64 working_set_size, s32 line_size)
+{
+  u32 line_count = (u32)(working_set_size / line_size);
+  cpu_bench_build_chase(working_set, line_count, line_size);
+
+  // Bring as much of the working set as possible in the caches before timing
+  void** pointer = (void**)working_set;
+  u32 warmup_step_count = (line_count < CPU_BENCH_CHASE_STEP_COUNT) ? line_count : CPU_BENCH_CHASE_STEP_COUNT;
+  for (u32 i = 0; i < warmup_step_count; i++)
+  {
+    pointer = (void**)*pointer;
+  }
+
+  u64 start_ns = os_get_time_ns();
+  for (u32 i = 0; i < CPU_BENCH_CHASE_STEP_COUNT; i += 8)
+  {
+    pointer = (void**)*pointer;
+    pointer = (void**)*pointer;
+    pointer = (void**)*pointer;
+    pointer = (void**)*pointer;
+    pointer = (void**)*pointer;
+    pointer = (void**)*pointer;
+    pointer = (void**)*pointer;
+    pointer = (void**)*pointer;
+  }
+  u64 end_ns = os_get_time_ns();
+  cpu_bench_pointer_sink = pointer;
+
+  return (end_ns - start_ns) * 1000 / CPU_BENCH_CHASE_STEP_COUNT;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Bandwidth
+static u64 cpu_bench_read(const u64* words, u64 word_count)
+{
+  // Independent accumulators, so that reads aren't serialized by a single dependency chain
+  u64 sum_0 = 0;
+  u64 sum_1 = 0;
+  u64 sum_2 = 0;
+  u64 sum_3 = 0;
+  for (u64 i = 0; i + 4 <= word_count; i += 4)
+  {
+    sum_0 += words[i];
+    sum_1 += words[i + 1];
+    sum_2 += words[i + 2];
+    sum_3 += words[i + 3];
+  }
+
+  return sum_0 ^ sum_1 ^ sum_2 ^ sum_3;
+}
+
+static void cpu_bench_write(u64* words, u64 word_count, u64 value)
+{
+  for (u64 i = 0; i < word_count; i++)
+  {
+    words[i] = value;
+  }
+}
+
+enum cpu_bench_task_type
+{
+  CPU_BENCH_TASK_LATENCY = 0,
+  CPU_BENCH_TASK_READ,
+  CPU_BENCH_TASK_WRITE
+};
+
+struct cpu_bench_task
+{
+  s32 type;
+  u8* working_set;
+  u64 working_set_size;
+  s32 line_size;
+
+  // Threads streaming concurrently wait for each other after warming up their working set
+  volatile long* ready_thread_count;
+  s32            thread_count;
+
+  // Latency in picoseconds or bandwidth in bytes per second
+  u64 result;
+};
+
+static void cpu_bench_run_task(s32 os_cpu_index, void* user_data)
+{
+  (void)os_cpu_index;
+  struct cpu_bench_task* task = (struct cpu_bench_task*)user_data;
+
+  if (task->type == CPU_BENCH_TASK_LATENCY)
+  {
+    task->result = cpu_bench_measure_latency(task->working_set, task->working_set_size, task->line_size);
+    return;
+  }
+
+  u64* words      = (u64*)task->working_set;
+  u64  word_count = task->working_set_size / sizeof(u64);
+  cpu_bench_write(words, word_count, 0);
+
+  _InterlockedIncrement(task->ready_thread_count);
+  while (cpu_load_acquire(task->ready_thread_count) < task->thread_count)
+  {
+  }
+
+  u64 byte_count = 0;
+  u64 start_ns   = os_get_time_ns();
+  for (u64 pass = 0; byte_count < CPU_BENCH_STREAM_BYTE_COUNT; pass++)
+  {
+    if (task->type == CPU_BENCH_TASK_READ)
+    {
+      cpu_bench_value_sink = cpu_bench_read(words, word_count);
+    }
+    else
+    {
+      cpu_bench_write(words, word_count, pass);
+    }
+    byte_count += word_count * sizeof(u64);
+  }
+  u64 end_ns = os_get_time_ns();
+
+  u64 elapsed_ns = (end_ns > start_ns) ? (end_ns - start_ns) : 1;
+  task->result = byte_count * 1000000000 / elapsed_ns;
+}
+
+// Run the same task on thread_count threads, pinned to the given logical processors, each thread
+// using its own slice of the buffer. Returns the sum of the results, or 0 if threads couldn't be
+// created
+static u64 cpu_bench_run_tasks(s32 type, const s32* os_cpu_indices, s32 thread_count, u8* buffer, u64 slice_size)
+{
+  struct cpu_bench_task tasks[CPU_BENCH_MAX_CORE_COUNT];
+  void*                 task_pointers[CPU_BENCH_MAX_CORE_COUNT] = {0};
+  volatile long         ready_thread_count = 0;
+
+  for (s32 i = 0; i < thread_count; i++)
+  {
+    tasks[i].type               = type;
+    tasks[i].working_set        = buffer + (u64)i * slice_size;
+    tasks[i].working_set_size   = slice_size;
+    tasks[i].line_size          = cpu_specs.cache_line_size;
+    tasks[i].ready_thread_count = &ready_thread_count;
+    tasks[i].thread_count       = thread_count;
+    tasks[i].result             = 0;
+    task_pointers[i]            = &tasks[i];
+  }
+
+  if (!os_run_threads(cpu_bench_run_task, os_cpu_indices, task_pointers, thread_count))
+  {
+    return 0;
+  }
+
+  u64 result_sum = 0;
+  for (s32 i = 0; i < thread_count; i++)
+  {
+    result_sum += tasks[i].result;
+  }
+
+  return result_sum;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Ping-pong
+struct cpu_bench_ping_pong
+{
+  long volatile* counter;
+
+  // The thread of parity 0 writes odd values, and the one of parity 1 writes even values
+  long parity;
+  u64  elapsed_ns;
+};
+
+static void cpu_bench_ping_pong_thread(s32 os_cpu_index, void* user_data)
+{
+  (void)os_cpu_index;
+  struct cpu_bench_ping_pong* ping_pong = (struct cpu_bench_ping_pong*)user_data;
+  long volatile* counter = ping_pong->counter;
+
+  const long warmup_value = 2 * CPU_BENCH_PING_PONG_WARMUP_COUNT;
+  const long end_value    = 2 * (CPU_BENCH_PING_PONG_WARMUP_COUNT + CPU_BENCH_PING_PONG_ROUND_TRIP_COUNT);
+  u64 start_ns = 0;
+  for (long value = ping_pong->parity; value < end_value; value += 2)
+  {
+    while (cpu_load_acquire(counter) != value)
+    {
+    }
+    if (value == warmup_value)
+    {
+      start_ns = os_get_time_ns();
+    }
+    cpu_store_release(counter, value + 1);
+  }
+  ping_pong->elapsed_ns = os_get_time_ns() - start_ns;
+}
+
+u64 cpu_bench_measure_ping_pong(s32 os_cpu_index_0, s32 os_cpu_index_1, void* buffer, u64 buffer_size)
+{
+  struct cpu_bench_ping_pong ping_pongs[2];
+  void* ping_pong_pointers[2] = {&ping_pongs[0], &ping_pongs[1]};
+  s32   os_cpu_indices[2]     = {os_cpu_index_0, os_cpu_index_1};
+
+  // The counter gets a whole destructive interference block, so that nothing else shares it
+  u64 line_size      = (cpu_specs.destructive_interference_size > 0) ? (u64)cpu_specs.destructive_interference_size : 64;
+  u64 aligned_offset = (line_size - ((u64)(os_uptr)buffer % line_size)) % line_size;
+  if (buffer_size < aligned_offset + line_size)
+  {
+    return 0;
+  }
+
+  long volatile* counter = (long volatile*)((u8*)buffer + aligned_offset);
+  *counter = 0;
+  for (long i = 0; i < 2; i++)
+  {
+    ping_pongs[i].counter    = counter;
+    ping_pongs[i].parity     = i;
+    ping_pongs[i].elapsed_ns = 0;
+  }
+
+  if (!os_run_threads(cpu_bench_ping_pong_thread, os_cpu_indices, ping_pong_pointers, 2))
+  {
+    return 0;
+  }
+
+  return ping_pongs[0].elapsed_ns * 1000 / (2 * CPU_BENCH_PING_PONG_ROUND_TRIP_COUNT);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Benchmarks
+// Size of the working set measuring a level: halfway between the sizes of the previous and the
+// current cache levels, so that it fits in the current one but not in the previous one. Memory is
+// measured with 4 times the size of the largest cache
+static u64 cpu_bench_get_working_set_size(s32 level, u64 buffer_size)
+{
+  u64 previous_cache_size = 0;
+  u64 largest_cache_size  = 0;
+  for (s32 cache_idx = 0; cache_idx < CACHE_LEVEL_COUNT; cache_idx++)
+  {
+    u64 cache_size = (u64)cpu_specs.cache_level_specs[cache_idx].data_cache_size;
+    if (cache_idx < level)
+    {
+      previous_cache_size = cache_size ? cache_size : previous_cache_size;
+    }
+    largest_cache_size = (cache_size > largest_cache_size) ? cache_size : largest_cache_size;
+  }
+
+  u64 working_set_size;
+  if (level == CPU_BENCH_MEMORY)
+  {
+    working_set_size = 4 * largest_cache_size;
+    working_set_size = (working_set_size > MiB(64)) ? working_set_size : MiB(64);
+  }
+  else
+  {
+    u64 cache_size = (u64)cpu_specs.cache_level_specs[level].data_cache_size;
+    if (cache_size <= previous_cache_size)
+    {
+      return 0;
+    }
+    working_set_size = (previous_cache_size + cache_size) / 2;
+  }
+
+  // Whole pages, which are also whole cache lines
+  working_set_size &= ~(u64)4095;
+  return (working_set_size <= buffer_size) ? working_set_size : 0;
+}
+
+u32 cpu_bench_run(void* buffer, u64 buffer_size)
+{
+  struct cpu_bench empty_cpu_bench = {0};
+  cpu_bench = empty_cpu_bench;
+
+  // Page-aligned buffer
+  u8* aligned_buffer = (u8*)buffer + ((4096 - ((u64)(os_uptr)buffer & 4095)) & 4095);
+  u64 aligned_offset = (u64)(aligned_buffer - (u8*)buffer);
+  if ((buffer_size <= aligned_offset) || (cpu_specs.cache_line_size <= 0))
+  {
+    return 0;
+  }
+  buffer_size -= aligned_offset;
+
+  // One thread per physical core, on the first of its logical processors the process may run on
+  s32* core_os_indices = cpu_bench.core_os_indices;
+  s32  core_count      = 0;
+  for (s32 i = 0; (i < cpu_topology.logical_processor_count) && (core_count < CPU_BENCH_MAX_CORE_COUNT); i++)
+  {
+    const struct cpu_logical_processor* logical_processor = &cpu_topology.logical_processors[i];
+
+    s32 is_new_core = 1;
+    for (s32 j = 0; j < i; j++)
+    {
+      is_new_core &= (cpu_topology.logical_processors[j].core_id != logical_processor->core_id);
+    }
+    if (is_new_core)
+    {
+      core_os_indices[core_count++] = logical_processor->os_index;
+    }
+  }
+  if (core_count == 0)
+  {
+    // Without cpu_topology, run a single unpinned thread
+    core_os_indices[0] = -1;
+    core_count         = 1;
+  }
+  cpu_bench.thread_count = core_count;
+
+  for (s32 level = 0; level < CPU_BENCH_LEVEL_COUNT; level++)
+  {
+    struct cpu_bench_level_results* results = &cpu_bench.levels[level];
+    u64 working_set_size = cpu_bench_get_working_set_size(level, buffer_size);
+    if (working_set_size == 0)
+    {
+      continue;
+    }
+
+    results->working_set_size = working_set_size;
+    results->latency_ps       = cpu_bench_run_tasks(CPU_BENCH_TASK_LATENCY, core_os_indices, 1, aligned_buffer, working_set_size);
+    results->read_bandwidth   = cpu_bench_run_tasks(CPU_BENCH_TASK_READ,    core_os_indices, 1, aligned_buffer, working_set_size);
+    results->write_bandwidth  = cpu_bench_run_tasks(CPU_BENCH_TASK_WRITE,   core_os_indices, 1, aligned_buffer, working_set_size);
+
+    // Private caches are measured with a full working set per thread, and shared caches and
+    // memory with a working set shared by all threads
+    s32 is_private_cache = (level != CPU_BENCH_MEMORY) && (cpu_specs.cache_level_specs[level].attached_core_count <= 1);
+    u64 slice_size       = is_private_cache ? working_set_size : ((working_set_size / core_count) & ~(u64)4095);
+    if ((core_count > 1) && (slice_size != 0) && (slice_size * core_count <= buffer_size))
+    {
+      results->multi_thread_read_bandwidth  = cpu_bench_run_tasks(CPU_BENCH_TASK_READ,  core_os_indices, core_count, aligned_buffer, slice_size);
+      results->multi_thread_write_bandwidth = cpu_bench_run_tasks(CPU_BENCH_TASK_WRITE, core_os_indices, core_count, aligned_buffer, slice_size);
+    }
+  }
+
+  for (s32 i = 1; i < core_count; i++)
+  {
+    cpu_bench.ping_pong_latency_ps[i] = cpu_bench_measure_ping_pong(core_os_indices[0], core_os_indices[i], aligned_buffer, buffer_size);
+  }
+
+  return cpu_bench.levels[L1].latency_ps != 0;
+}
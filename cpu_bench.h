@@ -0,0 +1,75 @@
+#pragma once
+
+#include "types.h"
+#include "cpu_specs.h"
+
+// Optional benchmarks measuring the latency and bandwidth of each cache level and of memory, and
+// the latency of cache line transfers between cores. They validate the CPUID-derived cpu_specs
+// fields, which may be approximate, wrong or missing, especially on virtual machines.
+// This module only depends on cpu_specs, cpu_topology and the OS layer, and can be left out of
+// builds which don't need it
+
+// Index of the memory results in cpu_bench.levels, after the cache levels
+#define CPU_BENCH_MEMORY      CACHE_LEVEL_COUNT
+#define CPU_BENCH_LEVEL_COUNT (CACHE_LEVEL_COUNT + 1)
+
+// Maximum count of physical cores measured by the multi-threaded and ping-pong benchmarks
+#define CPU_BENCH_MAX_CORE_COUNT 64
+
+struct cpu_bench_level_results
+{
+  // Size of the working set used for this level, in bytes. This is 0 if the level wasn't measured,
+  // because cpu_specs reports no such cache or the buffer was too small
+  u64 working_set_size;
+
+  // Average latency of dependent loads, in picoseconds, measured by chasing pointers in a random
+  // cyclic order. Random accesses to more than a few MiB also include TLB misses
+  u64 latency_ps;
+
+  // Bandwidth of streaming reads and writes of a single thread, in bytes per second
+  u64 read_bandwidth;
+  u64 write_bandwidth;
+
+  // Aggregated bandwidth of one thread per physical core, in bytes per second. Each thread uses its
+  // own working_set_size bytes on private caches, and a share of it on shared caches and memory.
+  // These are 0 if the buffer was too small or the threads couldn't be created
+  u64 multi_thread_read_bandwidth;
+  u64 multi_thread_write_bandwidth;
+};
+
+struct cpu_bench
+{
+  // Results accessed with enum cache_level's values, and CPU_BENCH_MEMORY
+  struct cpu_bench_level_results levels[CPU_BENCH_LEVEL_COUNT];
+
+  // Count of threads used by the multi-threaded benchmarks, one per physical core, and the OS
+  // index of the logical processor each thread is pinned to. The first thread also runs the
+  // single-threaded benchmarks
+  s32 thread_count;
+  s32 core_os_indices[CPU_BENCH_MAX_CORE_COUNT];
+
+  // Average one-way latency of a cache line bouncing between the logical processors of
+  // core_os_indices[0] and core_os_indices[i], in picoseconds. Entry 0 is 0. Only pairs with the
+  // first core are measured, to keep the run short: see cpu_bench_measure_ping_pong() for others
+  u64 ping_pong_latency_ps[CPU_BENCH_MAX_CORE_COUNT];
+};
+
+extern struct cpu_bench cpu_bench;
+
+// Size of a buffer large enough to measure memory on most CPUs, in bytes. Smaller buffers skip
+// the levels which don't fit
+#define CPU_BENCH_RECOMMENDED_BUFFER_SIZE ((u64)512 * 1024 * 1024)
+
+// Run all benchmarks and store their results in the global cpu_bench struct. cpu_specs_init() and
+// cpu_topology_init() must be called beforehand. buffer is caller-provided scratch memory, which
+// is overwritten. This takes about a few seconds, mostly spent on memory, and is meant to be run
+// once on an idle machine, with results cached. Returns 1 if at least the L1 cache was measured
+u32 cpu_bench_run(void* buffer, u64 buffer_size);
+
+// Return the average one-way latency of a cache line bouncing between the logical processors of OS
+// indices os_cpu_index_0 and os_cpu_index_1, in picoseconds, for instance between two L3 caches or
+// packages, or between all pairs of core_os_indices. cpu_specs_init() must be called beforehand.
+// buffer is caller-provided scratch memory, of which only the first block aligned to the
+// destructive interference size is overwritten. Returns 0 if buffer_size is too small to hold that
+// block or threads couldn't be created. This takes about 10 ms per pair
+u64 cpu_bench_measure_ping_pong(s32 os_cpu_index_0, s32 os_cpu_index_1, void* buffer, u64 buffer_size);
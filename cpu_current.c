@@ -0,0 +1,137 @@
+#include "cpu_current.h"
+#include "cpu_specs.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Globals
+struct cpu_current cpu_current =
+{
+  .method = CPU_CURRENT_METHOD_NONE
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Helpers
+static void cpu_current_clear_keys(void)
+{
+  for (s32 key = 0; key < CPU_CURRENT_MAX_KEY_COUNT; key++)
+  {
+    cpu_current.logical_processor_indices[key] = -1;
+  }
+}
+
+#if !defined(ISA_arm64)
+// Find the logical processor of an OS index in cpu_topology, which is sorted by OS index.
+// Returns its index, or -1 if absent
+static s32 cpu_current_find_logical_processor(s32 os_cpu_index)
+{
+  s32 low  = 0;
+  s32 high = cpu_topology.logical_processor_count - 1;
+  while (low <= high)
+  {
+    s32 middle = (low + high) / 2;
+    s32 middle_os_index = cpu_topology.logical_processors[middle].os_index;
+    if (middle_os_index == os_cpu_index)
+    {
+      return middle;
+    }
+
+    if (middle_os_index < os_cpu_index)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle - 1;
+    }
+  }
+
+  return -1;
+}
+
+struct cpu_current_visit
+{
+  s32 method;
+  s32 is_valid;
+};
+
+// Called on each logical processor by os_for_each_cpu(): map its TSC_AUX value to it
+static void cpu_current_visit_cpu(s32 os_cpu_index, void* user_data)
+{
+  struct cpu_current_visit* visit = (struct cpu_current_visit*)user_data;
+
+  u32 key = (visit->method == CPU_CURRENT_METHOD_RDPID) ? CPU_CURRENT_READ_RDPID() : cpu_current_read_rdtscp();
+  key &= CPU_CURRENT_MAX_KEY_COUNT - 1;
+
+  // Logical processors absent from the topology got allowed after cpu_topology_init()
+  s32 lp_idx = cpu_current_find_logical_processor(os_cpu_index);
+  if ((lp_idx < 0) || ((cpu_current.logical_processor_indices[key] >= 0) && (cpu_current.logical_processor_indices[key] != lp_idx)))
+  {
+    visit->is_valid = 0;
+    return;
+  }
+
+  cpu_current.logical_processor_indices[key] = (s16)lp_idx;
+}
+
+// Learn the TSC_AUX value of each logical processor. Returns 1 if they all have distinct values
+static s32 cpu_current_learn_keys(s32 method)
+{
+  struct cpu_current_visit visit = {.method = method, .is_valid = 1};
+  s32 visited_cpu_count = os_for_each_cpu(cpu_current_visit_cpu, &visit);
+  if (!visit.is_valid || (visited_cpu_count != cpu_topology.logical_processor_count))
+  {
+    cpu_current_clear_keys();
+    return 0;
+  }
+
+  return 1;
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Initialization
+u32 cpu_current_init(void)
+{
+  cpu_current.method = CPU_CURRENT_METHOD_NONE;
+  cpu_current_clear_keys();
+  if (cpu_topology.logical_processor_count == 0)
+  {
+    return 0;
+  }
+
+#if !defined(ISA_arm64)
+  s32 method = CPU_CURRENT_METHOD_NONE;
+  if (cpu_specs.instructions & RDPID)
+  {
+    method = CPU_CURRENT_METHOD_RDPID;
+  }
+  else if (cpu_specs.instructions & RDTSCP)
+  {
+    method = CPU_CURRENT_METHOD_RDTSCP;
+  }
+
+  if ((method != CPU_CURRENT_METHOD_NONE) && cpu_current_learn_keys(method))
+  {
+    cpu_current.method = method;
+    return 1;
+  }
+#endif
+
+  if (os_get_current_cpu() < 0)
+  {
+    return 0;
+  }
+
+  for (s32 i = 0; i < cpu_topology.logical_processor_count; i++)
+  {
+    s32 os_cpu_index = cpu_topology.logical_processors[i].os_index;
+    if ((os_cpu_index >= 0) && (os_cpu_index < CPU_CURRENT_MAX_KEY_COUNT))
+    {
+      cpu_current.logical_processor_indices[os_cpu_index] = (s16)i;
+    }
+  }
+
+  cpu_current.method = CPU_CURRENT_METHOD_OS;
+  return 1;
+}
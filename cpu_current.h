@@ -0,0 +1,139 @@
+#pragma once
+
+#include "isa.h"
+#include "types.h"
+#include "cpu_topology.h"
+#include "os.h"
+
+// Logical processor the calling thread runs on, read in a few dozen cycles without a system call
+// when the CPU has RDPID or RDTSCP, for per-CPU data such as sharded counters or per-L3 free
+// lists. The thread may be migrated right after, so the result is only a hint: code indexing
+// per-CPU data with it must stay correct, if slower, with any index
+
+// As in cpu_tsc.h, cpu_intrinsics.h isn't included here, as this header is included by user code
+#if !defined(ISA_arm64)
+#  if defined(_MSC_VER)
+extern u32 _rdpid_u32(void);
+extern u64 __rdtscp(u32* aux);
+#    define CPU_CURRENT_READ_RDPID() _rdpid_u32()
+static inline u32 cpu_current_read_rdtscp(void)
+{
+  u32 aux;
+  __rdtscp(&aux);
+  return aux;
+}
+#  else
+static inline u32 cpu_current_read_rdpid(void)
+{
+  // RDPID EAX (RAX in 64-bit mode, whose upper half is 0), encoded by hand for older assemblers
+  u32 aux;
+  __asm__ __volatile__(".byte 0xF3, 0x0F, 0xC7, 0xF8" : "=a"(aux));
+  return aux;
+}
+#    define CPU_CURRENT_READ_RDPID() cpu_current_read_rdpid()
+static inline u32 cpu_current_read_rdtscp(void)
+{
+  u32 low;
+  u32 high;
+  u32 aux;
+  __asm__ __volatile__("rdtscp" : "=a"(low), "=d"(high), "=c"(aux));
+  return aux;
+}
+#  endif
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// enums and structs
+// Count of keys cpu_current maps to logical processors. Keys are the low 12 bits of TSC_AUX, in
+// which Linux stores the OS index below the NUMA node, or OS indices with CPU_CURRENT_METHOD_OS
+#define CPU_CURRENT_MAX_KEY_COUNT 4096
+
+// How cpu_current_index() identifies the logical processor the calling thread runs on
+enum cpu_current_method
+{
+  // Unknown, cpu_current_index() returns -1
+  CPU_CURRENT_METHOD_NONE = 0,
+
+  // Read TSC_AUX with RDPID, which is the fastest
+  CPU_CURRENT_METHOD_RDPID,
+
+  // Read TSC_AUX with RDTSCP, which also reads the TSC, and so takes a few more cycles
+  CPU_CURRENT_METHOD_RDTSCP,
+
+  // Ask the OS with sched_getcpu() or GetCurrentProcessorNumberEx(), which is used when the CPU
+  // lacks both instructions, or when the OS doesn't set TSC_AUX to distinct values
+  CPU_CURRENT_METHOD_OS
+};
+
+struct cpu_current
+{
+  // Method used, as an enum cpu_current_method value
+  s32 method;
+
+  // Index in cpu_topology.logical_processors of the logical processor of each key, or -1 if the
+  // process may not run on it
+  s16 logical_processor_indices[CPU_CURRENT_MAX_KEY_COUNT];
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Implementation
+extern struct cpu_current cpu_current;
+
+// Initialize the global cpu_current struct. cpu_specs_init() and cpu_topology_init() must be called
+// beforehand, and this must be called again after cpu_topology_init() refreshes the topology.
+// With RDPID or RDTSCP, the calling thread is pinned to each logical processor in turn to learn
+// its TSC_AUX value, which the OS sets but doesn't report, as cpu_topology_init() does. If two
+// logical processors share a value, the OS method is used instead. Returns 1 if cpu_current_index()
+// works, or 0 if it always returns -1, which is the case with an empty topology
+u32 cpu_current_init(void);
+
+// Return the index in cpu_topology.logical_processors of the logical processor the calling
+// thread runs on, or -1 if unknown
+static inline s32 cpu_current_index(void)
+{
+  u32 key;
+  switch (cpu_current.method)
+  {
+#if !defined(ISA_arm64)
+    case CPU_CURRENT_METHOD_RDPID:
+      key = CPU_CURRENT_READ_RDPID();
+      break;
+
+    case CPU_CURRENT_METHOD_RDTSCP:
+      key = cpu_current_read_rdtscp();
+      break;
+#endif
+
+    case CPU_CURRENT_METHOD_OS:
+    {
+      // OS indices beyond the table are unknown, rather than aliasing other logical processors
+      s32 os_cpu_index = os_get_current_cpu();
+      if ((os_cpu_index < 0) || (os_cpu_index >= CPU_CURRENT_MAX_KEY_COUNT))
+      {
+        return -1;
+      }
+      key = (u32)os_cpu_index;
+      break;
+    }
+
+    default:
+      return -1;
+  }
+
+  return cpu_current.logical_processor_indices[key & (CPU_CURRENT_MAX_KEY_COUNT - 1)];
+}
+
+// Return the core_id or l3_id of the logical processor the calling thread runs on, or -1 if
+// unknown. See struct cpu_logical_processor
+static inline s32 cpu_current_core_id(void)
+{
+  s32 lp_idx = cpu_current_index();
+  return (lp_idx >= 0) ? cpu_topology.logical_processors[lp_idx].core_id : -1;
+}
+
+static inline s32 cpu_current_l3_id(void)
+{
+  s32 lp_idx = cpu_current_index();
+  return (lp_idx >= 0) ? cpu_topology.logical_processors[lp_idx].l3_id : -1;
+}
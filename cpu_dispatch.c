@@ -0,0 +1,67 @@
+#include "cpu_dispatch.h"
+#include "cpu_intrinsics.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Globals
+// State of the cpu_specs_init() call made by cpu_dispatch_resolve()
+enum cpu_dispatch_init_state
+{
+  CPU_DISPATCH_INIT_PENDING = 0,
+  CPU_DISPATCH_INIT_RUNNING,
+  CPU_DISPATCH_INIT_DONE
+};
+
+static long volatile cpu_dispatch_init_state = CPU_DISPATCH_INIT_PENDING;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Dispatch
+cpu_dispatch_func cpu_dispatch_select(const struct cpu_dispatch_impl* impls, s32 impl_count)
+{
+  u64 available_instructions = cpu_specs.instructions;
+  const struct cpu_dispatch_impl* selected_impl = 0;
+
+  for (s32 i = 0; i < impl_count; i++)
+  {
+    const struct cpu_dispatch_impl* impl = &impls[i];
+    s32 is_runnable = (impl->required_instructions & available_instructions) == impl->required_instructions;
+
+    if (is_runnable && ((selected_impl == 0) || (impl->priority > selected_impl->priority)))
+    {
+      selected_impl = impl;
+    }
+  }
+
+  return selected_impl ? selected_impl->func : 0;
+}
+
+cpu_dispatch_func cpu_dispatch_resolve(const struct cpu_dispatch_impl* impls, s32 impl_count)
+{
+  // Lazily dispatched kernels may be called before the program initializes cpu_specs, whose
+  // defaults would select the fallback forever. The first caller initializes it, others wait
+  if (cpu_load_acquire(&cpu_dispatch_init_state) != CPU_DISPATCH_INIT_DONE)
+  {
+    if (_InterlockedCompareExchange(&cpu_dispatch_init_state, CPU_DISPATCH_INIT_RUNNING, CPU_DISPATCH_INIT_PENDING) == CPU_DISPATCH_INIT_PENDING)
+    {
+      if (!cpu_specs.is_initialized)
+      {
+        cpu_specs_init();
+      }
+      cpu_store_release(&cpu_dispatch_init_state, CPU_DISPATCH_INIT_DONE);
+    }
+
+    while (cpu_load_acquire(&cpu_dispatch_init_state) != CPU_DISPATCH_INIT_DONE)
+    {
+    }
+  }
+
+  return cpu_dispatch_select(impls, impl_count);
+}
+
+void cpu_dispatch_patch(const struct cpu_dispatch_slot* slots, s32 slot_count)
+{
+  for (s32 i = 0; i < slot_count; i++)
+  {
+    slots[i].store(cpu_dispatch_select(slots[i].impls, slots[i].impl_count));
+  }
+}
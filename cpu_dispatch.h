@@ -0,0 +1,128 @@
+#pragma once
+
+#include "cpu_specs.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// enums and structs
+// Generic function pointer type. Any function pointer can be cast to it, then back to its original
+// type before being called
+typedef void (*cpu_dispatch_func)(void);
+
+struct cpu_dispatch_impl
+{
+  // One implementation of a kernel, cast to cpu_dispatch_func
+  cpu_dispatch_func func;
+
+  // Instructions required by this implementation, as CPU_INSTRUCTION() flags. Use 0 for a
+  // portable fallback
+  u64 required_instructions;
+
+  // Among the implementations whose required instructions are all available, the one with the
+  // highest priority is selected. Ties are won by the first one listed
+  s32 priority;
+};
+
+struct cpu_dispatch_slot
+{
+  // Function storing the selected implementation in the function pointer to patch, cast back to
+  // the pointer's own type. See CPU_DISPATCH_STORE_FUNC()
+  void (*store)(cpu_dispatch_func func);
+
+  // Candidate implementations for the function pointer
+  const struct cpu_dispatch_impl* impls;
+  s32                             impl_count;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Implementation
+// Shorthand to fill a struct cpu_dispatch_impl from any function
+#define CPU_DISPATCH_IMPL(func, required_instructions, priority) \
+  {(cpu_dispatch_func)(func), (required_instructions), (priority)}
+
+// Define a static function called store_name, storing a cpu_dispatch_func in the function pointer
+// called pointer, of type pointer_type, to fill the store field of a struct cpu_dispatch_slot
+#define CPU_DISPATCH_STORE_FUNC(store_name, pointer, pointer_type) \
+  static void store_name(cpu_dispatch_func func)                   \
+  {                                                                \
+    pointer = (pointer_type)func;                                  \
+  }
+
+// Load and store a function pointer shared between threads, of type type. Relaxed atomics are
+// enough, since the pointer only points to code
+#if defined(_MSC_VER)
+// Aligned pointer-sized volatile accesses are single-copy atomic on all MSVC targets
+#  define CPU_DISPATCH_LOAD(type, pointer)         (*(type volatile*)&(pointer))
+#  define CPU_DISPATCH_STORE(type, pointer, value) (*(type volatile*)&(pointer) = (type)(value))
+#else
+#  define CPU_DISPATCH_LOAD(type, pointer)         __atomic_load_n(&(pointer), __ATOMIC_RELAXED)
+#  define CPU_DISPATCH_STORE(type, pointer, value) __atomic_store_n(&(pointer), (type)(value), __ATOMIC_RELAXED)
+#endif
+
+// Return the implementation with the highest priority among the ones whose required instructions
+// are all set in cpu_specs.instructions, or 0 if there is none. cpu_specs_init() should be called
+// beforehand, otherwise only the implementations runnable on a low-end CPU are considered
+cpu_dispatch_func cpu_dispatch_select(const struct cpu_dispatch_impl* impls, s32 impl_count);
+
+// Same as cpu_dispatch_select(), calling cpu_specs_init() first if cpu_specs isn't initialized.
+// Concurrent first calls wait for a single cpu_specs_init() call. Used by CPU_DISPATCH_LAZY()
+cpu_dispatch_func cpu_dispatch_resolve(const struct cpu_dispatch_impl* impls, s32 impl_count);
+
+// Patch every slot's function pointer with cpu_dispatch_select()'s result. This is meant to be
+// called once, right after cpu_specs_init(), so that kernels are then called through a single
+// indirect call without any feature test. Function pointers are stored as plain variables, so this
+// must be done before other threads call them. For instance:
+//
+//   static float (*sum)(const float* values, s32 count);
+//   CPU_DISPATCH_STORE_FUNC(sum_store, sum, float (*)(const float*, s32))
+//   static const struct cpu_dispatch_slot slots[] = {{sum_store, sum_impls, 3}};
+void cpu_dispatch_patch(const struct cpu_dispatch_slot* slots, s32 slot_count);
+
+// Define a static function called name, which selects its implementation from the impls array on
+// its first call, after calling cpu_specs_init() if it hasn't been, then calls it through a
+// function pointer on subsequent calls. parameters is the parenthesized parameter list of the
+// kernel, and arguments the parenthesized list of their names. impls must contain a fallback
+// without required instructions. For instance:
+//
+//   static const struct cpu_dispatch_impl sum_impls[] =
+//   {
+//     CPU_DISPATCH_IMPL(sum_avx2, AVX2, 2),
+//     CPU_DISPATCH_IMPL(sum_sse2, SSE2, 1),
+//     CPU_DISPATCH_IMPL(sum_c,    0,    0)
+//   };
+//   CPU_DISPATCH_LAZY(float, sum, (const float* values, s32 count), (values, count), sum_impls)
+//
+// Concurrent first calls are harmless: they all select and atomically store the same
+// implementation
+#define CPU_DISPATCH_LAZY(return_type, name, parameters, arguments, impls)             \
+  typedef return_type (*name##_func_type) parameters;                                  \
+  static return_type name##_resolve parameters;                                        \
+  static name##_func_type name##_func = name##_resolve;                                \
+  static inline return_type name parameters                                            \
+  {                                                                                    \
+    return CPU_DISPATCH_LOAD(name##_func_type, name##_func) arguments;                 \
+  }                                                                                    \
+  static return_type name##_resolve parameters                                         \
+  {                                                                                    \
+    s32 impl_count = (s32)(sizeof(impls) / sizeof(impls[0]));                          \
+    name##_func_type func = (name##_func_type)cpu_dispatch_resolve(impls, impl_count); \
+    CPU_DISPATCH_STORE(name##_func_type, name##_func, func);                           \
+    return func arguments;                                                             \
+  }
+
+// Same as CPU_DISPATCH_LAZY(), for kernels returning void
+#define CPU_DISPATCH_LAZY_VOID(name, parameters, arguments, impls)                     \
+  typedef void (*name##_func_type) parameters;                                         \
+  static void name##_resolve parameters;                                               \
+  static name##_func_type name##_func = name##_resolve;                                \
+  static inline void name parameters                                                   \
+  {                                                                                    \
+    CPU_DISPATCH_LOAD(name##_func_type, name##_func) arguments;                        \
+  }                                                                                    \
+  static void name##_resolve parameters                                                \
+  {                                                                                    \
+    s32 impl_count = (s32)(sizeof(impls) / sizeof(impls[0]));                          \
+    name##_func_type func = (name##_func_type)cpu_dispatch_resolve(impls, impl_count); \
+    CPU_DISPATCH_STORE(name##_func_type, name##_func, func);                           \
+    func arguments;                                                                    \
+  }
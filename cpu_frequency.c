@@ -0,0 +1,60 @@
+#include "cpu_frequency.h"
+#include "cpu_tsc.h"
+#include "os.h"
+
+// MSR indices of the counters, shared by Intel and AMD
+#define CPU_FREQUENCY_MSR_MPERF 0xE7
+#define CPU_FREQUENCY_MSR_APERF 0xE8
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Sampling
+s32 cpu_frequency_sample(s32 os_cpu_index, struct cpu_frequency_sample* sample)
+{
+  sample->os_cpu_index = os_cpu_index;
+  sample->aperf        = 0;
+  sample->mperf        = 0;
+  if (!cpu_specs.has_aperf_mperf)
+  {
+    return 0;
+  }
+
+  // Each counter takes its own system call, microseconds apart, which is negligible over samples
+  // a few milliseconds apart
+  return os_read_msr(os_cpu_index, CPU_FREQUENCY_MSR_MPERF, &sample->mperf)
+      && os_read_msr(os_cpu_index, CPU_FREQUENCY_MSR_APERF, &sample->aperf);
+}
+
+u64 cpu_frequency_get_effective(const struct cpu_frequency_sample* begin, const struct cpu_frequency_sample* end)
+{
+  // The TSC's rate, which MPERF shares
+  u64 reference_frequency = cpu_specs.tsc_frequency;
+  if (reference_frequency == 0)
+  {
+    reference_frequency = (u64)cpu_specs.base_frequency_mhz * 1000000;
+  }
+  if (reference_frequency == 0)
+  {
+    reference_frequency = cpu_tsc.frequency;
+  }
+
+  u64 aperf_delta = end->aperf - begin->aperf;
+  u64 mperf_delta = end->mperf - begin->mperf;
+  if ((begin->os_cpu_index != end->os_cpu_index) || (mperf_delta == 0) || (reference_frequency == 0))
+  {
+    return 0;
+  }
+
+  // In kHz, below 2^23 for any realistic frequency, so that the product fits in 64 bits with
+  // deltas below 2^40, which is several minutes of counting
+  while (aperf_delta >> 40)
+  {
+    aperf_delta >>= 1;
+    mperf_delta >>= 1;
+  }
+  if (mperf_delta == 0)
+  {
+    return 0;
+  }
+
+  return (reference_frequency / 1000) * aperf_delta / mperf_delta * 1000;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "types.h"
+#include "cpu_specs.h"
+
+// Effective frequency of a logical processor, from its APERF and MPERF counters. Both only count
+// while the core is active (C0): MPERF at the constant rate of the TSC, and APERF at the actual
+// clock, so that their ratio over a period is the average clock relative to the TSC's, including
+// turbo and the downclocking of heavy AVX code. Reading them takes a system call per counter, and
+// requires privileges, see os_read_msr()
+
+// APERF and MPERF as read at some point on one logical processor
+struct cpu_frequency_sample
+{
+  // OS index of the logical processor the counters were read from
+  s32 os_cpu_index;
+
+  // Actual (APERF, IA32_APERF) and maximum (MPERF, IA32_MPERF) performance frequency clock counts
+  u64 aperf;
+  u64 mperf;
+};
+
+// Sample APERF and MPERF of the logical processor of OS index os_cpu_index, such as the one
+// os_get_current_cpu() returns, into sample. cpu_specs_init() must be called beforehand. Returns 1
+// on success, or 0 if cpu_specs.has_aperf_mperf is 0 or the counters couldn't be read, as on
+// Windows, on ARM64 and without privileges
+s32 cpu_frequency_sample(s32 os_cpu_index, struct cpu_frequency_sample* sample);
+
+// Estimate the average frequency in Hz of a logical processor while it was active between two of
+// its samples, begin being the older one. MPERF's rate is cpu_specs.tsc_frequency or
+// cpu_specs.base_frequency_mhz, or cpu_tsc.frequency on CPUs which report neither, such as AMD's,
+// for which cpu_tsc_init() must be called beforehand. Samples should be a few milliseconds
+// apart, as reading APERF and MPERF isn't atomic. Returns 0 if the samples come from different
+// logical processors, the core was idle in between or MPERF's rate is unknown
+u64 cpu_frequency_get_effective(const struct cpu_frequency_sample* begin, const struct cpu_frequency_sample* end);
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "isa.h"
+#include "types.h"
+
+#if defined(ISA_x64) || defined(ISA_x86)
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// x86
+#if defined(ISA_x64)
+#  define eflags_type u64
+#elif defined(ISA_x86)
+#  define eflags_type u32
+#endif
+
+#if defined(_MSC_VER)
+// Declare the specific intrinsics used by this library as extern, rather than including the
+// 1025-line-long intrin.h header
+extern eflags_type __readeflags(void);
+extern void        __writeeflags(eflags_type new_eflags);
+extern void        __cpuidex(s32 out[4], s32 func, s32 sub_func);
+extern u64         _xgetbv(u32 xcr);
+extern u64         __rdtsc(void);
+extern long        _InterlockedIncrement(long volatile* addend);
+extern long        _InterlockedCompareExchange(long volatile* destination, long exchange, long comparand);
+#else
+// Implement the same intrinsics with GCC and Clang builtins and inline assembly, rather than
+// including cpuid.h and x86intrin.h. Since these headers define some of the same names, this
+// header must only be included by the library's source files
+static inline eflags_type __readeflags(void)
+{
+#  if defined(ISA_x64)
+  return __builtin_ia32_readeflags_u64();
+#  else
+  return __builtin_ia32_readeflags_u32();
+#  endif
+}
+
+static inline void __writeeflags(eflags_type new_eflags)
+{
+#  if defined(ISA_x64)
+  __builtin_ia32_writeeflags_u64(new_eflags);
+#  else
+  __builtin_ia32_writeeflags_u32(new_eflags);
+#  endif
+}
+
+static inline void __cpuidex(s32 out[4], s32 func, s32 sub_func)
+{
+  __asm__ __volatile__("cpuid"
+                       : "=a"(out[0]), "=b"(out[1]), "=c"(out[2]), "=d"(out[3])
+                       : "a"(func), "c"(sub_func));
+}
+
+static inline u64 _xgetbv(u32 xcr)
+{
+  u32 eax;
+  u32 edx;
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(xcr));
+
+  return ((u64)edx << 32) | eax;
+}
+
+static inline u64 __rdtsc(void)
+{
+  return __builtin_ia32_rdtsc();
+}
+
+static inline long _InterlockedIncrement(long volatile* addend)
+{
+  return __atomic_add_fetch(addend, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline long _InterlockedCompareExchange(long volatile* destination, long exchange, long comparand)
+{
+  __atomic_compare_exchange_n(destination, &comparand, exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  return comparand;
+}
+#endif
+#elif defined(ISA_arm64)
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// ARM64
+// System registers readable from user mode, encoded as MSVC's ARM64_SYSREG() does
+#define ARM64_SYSREG(op0, op1, crn, crm, op2) \
+  ((((op0) & 1) << 14) | (((op1) & 7) << 11) | (((crn) & 15) << 7) | (((crm) & 15) << 3) | ((op2) & 7))
+
+#define ARM64_MIDR_EL1   ARM64_SYSREG(3, 0,  0, 0, 0)
+#define ARM64_CTR_EL0    ARM64_SYSREG(3, 3,  0, 0, 1)
+#define ARM64_CNTFRQ_EL0 ARM64_SYSREG(3, 3, 14, 0, 0)
+#define ARM64_CNTVCT_EL0 ARM64_SYSREG(3, 3, 14, 0, 2)
+
+#if defined(_MSC_VER)
+extern s64  _ReadStatusReg(s32 reg);
+extern long _InterlockedIncrement(long volatile* addend);
+extern long _InterlockedCompareExchange(long volatile* destination, long exchange, long comparand);
+#else
+// MRS takes the register as an immediate, so each one gets its own instruction. reg is a constant
+// in all calls, so this folds to a single MRS
+static inline s64 _ReadStatusReg(s32 reg)
+{
+  u64 value = 0;
+  switch (reg)
+  {
+    case ARM64_MIDR_EL1:
+      __asm__ __volatile__("mrs %0, midr_el1" : "=r"(value));
+      break;
+    case ARM64_CTR_EL0:
+      __asm__ __volatile__("mrs %0, ctr_el0" : "=r"(value));
+      break;
+    case ARM64_CNTFRQ_EL0:
+      __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(value));
+      break;
+    case ARM64_CNTVCT_EL0:
+      __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(value));
+      break;
+  }
+
+  return (s64)value;
+}
+
+static inline long _InterlockedIncrement(long volatile* addend)
+{
+  return __atomic_add_fetch(addend, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline long _InterlockedCompareExchange(long volatile* destination, long exchange, long comparand)
+{
+  __atomic_compare_exchange_n(destination, &comparand, exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  return comparand;
+}
+#endif
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Atomics
+// Load with acquire and store with release semantics, for flags and counters other threads spin
+// on: writes made before a release store are visible after the acquire load reading its value
+#if defined(_MSC_VER) && defined(ISA_arm64)
+extern u32  __ldar32(u32 volatile* address);
+extern void __stlr32(u32 volatile* address, u32 value);
+
+static inline long cpu_load_acquire(long volatile* address)
+{
+  return (long)__ldar32((u32 volatile*)address);
+}
+
+static inline void cpu_store_release(long volatile* address, long value)
+{
+  __stlr32((u32 volatile*)address, (u32)value);
+}
+#elif defined(_MSC_VER)
+// x86 loads already acquire and stores already release, only the compiler mustn't reorder them
+extern void _ReadWriteBarrier(void);
+
+static inline long cpu_load_acquire(long volatile* address)
+{
+  long value = *address;
+  _ReadWriteBarrier();
+  return value;
+}
+
+static inline void cpu_store_release(long volatile* address, long value)
+{
+  _ReadWriteBarrier();
+  *address = value;
+}
+#else
+static inline long cpu_load_acquire(long volatile* address)
+{
+  return __atomic_load_n(address, __ATOMIC_ACQUIRE);
+}
+
+static inline void cpu_store_release(long volatile* address, long value)
+{
+  __atomic_store_n(address, value, __ATOMIC_RELEASE);
+}
+#endif
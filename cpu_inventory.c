@@ -0,0 +1,374 @@
+#include "cpu_inventory.h"
+#include "cpu_topology.h"
+#include "cpu_tlb.h"
+#include "cpu_rdt.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Writer
+// Text being written into a caller-provided buffer. Once full, writes are dropped and overflowed
+// is set, so that callers check for it once at the end
+struct cpu_inventory_writer
+{
+  schar8* text;
+  s32     text_size;
+  s32     length;
+  s32     overflowed;
+};
+
+static void cpu_inventory_append_char(struct cpu_inventory_writer* writer, schar8 character)
+{
+  // The last byte is kept for the null terminator
+  if (writer->length >= writer->text_size - 1)
+  {
+    writer->overflowed = 1;
+    return;
+  }
+
+  writer->text[writer->length++] = character;
+}
+
+static void cpu_inventory_append_string(struct cpu_inventory_writer* writer, const schar8* string)
+{
+  while (*string)
+  {
+    cpu_inventory_append_char(writer, *string++);
+  }
+}
+
+static void cpu_inventory_append_u64(struct cpu_inventory_writer* writer, u64 value, u32 base)
+{
+  schar8 digits[20];
+  s32    digit_count = 0;
+  do
+  {
+    u32 digit = (u32)(value % base);
+    digits[digit_count++] = (schar8)((digit < 10) ? '0' + digit : 'A' + digit - 10);
+    value /= base;
+  }
+  while (value != 0);
+
+  while (digit_count != 0)
+  {
+    cpu_inventory_append_char(writer, digits[--digit_count]);
+  }
+}
+
+// Start the line of key <prefix><index>.<name>, where index is left out if negative, such as
+// "specs.cache.l" 1 "data_cache_size" for "specs.cache.l1.data_cache_size"
+static void cpu_inventory_begin_line(struct cpu_inventory_writer* writer, const schar8* prefix, s32 index, const schar8* name)
+{
+  cpu_inventory_append_string(writer, prefix);
+  if (index >= 0)
+  {
+    cpu_inventory_append_u64(writer, (u64)index, 10);
+    cpu_inventory_append_char(writer, '.');
+  }
+  cpu_inventory_append_string(writer, name);
+  cpu_inventory_append_char(writer, '=');
+}
+
+static void cpu_inventory_write_decimal(struct cpu_inventory_writer* writer, const schar8* prefix, s32 index, const schar8* name, s64 value)
+{
+  cpu_inventory_begin_line(writer, prefix, index, name);
+  if (value < 0)
+  {
+    cpu_inventory_append_char(writer, '-');
+  }
+  cpu_inventory_append_u64(writer, (value < 0) ? (u64)0 - (u64)value : (u64)value, 10);
+  cpu_inventory_append_char(writer, '\n');
+}
+
+static void cpu_inventory_write_hexadecimal(struct cpu_inventory_writer* writer, const schar8* prefix, s32 index, const schar8* name, u64 value)
+{
+  cpu_inventory_begin_line(writer, prefix, index, name);
+  cpu_inventory_append_string(writer, (const schar8*)"0x");
+  cpu_inventory_append_u64(writer, value, 16);
+  cpu_inventory_append_char(writer, '\n');
+}
+
+// Write up to max_length characters of text, stopping at its null terminator, without trailing
+// spaces, which pad AMD's CPU names. Control characters would break lines, and are replaced
+static void cpu_inventory_write_text(struct cpu_inventory_writer* writer, const schar8* prefix, const schar8* name, const schar8* text, s32 max_length)
+{
+  s32 length = 0;
+  while ((length < max_length) && (text[length] != 0))
+  {
+    length++;
+  }
+  while ((length > 0) && (text[length - 1] == ' '))
+  {
+    length--;
+  }
+
+  cpu_inventory_begin_line(writer, prefix, -1, name);
+  for (s32 i = 0; i < length; i++)
+  {
+    cpu_inventory_append_char(writer, ((u8)text[i] < 0x20) ? '?' : text[i]);
+  }
+  cpu_inventory_append_char(writer, '\n');
+}
+
+// Keys are string literals, which are char arrays
+#define CPU_INVENTORY_WRITE_DECIMAL(writer, prefix, index, name, value) \
+  cpu_inventory_write_decimal(writer, (const schar8*)(prefix), index, (const schar8*)(name), (s64)(value))
+#define CPU_INVENTORY_WRITE_HEXADECIMAL(writer, prefix, index, name, value) \
+  cpu_inventory_write_hexadecimal(writer, (const schar8*)(prefix), index, (const schar8*)(name), (u64)(value))
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Sections
+// Levels are numbered from 1, as in their names, and only written when the cache exists
+static void cpu_inventory_write_caches(struct cpu_inventory_writer* writer, const schar8* prefix, const struct cpu_cache_level_specs* cache_level_specs)
+{
+  for (s32 level = L1; level < CACHE_LEVEL_COUNT; level++)
+  {
+    const struct cpu_cache_level_specs* specs = &cache_level_specs[level];
+    if (specs->data_cache_size == 0)
+    {
+      continue;
+    }
+
+    CPU_INVENTORY_WRITE_DECIMAL(writer, prefix, level + 1, "data_cache_size",           specs->data_cache_size);
+    CPU_INVENTORY_WRITE_DECIMAL(writer, prefix, level + 1, "attached_core_count",       specs->attached_core_count);
+    CPU_INVENTORY_WRITE_DECIMAL(writer, prefix, level + 1, "max_attached_thread_count", specs->max_attached_thread_count);
+    CPU_INVENTORY_WRITE_DECIMAL(writer, prefix, level + 1, "type",                      specs->type);
+    CPU_INVENTORY_WRITE_DECIMAL(writer, prefix, level + 1, "line_size",                 specs->line_size);
+    CPU_INVENTORY_WRITE_DECIMAL(writer, prefix, level + 1, "ways",                      specs->ways);
+    CPU_INVENTORY_WRITE_DECIMAL(writer, prefix, level + 1, "partitions",                specs->partitions);
+    CPU_INVENTORY_WRITE_DECIMAL(writer, prefix, level + 1, "sets",                      specs->sets);
+    CPU_INVENTORY_WRITE_DECIMAL(writer, prefix, level + 1, "is_inclusive",              specs->is_inclusive);
+    CPU_INVENTORY_WRITE_DECIMAL(writer, prefix, level + 1, "has_complex_indexing",      specs->has_complex_indexing);
+  }
+}
+
+static void cpu_inventory_write_specs(struct cpu_inventory_writer* writer)
+{
+  cpu_inventory_write_text(writer, (const schar8*)"identity.", (const schar8*)"manufacturer", cpu_identity.manufacturer, sizeof(cpu_identity.manufacturer));
+  cpu_inventory_write_text(writer, (const schar8*)"identity.", (const schar8*)"name", cpu_identity.name, sizeof(cpu_identity.name));
+  CPU_INVENTORY_WRITE_HEXADECIMAL(writer, "identity.", -1, "family",   cpu_identity.family);
+  CPU_INVENTORY_WRITE_HEXADECIMAL(writer, "identity.", -1, "model",    cpu_identity.model);
+  CPU_INVENTORY_WRITE_HEXADECIMAL(writer, "identity.", -1, "stepping", cpu_identity.stepping);
+
+  CPU_INVENTORY_WRITE_HEXADECIMAL(writer, "specs.", -1, "instructions",           cpu_specs.instructions);
+  CPU_INVENTORY_WRITE_HEXADECIMAL(writer, "specs.", -1, "disabled_instructions",  cpu_specs.disabled_instructions);
+  CPU_INVENTORY_WRITE_DECIMAL(writer,     "specs.", -1, "x86_64_level",           cpu_specs.x86_64_level);
+  CPU_INVENTORY_WRITE_DECIMAL(writer,     "specs.", -1, "preferred_vector_width", cpu_specs.preferred_vector_width);
+  CPU_INVENTORY_WRITE_DECIMAL(writer,     "specs.", -1, "sve_vector_length",      cpu_specs.sve_vector_length);
+
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "core_count",       cpu_specs.core_count);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "threads_per_core", cpu_specs.threads_per_core);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "is_hybrid",        cpu_specs.is_hybrid);
+
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "cache_line_size",                cpu_specs.cache_line_size);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "constructive_interference_size", cpu_specs.constructive_interference_size);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "destructive_interference_size",  cpu_specs.destructive_interference_size);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "non_temporal_threshold",         cpu_specs.non_temporal_threshold);
+  cpu_inventory_write_caches(writer, (const schar8*)"specs.cache.l", cpu_specs.cache_level_specs);
+  cpu_inventory_write_caches(writer, (const schar8*)"specs.instruction_cache.l", cpu_specs.instruction_cache_level_specs);
+
+  // Performance cores are already described above
+  if (cpu_specs.is_hybrid)
+  {
+    const struct cpu_core_type_specs* efficient_specs = &cpu_specs.core_type_specs[CPU_CORE_TYPE_EFFICIENT];
+    CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.efficient.", -1, "core_count",       efficient_specs->core_count);
+    CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.efficient.", -1, "threads_per_core", efficient_specs->threads_per_core);
+    cpu_inventory_write_caches(writer, (const schar8*)"specs.efficient.cache.l", efficient_specs->cache_level_specs);
+    cpu_inventory_write_caches(writer, (const schar8*)"specs.efficient.instruction_cache.l", efficient_specs->instruction_cache_level_specs);
+  }
+
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "has_invariant_tsc",                 cpu_specs.has_invariant_tsc);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "tsc_frequency",                     cpu_specs.tsc_frequency);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "base_frequency_mhz",                cpu_specs.base_frequency_mhz);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "max_frequency_mhz",                 cpu_specs.max_frequency_mhz);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "bus_frequency_mhz",                 cpu_specs.bus_frequency_mhz);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "has_turbo_boost",                   cpu_specs.has_turbo_boost);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "has_hardware_pstates",              cpu_specs.has_hardware_pstates);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "has_energy_performance_preference", cpu_specs.has_energy_performance_preference);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "has_aperf_mperf",                   cpu_specs.has_aperf_mperf);
+
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "hypervisor",            cpu_specs.hypervisor);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "is_topology_untrusted", cpu_specs.is_topology_untrusted);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "has_paravirtual_clock", cpu_specs.has_paravirtual_clock);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "specs.", -1, "apic_timer_frequency",  cpu_specs.apic_timer_frequency);
+}
+
+static void cpu_inventory_write_topology(struct cpu_inventory_writer* writer)
+{
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "topology.", -1, "logical_processor_count", cpu_topology.logical_processor_count);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "topology.", -1, "core_count",              cpu_topology.core_count);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "topology.", -1, "die_count",               cpu_topology.die_count);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "topology.", -1, "package_count",           cpu_topology.package_count);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "topology.", -1, "l2_count",                cpu_topology.l2_count);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "topology.", -1, "l3_count",                cpu_topology.l3_count);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "topology.", -1, "numa_node_count",         cpu_topology.numa_node_count);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "topology.", -1, "is_untrusted",            cpu_topology.is_untrusted);
+}
+
+static void cpu_inventory_write_tlbs(struct cpu_inventory_writer* writer, const schar8* prefix, const struct cpu_tlb_level_specs* tlb_level_specs)
+{
+  static const schar8 entries_names[CPU_PAGE_SIZE_COUNT][12] = {"entries_4k", "entries_2m", "entries_1g"};
+  static const schar8 ways_names[CPU_PAGE_SIZE_COUNT][12]    = {"ways_4k", "ways_2m", "ways_1g"};
+
+  for (s32 level = CPU_TLB_L1; level < CPU_TLB_LEVEL_COUNT; level++)
+  {
+    for (s32 page_size = CPU_PAGE_SIZE_4K; page_size < CPU_PAGE_SIZE_COUNT; page_size++)
+    {
+      cpu_inventory_write_decimal(writer, prefix, level + 1, entries_names[page_size], tlb_level_specs[level].entries[page_size]);
+      cpu_inventory_write_decimal(writer, prefix, level + 1, ways_names[page_size],    tlb_level_specs[level].ways[page_size]);
+    }
+  }
+}
+
+static void cpu_inventory_write_tlb(struct cpu_inventory_writer* writer)
+{
+  cpu_inventory_write_tlbs(writer, (const schar8*)"tlb.data.l", cpu_tlb_specs.data_tlb_level_specs);
+  cpu_inventory_write_tlbs(writer, (const schar8*)"tlb.instruction.l", cpu_tlb_specs.instruction_tlb_level_specs);
+
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "tlb.", -1, "has_1g_pages",          cpu_tlb_specs.has_1g_pages);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "tlb.", -1, "has_pcid",              cpu_tlb_specs.has_pcid);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "tlb.", -1, "has_invpcid",           cpu_tlb_specs.has_invpcid);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "tlb.", -1, "physical_address_bits", cpu_tlb_specs.physical_address_bits);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "tlb.", -1, "linear_address_bits",   cpu_tlb_specs.linear_address_bits);
+}
+
+static void cpu_inventory_write_rdt(struct cpu_inventory_writer* writer)
+{
+  for (s32 level = L1; level < CACHE_LEVEL_COUNT; level++)
+  {
+    const struct cpu_rdt_cache_allocation_specs* specs = &cpu_rdt_specs.cache_allocation_specs[level];
+    if (!specs->is_supported)
+    {
+      continue;
+    }
+
+    CPU_INVENTORY_WRITE_DECIMAL(writer,     "rdt.cache_allocation.l", level + 1, "clos_count",                   specs->clos_count);
+    CPU_INVENTORY_WRITE_DECIMAL(writer,     "rdt.cache_allocation.l", level + 1, "capacity_bitmask_length",      specs->capacity_bitmask_length);
+    CPU_INVENTORY_WRITE_HEXADECIMAL(writer, "rdt.cache_allocation.l", level + 1, "shareable_bitmask",            specs->shareable_bitmask);
+    CPU_INVENTORY_WRITE_DECIMAL(writer,     "rdt.cache_allocation.l", level + 1, "has_code_data_prioritization", specs->has_code_data_prioritization);
+    CPU_INVENTORY_WRITE_DECIMAL(writer,     "rdt.cache_allocation.l", level + 1, "has_noncontiguous_bitmasks",   specs->has_noncontiguous_bitmasks);
+  }
+
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "rdt.", -1, "memory_bandwidth_type",          cpu_rdt_specs.memory_bandwidth_type);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "rdt.", -1, "memory_bandwidth_clos_count",    cpu_rdt_specs.memory_bandwidth_clos_count);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "rdt.", -1, "memory_bandwidth_max_value",     cpu_rdt_specs.memory_bandwidth_max_value);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "rdt.", -1, "memory_bandwidth_granularity",   cpu_rdt_specs.memory_bandwidth_granularity);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "rdt.", -1, "has_cache_occupancy_monitoring", cpu_rdt_specs.has_cache_occupancy_monitoring);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "rdt.", -1, "has_total_bandwidth_monitoring", cpu_rdt_specs.has_total_bandwidth_monitoring);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "rdt.", -1, "has_local_bandwidth_monitoring", cpu_rdt_specs.has_local_bandwidth_monitoring);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "rdt.", -1, "rmid_count",                     cpu_rdt_specs.rmid_count);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "rdt.", -1, "monitoring_upscaling_factor",    cpu_rdt_specs.monitoring_upscaling_factor);
+  CPU_INVENTORY_WRITE_DECIMAL(writer, "rdt.", -1, "monitoring_counter_width",       cpu_rdt_specs.monitoring_counter_width);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Implementation
+s32 cpu_inventory_write(char* text, s32 text_size, u32 sections)
+{
+  if (text_size <= 0)
+  {
+    return 0;
+  }
+
+  struct cpu_inventory_writer writer = {.text = (schar8*)text, .text_size = text_size};
+  CPU_INVENTORY_WRITE_DECIMAL(&writer, "cpu_inventory.", -1, "version", CPU_INVENTORY_VERSION);
+  cpu_inventory_write_specs(&writer);
+  if (sections & CPU_INVENTORY_TOPOLOGY)
+  {
+    cpu_inventory_write_topology(&writer);
+  }
+  if (sections & CPU_INVENTORY_TLB)
+  {
+    cpu_inventory_write_tlb(&writer);
+  }
+  if (sections & CPU_INVENTORY_RDT)
+  {
+    cpu_inventory_write_rdt(&writer);
+  }
+  CPU_INVENTORY_WRITE_HEXADECIMAL(&writer, "cpu_inventory.", -1, "fingerprint", cpu_inventory_get_fingerprint());
+
+  // A truncated inventory would be silently misread, so nothing is returned rather than part of it
+  writer.length = writer.overflowed ? 0 : writer.length;
+  text[writer.length] = 0;
+
+  return writer.length;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Fingerprint
+#define CPU_INVENTORY_FNV_OFFSET_BASIS 0xCBF29CE484222325ull
+#define CPU_INVENTORY_FNV_PRIME        0x00000100000001B3ull
+
+static u64 cpu_inventory_hash_bytes(u64 hash, const u8* bytes, s32 count)
+{
+  for (s32 i = 0; i < count; i++)
+  {
+    hash = (hash ^ bytes[i]) * CPU_INVENTORY_FNV_PRIME;
+  }
+
+  return hash;
+}
+
+// Values are hashed as 8 little-endian bytes rather than in memory, so that the hash doesn't
+// depend on the byte order, the size of fields nor the padding of structs
+static u64 cpu_inventory_hash_u64(u64 hash, u64 value)
+{
+  u8 bytes[8];
+  for (s32 i = 0; i < 8; i++)
+  {
+    bytes[i] = (u8)(value >> (i * 8));
+  }
+
+  return cpu_inventory_hash_bytes(hash, bytes, 8);
+}
+
+static u64 cpu_inventory_hash_caches(u64 hash, const struct cpu_cache_level_specs* cache_level_specs)
+{
+  for (s32 level = L1; level < CACHE_LEVEL_COUNT; level++)
+  {
+    const struct cpu_cache_level_specs* specs = &cache_level_specs[level];
+    hash = cpu_inventory_hash_u64(hash, (u64)(s64)specs->data_cache_size);
+    hash = cpu_inventory_hash_u64(hash, (u64)(s64)specs->max_attached_thread_count);
+    hash = cpu_inventory_hash_u64(hash, (u64)(s64)specs->line_size);
+    hash = cpu_inventory_hash_u64(hash, (u64)(s64)specs->ways);
+    hash = cpu_inventory_hash_u64(hash, (u64)(s64)specs->is_inclusive);
+  }
+
+  return hash;
+}
+
+u64 cpu_inventory_get_fingerprint(void)
+{
+  u64 hash = cpu_inventory_hash_u64(CPU_INVENTORY_FNV_OFFSET_BASIS, CPU_INVENTORY_FINGERPRINT_VERSION);
+
+  // The name stops at its null terminator, as the bytes after it aren't always cleared
+  s32 name_length = 0;
+  while ((name_length < (s32)sizeof(cpu_identity.name)) && (cpu_identity.name[name_length] != 0))
+  {
+    name_length++;
+  }
+  hash = cpu_inventory_hash_bytes(hash, (const u8*)cpu_identity.manufacturer, sizeof(cpu_identity.manufacturer));
+  hash = cpu_inventory_hash_bytes(hash, (const u8*)cpu_identity.name, name_length);
+  hash = cpu_inventory_hash_u64(hash, (u64)(s64)cpu_identity.family);
+  hash = cpu_inventory_hash_u64(hash, (u64)(s64)cpu_identity.model);
+  hash = cpu_inventory_hash_u64(hash, (u64)(s64)cpu_identity.stepping);
+
+  // Instructions the OS disables are hashed too, and fields derived from the enabled ones left out,
+  // so that the same CPU under different OSes or XCR0 settings gets the same fingerprint
+  hash = cpu_inventory_hash_u64(hash, cpu_specs.instructions | cpu_specs.disabled_instructions);
+  hash = cpu_inventory_hash_u64(hash, (u64)(s64)cpu_specs.sve_vector_length);
+  hash = cpu_inventory_hash_u64(hash, (u64)(s64)cpu_specs.is_hybrid);
+
+  // Core counts are left out, as containers and virtual machines may only get some of the cores,
+  // and so are the caches' attached core counts, which are bounded by them
+  for (s32 core_type = CPU_CORE_TYPE_PERFORMANCE; core_type < CPU_CORE_TYPE_COUNT; core_type++)
+  {
+    const struct cpu_core_type_specs* specs = &cpu_specs.core_type_specs[core_type];
+    hash = cpu_inventory_hash_u64(hash, (u64)(s64)specs->threads_per_core);
+    hash = cpu_inventory_hash_caches(hash, specs->cache_level_specs);
+    hash = cpu_inventory_hash_caches(hash, specs->instruction_cache_level_specs);
+  }
+
+  return hash;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "types.h"
+#include "cpu_specs.h"
+
+// Inventory of what was detected, for fleet management: a node agent reports it to a scheduler,
+// which places jobs on the hosts where they run fastest, and a fingerprint groups hosts with the
+// same CPU model so that tuning results can be cached per model rather than measured on each host
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// enums and structs
+// Version of the text format written by cpu_inventory_write(), as its first line. It changes when
+// keys are renamed or removed, or their values change meaning. New keys may be added without
+// changing it, so readers should ignore the keys they don't know
+#define CPU_INVENTORY_VERSION 1
+
+// Version of the set of fields hashed by cpu_inventory_get_fingerprint(). It is hashed first, so
+// that fingerprints of different versions never match
+#define CPU_INVENTORY_FINGERPRINT_VERSION 2
+
+// Size of a buffer large enough to hold the inventory of any CPU, with all sections
+#define CPU_INVENTORY_MAX_SIZE 16384
+
+// Optional sections of the inventory, whose modules must be initialized beforehand
+enum cpu_inventory_section
+{
+  CPU_INVENTORY_TOPOLOGY = 1 << 0, // cpu_topology, see cpu_topology_init()
+  CPU_INVENTORY_TLB      = 1 << 1, // cpu_tlb_specs, see cpu_tlb_init()
+  CPU_INVENTORY_RDT      = 1 << 2  // cpu_rdt_specs, see cpu_rdt_init()
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Implementation
+// Write the inventory into text as null-terminated "key=value" lines, such as
+// "specs.x86_64_level=3", starting with "cpu_inventory.version=" and ending with
+// "cpu_inventory.fingerprint=". Keys are dot-separated, counts are decimal and bit masks and
+// identity fields hexadecimal with a 0x prefix. cpu_specs_init() and cpu_identity_init() must be
+// called beforehand, along with the initializers of the optional sections, given as a combination
+// of enum cpu_inventory_section's values. text is a plain char buffer, as taken by fwrite() or
+// send(). Returns the length of the text, or 0 if text_size is too small, see
+// CPU_INVENTORY_MAX_SIZE
+s32 cpu_inventory_write(char* text, s32 text_size, u32 sections);
+
+// Return a 64-bit FNV-1a hash of the fields describing the CPU model: its identity, the
+// instructions CPUID reports (including the ones the OS disables), the caches of each core type
+// with their hardware sharing counts, threads per core and the SVE vector length. It leaves out
+// what differs between hosts of the same model, such as the cores the process may run on, the
+// instructions the OS enables, frequencies and the hypervisor. A process only allowed to run on
+// one core type of a hybrid CPU still sees the caches of that type only. Fields are hashed by
+// value, so that the same CPU gets the same fingerprint with all compilers. cpu_specs_init() and
+// cpu_identity_init() must be called beforehand
+u64 cpu_inventory_get_fingerprint(void);
@@ -0,0 +1,148 @@
+#include "cpu_plan.h"
+#include "os.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Globals
+// Scratch arrays indexed by core ID, or listing core IDs in placement order
+static s32 cpu_plan_first_logical_processors[CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS];
+static s32 cpu_plan_domain_ids[CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS];
+static s32 cpu_plan_domain_ranks[CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS];
+static s32 cpu_plan_core_order[CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS];
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Helpers
+// Get the L3 domain of a physical core. Without L3 IDs in the topology, consecutive cores are
+// grouped by the L3 cache's attached_core_count, or by package if there's no L3 cache
+static s32 cpu_plan_get_domain_id(const struct cpu_logical_processor* logical_processor)
+{
+  if (cpu_topology.l3_count != 0)
+  {
+    return logical_processor->l3_id;
+  }
+
+  s32 attached_core_count = cpu_specs.cache_level_specs[L3].attached_core_count;
+  if (attached_core_count > 0)
+  {
+    return logical_processor->core_id / attached_core_count;
+  }
+
+  return logical_processor->package_id;
+}
+
+// Add one worker, with the logical processors of its affinity mask
+static void cpu_plan_add_worker(s32 worker_idx, s32 lp_idx, s32 is_core_wide, s32* os_indices, struct cpu_affinity* affinities)
+{
+  const struct cpu_logical_processor* logical_processor = &cpu_topology.logical_processors[lp_idx];
+  os_indices[worker_idx] = logical_processor->os_index;
+
+  if (affinities)
+  {
+    if (is_core_wide && (cpu_topology_get_affinities(CPU_TOPOLOGY_DOMAIN_CORE, logical_processor->core_id, &affinities[worker_idx], 1) == 1))
+    {
+      return;
+    }
+
+    affinities[worker_idx].mask  = (u64)1 << (logical_processor->os_index % OS_CPU_GROUP_SIZE);
+    affinities[worker_idx].group = logical_processor->os_index / OS_CPU_GROUP_SIZE;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Planning
+s32 cpu_plan_workers(s32 worker_count, s32 policy, s32* os_indices, struct cpu_affinity* affinities)
+{
+  s32 placement = policy & ~CPU_PLAN_AVOID_EFFICIENT_CORES;
+  s32 core_count = cpu_topology.core_count;
+  if ((worker_count <= 0) || (placement < 0) || (placement >= CPU_PLAN_POLICY_COUNT) || (core_count == 0))
+  {
+    return 0;
+  }
+
+  // Logical processors are sorted by OS index, so the first one of a core is its lowest allowed
+  // SMT sibling
+  s32 has_performance_cores = 0;
+  for (s32 core_id = 0; core_id < core_count; core_id++)
+  {
+    cpu_plan_first_logical_processors[core_id] = -1;
+  }
+  for (s32 i = 0; i < cpu_topology.logical_processor_count; i++)
+  {
+    const struct cpu_logical_processor* logical_processor = &cpu_topology.logical_processors[i];
+    if (cpu_plan_first_logical_processors[logical_processor->core_id] < 0)
+    {
+      cpu_plan_first_logical_processors[logical_processor->core_id] = i;
+      cpu_plan_domain_ids[logical_processor->core_id] = cpu_plan_get_domain_id(logical_processor);
+    }
+    has_performance_cores |= (logical_processor->core_type == CPU_CORE_TYPE_PERFORMANCE);
+  }
+
+  s32 avoid_efficient_cores = (policy & CPU_PLAN_AVOID_EFFICIENT_CORES) && has_performance_cores;
+  s32 max_domain_id = 0;
+  for (s32 core_id = 0; core_id < core_count; core_id++)
+  {
+    max_domain_id = (cpu_plan_domain_ids[core_id] > max_domain_id) ? cpu_plan_domain_ids[core_id] : max_domain_id;
+  }
+
+  // List eligible cores domain by domain, along with their rank within their domain
+  s32 ordered_core_count = 0;
+  s32 max_domain_rank    = 0;
+  for (s32 domain_id = 0; domain_id <= max_domain_id; domain_id++)
+  {
+    s32 domain_rank = 0;
+    for (s32 core_id = 0; core_id < core_count; core_id++)
+    {
+      s32 core_type = cpu_topology.logical_processors[cpu_plan_first_logical_processors[core_id]].core_type;
+      if ((cpu_plan_domain_ids[core_id] == domain_id) && !(avoid_efficient_cores && (core_type == CPU_CORE_TYPE_EFFICIENT)))
+      {
+        cpu_plan_domain_ranks[ordered_core_count] = domain_rank;
+        cpu_plan_core_order[ordered_core_count]   = core_id;
+        ordered_core_count++;
+        domain_rank++;
+      }
+    }
+    max_domain_rank = (domain_rank > max_domain_rank) ? domain_rank : max_domain_rank;
+  }
+
+  s32 worker_idx = 0;
+  switch (placement)
+  {
+    case CPU_PLAN_ONE_PER_CORE:
+      // Take the first core of each domain, then the second one, and so on
+      for (s32 domain_rank = 0; domain_rank < max_domain_rank; domain_rank++)
+      {
+        for (s32 i = 0; (i < ordered_core_count) && (worker_idx < worker_count); i++)
+        {
+          if (cpu_plan_domain_ranks[i] == domain_rank)
+          {
+            cpu_plan_add_worker(worker_idx++, cpu_plan_first_logical_processors[cpu_plan_core_order[i]], 1, os_indices, affinities);
+          }
+        }
+      }
+      break;
+
+    case CPU_PLAN_FILL_L3:
+      for (s32 i = 0; (i < ordered_core_count) && (worker_idx < worker_count); i++)
+      {
+        cpu_plan_add_worker(worker_idx++, cpu_plan_first_logical_processors[cpu_plan_core_order[i]], 1, os_indices, affinities);
+      }
+      break;
+
+    case CPU_PLAN_ONE_PER_SMT_SIBLING:
+      for (s32 i = 0; (i < ordered_core_count) && (worker_idx < worker_count); i++)
+      {
+        s32 core_id = cpu_plan_core_order[i];
+        for (s32 lp_idx = cpu_plan_first_logical_processors[core_id]; (lp_idx < cpu_topology.logical_processor_count) && (worker_idx < worker_count); lp_idx++)
+        {
+          if (cpu_topology.logical_processors[lp_idx].core_id == core_id)
+          {
+            cpu_plan_add_worker(worker_idx++, lp_idx, 0, os_indices, affinities);
+          }
+        }
+      }
+      break;
+  }
+
+  return worker_idx;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "types.h"
+#include "cpu_topology.h"
+
+// Placement of worker threads on the logical processors of cpu_topology, grouping them by L3
+// cache domain (CCXs on AMD). Workers sharing an L3 cache exchange data much faster than workers
+// on different domains, whose cache lines cross the die or package interconnect
+
+// Placement policies of cpu_plan_workers(), which may be combined with the flags below
+enum cpu_plan_policy
+{
+  // One worker per physical core, alternating between L3 domains: worker i goes to domain
+  // (i % domain count). This spreads cache capacity and memory bandwidth over the whole CPU
+  CPU_PLAN_ONE_PER_CORE = 0,
+
+  // One worker per physical core, filling all the cores of an L3 domain before the next one. This
+  // keeps communicating workers, such as producer and consumer pairs, on the same L3 cache
+  CPU_PLAN_FILL_L3,
+
+  // One worker per logical processor, filling L3 domains like CPU_PLAN_FILL_L3. The SMT siblings
+  // of a core are consecutive, so consecutive workers also share L1 and L2 caches
+  CPU_PLAN_ONE_PER_SMT_SIBLING,
+
+  CPU_PLAN_POLICY_COUNT
+};
+
+// Leave out efficient cores on hybrid CPUs, unless there are no performance cores at all
+#define CPU_PLAN_AVOID_EFFICIENT_CORES 0x100
+
+// Plan the placement of up to worker_count workers following policy, an enum cpu_plan_policy
+// value optionally combined with CPU_PLAN_AVOID_EFFICIENT_CORES. cpu_topology_init() must be called
+// beforehand, as well as cpu_specs_init() if the topology lacks L3 IDs, as L3 domains are then
+// derived from cpu_specs' attached_core_count.
+// The OS index of the logical processor of worker i is written to os_indices[i], which suits
+// os_run_threads(). If affinities isn't null, affinities[i] receives the logical processors worker
+// i may run on: its whole physical core with per-core policies, leaving the OS to pick an idle
+// sibling, or its single logical processor with CPU_PLAN_ONE_PER_SMT_SIBLING.
+// Returns the count of workers placed, which is less than worker_count when there are fewer
+// eligible cores or logical processors, and 0 if the topology is unknown
+s32 cpu_plan_workers(s32 worker_count, s32 policy, s32* os_indices, struct cpu_affinity* affinities);
@@ -0,0 +1,199 @@
+#include "cpu_rdt.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Globals
+struct cpu_rdt_specs cpu_rdt_specs =
+{
+  .memory_bandwidth_type = CPU_RDT_MEMORY_BANDWIDTH_NONE
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Helpers
+static void cpu_rdt_reset(void)
+{
+  struct cpu_rdt_specs empty_specs = {0};
+  cpu_rdt_specs = empty_specs;
+}
+
+static s32 cpu_rdt_count_bits(u32 mask)
+{
+  s32 count = 0;
+  for (; mask != 0; mask &= mask - 1)
+  {
+    count++;
+  }
+
+  return count;
+}
+
+#if !defined(ISA_arm64)
+// Resource IDs of function 0x10, which are also the bits of its subfunction 0x0 EBX reporting them
+#define CPU_RDT_RESOURCE_L3_CACHE         1
+#define CPU_RDT_RESOURCE_L2_CACHE         2
+#define CPU_RDT_RESOURCE_MEMORY_BANDWIDTH 3
+
+// Width of memory bandwidth counters, to which function 0xF adds an offset
+#define CPU_RDT_MIN_COUNTER_WIDTH 24
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Decoding
+static void cpu_rdt_get_monitoring(const struct cpuid_snapshot* snapshot)
+{
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0xF, 0x0);
+  if (((cpuid_out[EDX] >> 1) & 0b1) == 0)
+  {
+    return;
+  }
+
+  // Only the L3 cache is monitored on current CPUs
+  cpuid_snapshot_get(snapshot, cpuid_out, 0xF, 0x1);
+  cpu_rdt_specs.has_cache_occupancy_monitoring = cpuid_out[EDX] & 0b1;
+  cpu_rdt_specs.has_total_bandwidth_monitoring = (cpuid_out[EDX] >> 1) & 0b1;
+  cpu_rdt_specs.has_local_bandwidth_monitoring = (cpuid_out[EDX] >> 2) & 0b1;
+  cpu_rdt_specs.rmid_count                     = (s32)((u32)cpuid_out[ECX] + 1);
+  cpu_rdt_specs.monitoring_upscaling_factor    = (u32)cpuid_out[EBX];
+  cpu_rdt_specs.monitoring_counter_width       = CPU_RDT_MIN_COUNTER_WIDTH + (cpuid_out[EAX] & 0xFF);
+}
+
+static void cpu_rdt_get_cache_allocation(const struct cpuid_snapshot* snapshot, u32 resource_id, s32 is_amd, struct cpu_rdt_cache_allocation_specs* specs)
+{
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x10, resource_id);
+
+  // AMD's capacity bitmasks may always be non-contiguous, which its function 0x10 doesn't report
+  specs->is_supported                 = 1;
+  specs->clos_count                   = (cpuid_out[EDX] & 0xFFFF) + 1;
+  specs->capacity_bitmask_length      = (cpuid_out[EAX] & 0x1F) + 1;
+  specs->shareable_bitmask            = (u32)cpuid_out[EBX];
+  specs->has_code_data_prioritization = (cpuid_out[ECX] >> 2) & 0b1;
+  specs->has_noncontiguous_bitmasks   = is_amd ? 1 : (cpuid_out[ECX] >> 3) & 0b1;
+}
+
+// Intel's memory bandwidth allocation delays memory requests by a percentage, in steps of
+// (100 - maximum delay) when the delay is linear, as Linux' resctrl assumes
+static void cpu_rdt_intel_get_memory_bandwidth_allocation(const struct cpuid_snapshot* snapshot)
+{
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x10, CPU_RDT_RESOURCE_MEMORY_BANDWIDTH);
+
+  s32 max_throttling = (cpuid_out[EAX] & 0xFFF) + 1;
+  s32 is_linear      = (cpuid_out[ECX] >> 2) & 0b1;
+
+  cpu_rdt_specs.memory_bandwidth_type        = CPU_RDT_MEMORY_BANDWIDTH_THROTTLING;
+  cpu_rdt_specs.memory_bandwidth_clos_count  = (cpuid_out[EDX] & 0xFFFF) + 1;
+  cpu_rdt_specs.memory_bandwidth_max_value   = max_throttling;
+  cpu_rdt_specs.memory_bandwidth_granularity = (is_linear && (max_throttling < 100)) ? 100 - max_throttling : 0;
+}
+
+// AMD's memory bandwidth enforcement caps the bandwidth of each class in 1/8 GB/s units, with
+// limits of bandwidth_length bits. The next bit marks classes as unlimited
+static void cpu_rdt_amd_get_memory_bandwidth_allocation(const struct cpuid_snapshot* snapshot)
+{
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x80000020, 0x0);
+  if (((cpuid_out[EBX] >> 1) & 0b1) == 0)
+  {
+    return;
+  }
+
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x80000020, 0x1);
+  s32 bandwidth_length = cpuid_out[EAX];
+
+  cpu_rdt_specs.memory_bandwidth_type        = CPU_RDT_MEMORY_BANDWIDTH_LIMIT;
+  cpu_rdt_specs.memory_bandwidth_clos_count  = (s32)((u32)cpuid_out[EDX] + 1);
+  cpu_rdt_specs.memory_bandwidth_max_value   = ((bandwidth_length > 0) && (bandwidth_length < 31)) ? (1 << bandwidth_length) - 1 : 0;
+  cpu_rdt_specs.memory_bandwidth_granularity = 1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Initialization
+void cpu_rdt_init_from_snapshot(const struct cpuid_snapshot* snapshot)
+{
+  cpu_rdt_reset();
+
+  // An empty snapshot means that CPUID was unavailable. See cpuid_is_available()
+  if (snapshot->leaf_count == 0)
+  {
+    return;
+  }
+
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x0, 0x0);
+  struct cpuid_ctx cpuid_ctx = {.max_standard_func = (u32)cpuid_out[EAX]};
+  s32 is_amd = (cpuid_out[ECX] == CPU_MANUFACTURER_AMD) || (cpuid_out[ECX] == CPU_MANUFACTURER_HYGON);
+
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x80000000, 0x0);
+  cpuid_ctx.max_extended_func = (u32)cpuid_out[EAX];
+
+  if (cpuid_ctx.max_standard_func < 0x7)
+  {
+    return;
+  }
+
+  // Monitoring (PQM) and allocation (PQE) are reported by function 0x7 on both Intel and AMD
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x7, 0x0);
+  s32 has_monitoring = (cpuid_out[EBX] >> 12) & 0b1;
+  s32 has_allocation = (cpuid_out[EBX] >> 15) & 0b1;
+
+  if (has_monitoring && (cpuid_ctx.max_standard_func >= 0xF))
+  {
+    cpu_rdt_get_monitoring(snapshot);
+  }
+
+  if (has_allocation && (cpuid_ctx.max_standard_func >= 0x10))
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x10, 0x0);
+    u32 resources = (u32)cpuid_out[EBX];
+    if ((resources >> CPU_RDT_RESOURCE_L3_CACHE) & 0b1)
+    {
+      cpu_rdt_get_cache_allocation(snapshot, CPU_RDT_RESOURCE_L3_CACHE, is_amd, &cpu_rdt_specs.cache_allocation_specs[L3]);
+    }
+    if ((resources >> CPU_RDT_RESOURCE_L2_CACHE) & 0b1)
+    {
+      cpu_rdt_get_cache_allocation(snapshot, CPU_RDT_RESOURCE_L2_CACHE, is_amd, &cpu_rdt_specs.cache_allocation_specs[L2]);
+    }
+    if (!is_amd && ((resources >> CPU_RDT_RESOURCE_MEMORY_BANDWIDTH) & 0b1))
+    {
+      cpu_rdt_intel_get_memory_bandwidth_allocation(snapshot);
+    }
+  }
+
+  if (is_amd && has_allocation && (cpuid_ctx.max_extended_func >= 0x80000020))
+  {
+    cpu_rdt_amd_get_memory_bandwidth_allocation(snapshot);
+  }
+}
+#endif
+
+void cpu_rdt_init(void)
+{
+#if defined(ISA_arm64)
+  cpu_rdt_reset();
+#else
+  struct cpuid_snapshot snapshot;
+  cpuid_snapshot_init(&snapshot);
+  cpu_rdt_init_from_snapshot(&snapshot);
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Partitioning
+s32 cpu_rdt_can_partition_l3(s32 min_clos_count)
+{
+  const struct cpu_rdt_cache_allocation_specs* specs = &cpu_rdt_specs.cache_allocation_specs[L3];
+  if (!specs->is_supported || (specs->clos_count < min_clos_count))
+  {
+    return 0;
+  }
+
+  // Each class needs a bit of its own, outside of the ways shared with I/O devices
+  u32 full_mask     = (specs->capacity_bitmask_length < 32) ? ((u32)1 << specs->capacity_bitmask_length) - 1 : 0xFFFFFFFF;
+  s32 isolated_bits = specs->capacity_bitmask_length - cpu_rdt_count_bits(specs->shareable_bitmask & full_mask);
+
+  return isolated_bits >= min_clos_count;
+}
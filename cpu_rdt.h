@@ -0,0 +1,107 @@
+#pragma once
+
+#include "cpu_specs.h"
+
+// Intel's Resource Director Technology (RDT), which AMD implements as Platform Quality of Service
+// (PQoS), to partition and monitor the resources shared by cores. Threads are tagged with a class of
+// service (CLOS) limiting their share of caches and memory bandwidth, and with a resource
+// monitoring ID (RMID) counting their cache occupancy and memory traffic. Both are set through
+// MSRs, hence by the OS, such as with Linux' resctrl file system. This only tells what the CPU
+// supports
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// enums and structs
+// How memory bandwidth allocation (MBA) limits are expressed
+enum cpu_rdt_memory_bandwidth_type
+{
+  CPU_RDT_MEMORY_BANDWIDTH_NONE = 0,    // No memory bandwidth allocation
+  CPU_RDT_MEMORY_BANDWIDTH_THROTTLING,  // Intel: percentages of delay added to memory requests
+  CPU_RDT_MEMORY_BANDWIDTH_LIMIT        // AMD: absolute bandwidths in 1/8 GB/s units
+};
+
+struct cpu_rdt_cache_allocation_specs
+{
+  // Whether cache allocation (CAT) can partition this cache (1) or not (0)
+  s32 is_supported;
+
+  // Count of classes of service, each with its own capacity bitmask. Code and data prioritization
+  // halves it when enabled
+  s32 clos_count;
+
+  // Length in bits of capacity bitmasks, each bit granting a fraction of the ways, such as 11 bits
+  // for 11 ways
+  s32 capacity_bitmask_length;
+
+  // Bits of capacity bitmasks whose ways are also used by other agents, such as I/O devices
+  // writing to the L3 cache (Intel's DDIO) or the integrated GPU. Tenants isolated from them
+  // should avoid these bits
+  u32 shareable_bitmask;
+
+  // Whether code and data prioritization (CDP) gives code and data separate capacity bitmasks (1)
+  // or not (0)
+  s32 has_code_data_prioritization;
+
+  // Whether capacity bitmasks may have non-contiguous bits set (1) or not (0)
+  s32 has_noncontiguous_bitmasks;
+};
+
+struct cpu_rdt_specs
+{
+  // Cache allocation of each cache level, accessed with enum cache_level's values. Intel supports
+  // L2 and L3 caches, and AMD only L3 caches. L1 caches can't be partitioned
+  struct cpu_rdt_cache_allocation_specs cache_allocation_specs[CACHE_LEVEL_COUNT];
+
+  // Memory bandwidth allocation, as an enum cpu_rdt_memory_bandwidth_type value
+  s32 memory_bandwidth_type;
+
+  // Count of classes of service with their own bandwidth limit
+  s32 memory_bandwidth_clos_count;
+
+  // Highest limit: the maximum throttling in percent on Intel, such as 90, or the highest
+  // bandwidth in 1/8 GB/s units on AMD, beyond which bandwidth is unlimited
+  s32 memory_bandwidth_max_value;
+
+  // Step between two limits: in percent on Intel, such as 10, which is also the smallest bandwidth
+  // share, or 1 on AMD. This is 0 on Intel CPUs whose throttling isn't linear, whose values are
+  // only approximate
+  s32 memory_bandwidth_granularity;
+
+  // Whether L3 cache occupancy monitoring (CMT), and total and local memory bandwidth monitoring
+  // (MBM), are supported (1) or not (0). Local bandwidth only counts the accesses to the NUMA node
+  // of the core
+  s32 has_cache_occupancy_monitoring;
+  s32 has_total_bandwidth_monitoring;
+  s32 has_local_bandwidth_monitoring;
+
+  // Count of RMIDs of L3 monitoring, which bounds how many thread groups can be monitored at once
+  s32 rmid_count;
+
+  // Bytes per unit of the monitoring counters (IA32_QM_CTR)
+  u32 monitoring_upscaling_factor;
+
+  // Width in bits of the memory bandwidth counters, after which they wrap around, such as 24 or 32
+  s32 monitoring_counter_width;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Implementation
+extern struct cpu_rdt_specs cpu_rdt_specs;
+
+#if !defined(ISA_arm64)
+// Initialize or refresh the global cpu_rdt_specs struct from a snapshot, see cpuid_snapshot_init().
+// Monitoring is read from function 0xF and allocation from function 0x10, on both Intel and AMD,
+// and AMD's memory bandwidth enforcement from function 0x80000020
+void cpu_rdt_init_from_snapshot(const struct cpuid_snapshot* snapshot);
+#endif
+
+// Initialize or refresh the global cpu_rdt_specs struct. On ARM64, whose Memory System Resource
+// Partitioning and Monitoring (MPAM) isn't visible from user mode, and when CPUID is unavailable,
+// nothing is supported
+void cpu_rdt_init(void);
+
+// Return whether the L3 cache can be partitioned between min_clos_count classes of service, each
+// given at least one way that no other class nor I/O devices use. For instance, a latency-critical
+// tenant and the other tenants make 2 classes. With code and data prioritization enabled, classes
+// need twice as many CLOS. cpu_rdt_init() must be called beforehand. Returns 1 if so, or 0
+s32 cpu_rdt_can_partition_l3(s32 min_clos_count);
@@ -0,0 +1,67 @@
+#include "cpu_slots.h"
+#include "os.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Globals
+// The arena is over-allocated by the largest alignment, as its address is aligned at runtime
+static u8  cpu_slots_arena[CPU_SLOTS_ARENA_SIZE + CPU_MAX_DESTRUCTIVE_INTERFERENCE_SIZE];
+static s32 cpu_slots_arena_offset = 0;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Allocation
+s32 cpu_slots_alloc(struct cpu_slots* slots, s32 payload_size)
+{
+  struct cpu_slots empty_slots = {0};
+  *slots = empty_slots;
+  if (payload_size <= 0)
+  {
+    return 0;
+  }
+
+  // Line sizes are powers of two, so any other value is bogus
+  s32 alignment = cpu_specs.destructive_interference_size;
+  if ((alignment <= 0) || (alignment > CPU_MAX_DESTRUCTIVE_INTERFERENCE_SIZE) || (alignment & (alignment - 1)))
+  {
+    alignment = CPU_MAX_DESTRUCTIVE_INTERFERENCE_SIZE;
+  }
+
+  // Hybrid CPUs have cores of different thread counts, and the process may only be allowed to run
+  // on some of the SMT siblings of a core, so one slot per logical processor of the topology
+  s32 slot_count = cpu_topology.logical_processor_count;
+  if (slot_count <= 0)
+  {
+    slot_count = cpu_specs.core_count * cpu_specs.threads_per_core;
+  }
+  slot_count = (slot_count > 0) ? slot_count : 1;
+
+  s64 slot_size    = ((s64)payload_size + alignment - 1) & ~(s64)(alignment - 1);
+  s64 table_offset = ((s64)cpu_slots_arena_offset + alignment - 1) & ~(s64)(alignment - 1);
+  s64 table_size   = slot_size * slot_count;
+  if (table_offset + table_size > CPU_SLOTS_ARENA_SIZE)
+  {
+    return 0;
+  }
+
+  u8* arena = cpu_slots_arena + ((CPU_MAX_DESTRUCTIVE_INTERFERENCE_SIZE - ((os_uptr)cpu_slots_arena & (CPU_MAX_DESTRUCTIVE_INTERFERENCE_SIZE - 1))) & (CPU_MAX_DESTRUCTIVE_INTERFERENCE_SIZE - 1));
+  u8* base  = arena + table_offset;
+
+  // The arena starts zeroed, but tables released by cpu_slots_reset() don't
+  for (s64 i = 0; i < table_size; i++)
+  {
+    base[i] = 0;
+  }
+
+  cpu_slots_arena_offset = (s32)(table_offset + table_size);
+
+  slots->base       = base;
+  slots->slot_size  = (s32)slot_size;
+  slots->slot_count = slot_count;
+
+  return 1;
+}
+
+void cpu_slots_reset(void)
+{
+  cpu_slots_arena_offset = 0;
+}
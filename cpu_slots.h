@@ -0,0 +1,61 @@
+#pragma once
+
+#include "cpu_specs.h"
+#include "cpu_topology.h"
+
+// Per-logical-processor slots carved out of a static arena, such as per-thread counters or
+// statistics. Slots are aligned and padded to cpu_specs.destructive_interference_size, so that
+// threads writing to their own slot never write to a cache line pair another thread writes to
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// enums and structs
+// Size in bytes of the static arena all slot tables are carved from. May be overridden at compile
+// time
+#if !defined(CPU_SLOTS_ARENA_SIZE)
+#  define CPU_SLOTS_ARENA_SIZE (256 * 1024)
+#endif
+
+struct cpu_slots
+{
+  // First slot, aligned to cpu_specs.destructive_interference_size like all the others, since
+  // slot_size is a multiple of it
+  u8* base;
+
+  // Distance between consecutive slots in bytes: the payload size rounded up to a multiple of the
+  // destructive interference size
+  s32 slot_size;
+
+  // Count of slots, which is cpu_topology.logical_processor_count, so that each index
+  // cpu_current_index() returns gets its own slot. Without a topology, such as on ARM64, this is
+  // cpu_specs.core_count * cpu_specs.threads_per_core instead
+  s32 slot_count;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Implementation
+// Carve a table of one zeroed slot per logical processor, of at least payload_size bytes each, out
+// of the static arena. cpu_specs_init() and cpu_topology_init() must be called beforehand, and
+// tables carved again after cpu_topology_init() refreshes the topology. This isn't thread-safe, so
+// tables are meant to be set up at startup. Returns 1 on success, or 0 if payload_size isn't
+// positive or the arena is exhausted, in which case slots is zeroed
+s32 cpu_slots_alloc(struct cpu_slots* slots, s32 payload_size);
+
+// Release all tables at once, so that the arena may be carved again. Previous tables must no
+// longer be used
+void cpu_slots_reset(void);
+
+// Return the slot of index slot_idx of a table cpu_slots_alloc() succeeded on, such as the slot of
+// cpu_current_index(). Indices beyond slot_count wrap around, and negative ones, which denote
+// unknown logical processors, map to slot 0. Threads may then share a slot, which must only be
+// slower, never incorrect, for instance with atomic updates
+static inline void* cpu_slots_get(const struct cpu_slots* slots, s32 slot_idx)
+{
+  u32 wrapped_idx = (u32)slot_idx;
+  if (wrapped_idx >= (u32)slots->slot_count)
+  {
+    wrapped_idx = (slot_idx < 0) ? 0 : wrapped_idx % (u32)slots->slot_count;
+  }
+
+  return slots->base + wrapped_idx * (u32)slots->slot_size;
+}
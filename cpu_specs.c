@@ -1,32 +1,158 @@
 #include "cpu_specs.h"
-#include "isa.h"
+#include "cpu_intrinsics.h"
+#include "os.h"
+
+// ARM64 CPUs are described by cpu_specs_arm64.c instead
+#if defined(ISA_x64) || defined(ISA_x86)
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Statistics
+#if defined(CPU_SPECS_STATS)
+struct cpu_specs_stats cpu_specs_stats;
+
+void cpu_specs_stats_reset(void)
+{
+  struct cpu_specs_stats empty_stats = {0};
+  cpu_specs_stats = empty_stats;
+}
+
+// Execute CPUID, counting it by function and subfunction
+static void cpu_specs_stats_cpuidex(s32 out[4], s32 func, s32 sub_func)
+{
+  s32 leaf_idx = 0;
+  while ((leaf_idx < cpu_specs_stats.leaf_count)
+      && ((cpu_specs_stats.leaves[leaf_idx].func != (u32)func) || (cpu_specs_stats.leaves[leaf_idx].sub_func != (u32)sub_func)))
+  {
+    leaf_idx++;
+  }
+
+  if ((leaf_idx == cpu_specs_stats.leaf_count) && (leaf_idx < CPU_SPECS_STATS_MAX_LEAF_COUNT))
+  {
+    struct cpu_specs_leaf_stats* leaf_stats = &cpu_specs_stats.leaves[cpu_specs_stats.leaf_count++];
+    leaf_stats->func       = (u32)func;
+    leaf_stats->sub_func   = (u32)sub_func;
+    leaf_stats->call_count = 0;
+    leaf_stats->cycles     = 0;
+  }
+
+  u64 start_tsc = __rdtsc();
+  __cpuidex(out, func, sub_func);
+  u64 cycles = __rdtsc() - start_tsc;
+
+  cpu_specs_stats.cpuid_call_count++;
+  if (leaf_idx < cpu_specs_stats.leaf_count)
+  {
+    cpu_specs_stats.leaves[leaf_idx].call_count++;
+    cpu_specs_stats.leaves[leaf_idx].cycles += cycles;
+  }
+}
+
+#  define CPU_SPECS_CPUIDEX(out, func, sub_func) cpu_specs_stats_cpuidex(out, func, sub_func)
+#  define CPU_SPECS_STATS_BEGIN(name)            u64 name = __rdtsc()
+#  define CPU_SPECS_STATS_END(name, phase)       cpu_specs_stats.phase_cycles[phase] += __rdtsc() - (name)
+#else
+#  define CPU_SPECS_CPUIDEX(out, func, sub_func) __cpuidex(out, func, sub_func)
+#  define CPU_SPECS_STATS_BEGIN(name)
+#  define CPU_SPECS_STATS_END(name, phase)
+#endif
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 //// Helpers
 #define KiB(x) ((x) * 1024)
 
-static inline s32 update_inst_availability(s32 instructions, s32 flags, s32 flag_bit, s32 feature_mask)
+static inline u64 update_inst_availability(u64 instructions, s32 flags, s32 flag_bit, u64 feature_mask)
 {
-  s32 isolated_bit = (flags >> flag_bit) & 0b1;
-  s32 xor_mask     = (-isolated_bit ^ instructions) & feature_mask;
+  s64 isolated_bit = (flags >> flag_bit) & 0b1;
+  u64 xor_mask     = ((u64)-isolated_bit ^ instructions) & feature_mask;
 
   return instructions ^ xor_mask;
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-//// Intrinsics
-// Declare the specific intrinsics used below as extern, rather than including the 1025-line-long
-// intrin.h header 
-#if defined(ISA_x64)
-#  define eflags_type u64
-#elif defined(ISA_x86)
-#  define eflags_type u32
-#endif
+// Whether a manufacturer's CPUs implement AMD's topology and cache functions
+static inline s32 cpu_is_amd_compatible(s32 manufacturer_ecx)
+{
+  return (manufacturer_ecx == CPU_MANUFACTURER_AMD) || (manufacturer_ecx == CPU_MANUFACTURER_HYGON);
+}
+
+// Whether a manufacturer's CPUs implement Intel's topology and cache functions
+static inline s32 cpu_is_intel_compatible(s32 manufacturer_ecx)
+{
+  return (manufacturer_ecx == CPU_MANUFACTURER_INTEL) || (manufacturer_ecx == CPU_MANUFACTURER_CENTAUR) || (manufacturer_ecx == CPU_MANUFACTURER_ZHAOXIN);
+}
+
+// Return the cache level specs described by the output of Intel's function 0x4 or AMD's function
+// 0x8000001D, or 0 if its level is out of bounds
+static struct cpu_cache_level_specs* cpu_specs_get_cache_level_spec(struct cpu_specs* specs, const s32 cpuid_out[4])
+{
+  s32 cache_type  = cpuid_out[EAX] & 0x1F;
+  s32 cache_level = (cpuid_out[EAX] >> 5) & 0b111;
+  s32 cache_idx   = cache_level - 1;
+  if ((cache_idx < 0) || (cache_idx >= CACHE_LEVEL_COUNT))
+  {
+    return 0;
+  }
+
+  if (cache_type == CACHE_TYPE_INSTRUCTION)
+  {
+    return &specs->instruction_cache_level_specs[cache_idx];
+  }
+
+  return &specs->cache_level_specs[cache_idx];
+}
+
+// Decode the cache geometry fields shared by Intel's function 0x4 and AMD's function 0x8000001D
+static void cpu_specs_get_deterministic_cache_specs(const s32 cpuid_out[4], struct cpu_cache_level_specs* cache_level_spec)
+{
+  cache_level_spec->type         = cpuid_out[EAX] & 0x1F;
+  cache_level_spec->line_size    = (cpuid_out[EBX] & 0xFFF) + 1;
+  cache_level_spec->partitions   = ((cpuid_out[EBX] >> 12) & 0x3FF) + 1;
+  cache_level_spec->ways         = (((u32)cpuid_out[EBX] >> 22) & 0x3FF) + 1;
+  cache_level_spec->sets         = cpuid_out[ECX] + 1;
+  cache_level_spec->is_inclusive = (cpuid_out[EDX] >> 1) & 0b1;
 
-extern eflags_type __readeflags(void);
-extern void        __writeeflags(eflags_type new_eflags);
-extern void        __cpuidex(s32 out[4], s32 func, s32 sub_func);
+  cache_level_spec->max_attached_thread_count = ((cpuid_out[EAX] >> 14) & 0xFFF) + 1;
 
+  s32 cache_line_count = cache_level_spec->partitions * cache_level_spec->ways * cache_level_spec->sets;
+  cache_level_spec->data_cache_size = cache_line_count * cache_level_spec->line_size;
+}
+
+// Fill the geometry of a cache only described by its size, line size and associativity
+static void cpu_specs_set_cache_geometry(struct cpu_cache_level_specs* cache_level_spec, s32 type, s32 size, s32 line_size, s32 ways)
+{
+  s32 cache_line_count = line_size ? (size / line_size) : 0;
+
+  cache_level_spec->data_cache_size      = size;
+  cache_level_spec->type                 = size ? type : CACHE_TYPE_NULL;
+  cache_level_spec->line_size            = line_size;
+  cache_level_spec->ways                 = ways;
+  cache_level_spec->partitions           = 1;
+  cache_level_spec->sets                 = ways ? (cache_line_count / ways) : 0;
+  cache_level_spec->is_inclusive         = 0;
+  cache_level_spec->has_complex_indexing = 0;
+
+  cache_level_spec->max_attached_thread_count = 0;
+}
+
+s32 cpuid_amd_decode_associativity(s32 encoding, s32 line_count)
+{
+  switch (encoding)
+  {
+    case 0x1: return 1;
+    case 0x2: return 2;
+    case 0x3: return 3;
+    case 0x4: return 4;
+    case 0x5: return 6;
+    case 0x6: return 8;
+    case 0x8: return 16;
+    case 0xA: return 32;
+    case 0xB: return 48;
+    case 0xC: return 64;
+    case 0xD: return 96;
+    case 0xE: return 128;
+    case 0xF: return line_count;
+    default:  return 0;
+  }
+}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 //// Globals
@@ -34,18 +160,51 @@ struct cpu_specs cpu_specs =
 {
   .cache_level_specs[L1].data_cache_size     = KiB(4),
   .cache_level_specs[L1].attached_core_count = 1,
+  .cache_level_specs[L1].type                = CACHE_TYPE_DATA,
+  .cache_level_specs[L1].line_size           = 64,
   .cache_level_specs[L2].data_cache_size     = 0,
   .cache_level_specs[L2].attached_core_count = 0,
   .cache_level_specs[L3].data_cache_size     = 0,
   .cache_level_specs[L3].attached_core_count = 0,
   .cache_line_size                           = 64,
+  .constructive_interference_size            = 64,
+  .destructive_interference_size             = 64,
+  .non_temporal_threshold                    = 0,
   .threads_per_core                          = 1,
   .core_count                                = 1,
 #if defined(ISA_x64)
-  .instructions                              = SSE1 | SSE2
+  .instructions                              = SSE1 | SSE2,
 #else
-  .instructions                              = 0
+  .instructions                              = 0,
 #endif
+  .disabled_instructions                     = 0,
+  .preferred_vector_width                    = 128,
+  .sve_vector_length                         = 0,
+  .x86_64_level                              = 0,
+  .is_hybrid                                 = 0,
+  .has_invariant_tsc                         = 0,
+  .tsc_frequency                             = 0,
+  .base_frequency_mhz                        = 0,
+  .max_frequency_mhz                         = 0,
+  .bus_frequency_mhz                         = 0,
+  .has_turbo_boost                           = 0,
+  .has_hardware_pstates                      = 0,
+  .has_energy_performance_preference         = 0,
+  .has_aperf_mperf                           = 0,
+  .hypervisor                                = CPU_HYPERVISOR_NONE,
+  .is_topology_untrusted                     = 0,
+  .has_paravirtual_clock                     = 0,
+  .apic_timer_frequency                      = 0,
+  .is_initialized                            = 0,
+  .core_type_specs[CPU_CORE_TYPE_PERFORMANCE] =
+  {
+    .core_count                                = 1,
+    .threads_per_core                          = 1,
+    .cache_level_specs[L1].data_cache_size     = KiB(4),
+    .cache_level_specs[L1].attached_core_count = 1,
+    .cache_level_specs[L1].type                = CACHE_TYPE_DATA,
+    .cache_level_specs[L1].line_size           = 64
+  }
 };
 
 struct cpu_identity cpu_identity =
@@ -60,26 +219,35 @@ struct cpu_identity cpu_identity =
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 //// AMD functions
-static void cpu_specs_amd_get_cores_info(struct cpuid_ctx cpuid_ctx)
+static void cpu_specs_amd_get_cores_info(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx, struct cpu_specs* specs)
 {
   s32 cpuid_out[4];
 
+  // Function 0xB provides useful data regarding the core and thread count, but seems to be
+  // available since around the 1st quarter of 2019 with teh QuadCore AMD Ryzen 5 3500U. It
+  // returns clearer, straightforward, unambiguous core and thread count, which is why it is
+  // preferred. Earlier methods are more likely to be compatible with older CPUs, but depend
+  // on hyperthreading/SMT CPUID flags, whose documentation is ambiguous.
+  s32 topology_threads_per_core = 0;
+  s32 topology_thread_count     = 0;
   if (cpuid_ctx.max_standard_func >= 0xB)
   {
-    // Function 0xB provides useful data regarding the core and thread count, but seems to be
-    // available since around the 1st quarter of 2019 with teh QuadCore AMD Ryzen 5 3500U. It
-    // returns clearer, straightforward, unambiguous core and thread count, which is why it is
-    // preferred. Earlier methods are more likely to be compatible with older CPUs, but depend
-    // on hyperthreading/SMT CPUID flags, whose documentation is ambiguous.
-    __cpuidex(cpuid_out, 0xB, 0x0);
-    cpu_specs.threads_per_core = cpuid_out[EBX] & 0xFFFF;
-    __cpuidex(cpuid_out, 0xB, 0x1);
-    s32 total_thread_count = cpuid_out[EBX] & 0xFFFF;
-    cpu_specs.core_count = total_thread_count / cpu_specs.threads_per_core;
+    cpuid_snapshot_get(snapshot, cpuid_out, 0xB, 0x0);
+    topology_threads_per_core = cpuid_out[EBX] & 0xFFFF;
+    cpuid_snapshot_get(snapshot, cpuid_out, 0xB, 0x1);
+    topology_thread_count     = cpuid_out[EBX] & 0xFFFF;
+  }
+
+  // Function 0xB reports no logical processor when it is missing from a dump, or on some
+  // hypervisors. Function 0x1 is then used as on older CPUs
+  if ((topology_threads_per_core > 0) && (topology_thread_count >= topology_threads_per_core))
+  {
+    specs->threads_per_core = topology_threads_per_core;
+    specs->core_count       = topology_thread_count / topology_threads_per_core;
   }
   else
   {
-    __cpuidex(cpuid_out, 0x1, 0x0);
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
 
     // Although this is marked as "Hyper-threading technology" in AMD's manual, it is described as
     // as whether there is (1) or isn't (0) more than on thread per core OR more than one core per
@@ -93,43 +261,104 @@ static void cpu_specs_amd_get_cores_info(struct cpuid_ctx cpuid_ctx)
     // programmatically. Since all AMD CPUs with simultaneous multithreading have 2 threads per
     // core as of december 2023, this should be alright . If this ever increases, 2 being the minimum value on hyperthreaded is
     // on
-    cpu_specs.threads_per_core = hyperthreaded + 1;
+    specs->threads_per_core = hyperthreaded + 1;
     
     if (cpuid_ctx.max_extended_func >= 0x80000008)
     {
       // This is AMD's recommanded method to retrieve the total count of threads
-      __cpuidex(cpuid_out, 0x80000008, 0);
+      cpuid_snapshot_get(snapshot, cpuid_out, 0x80000008, 0);
       s32 total_thread_count = (cpuid_out[ECX] & 0xFF) + 1;
-      cpu_specs.core_count = total_thread_count >> hyperthreaded;
+      specs->core_count = (total_thread_count > 1) ? total_thread_count >> hyperthreaded : 1;
     }
     else if (hyperthreaded)
     {
       s32 total_thread_count = (cpuid_out[EBX] >> 16) & 0xFF;
-      s32 core_count         = total_thread_count >> 1;
+      s32 core_count         = (total_thread_count > 1) ? total_thread_count >> 1 : 1;
       
       if (cpuid_ctx.max_extended_func >= 0x80000001)
       {
-        __cpuidex(cpuid_out, 0x80000001, 0x0);
+        cpuid_snapshot_get(snapshot, cpuid_out, 0x80000001, 0x0);
         if (cpuid_out[ECX] & (1 << 1))
         {
-          cpu_specs.core_count = core_count;
+          specs->core_count = core_count;
         }
       }
       else
       {
-        cpu_specs.core_count = core_count;
+        specs->core_count = core_count;
       }
     }
     // else if hyperthreaded is 0, there is a total of one thread
   }
 }
 
-static void cpu_specs_amd_get_caches_info(struct cpuid_ctx cpuid_ctx)
+// Decode functions 0x80000005 and 0x80000006, which predate function 0x8000001D. VIA's CPUs
+// without function 0x4 also report their caches in this format
+static void cpu_specs_amd_get_legacy_caches_info(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx, struct cpu_specs* specs)
+{
+  s32 cpuid_out[4];
+  if (cpuid_ctx.max_extended_func >= 0x80000005)
+  {
+    // The count of threads attached to each cache is unknown. It is assumed that:
+    // - there is 1 L1 cache per physical CPU core
+    // - there is 1 L2 cache per physical CPU core
+    // - there is 1 L3 cache for the whole CPU
+    // Whether caches are inclusive isn't reported either
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000005, 0x0);
+    
+    specs->cache_line_size = cpuid_out[ECX] & 0xFF;
+    struct cpu_cache_level_specs* l1d_specs = &specs->cache_level_specs[L1];
+    struct cpu_cache_level_specs* l1i_specs = &specs->instruction_cache_level_specs[L1];
+
+    // L1 associativity is a plain ways count, where 0xFF means fully associative
+    s32 l1d_size      = ((cpuid_out[ECX] >> 24) & 0xFF) * KiB(1);
+    s32 l1d_line_size = cpuid_out[ECX] & 0xFF;
+    s32 l1d_ways      = (cpuid_out[ECX] >> 16) & 0xFF;
+    s32 l1i_size      = ((cpuid_out[EDX] >> 24) & 0xFF) * KiB(1);
+    s32 l1i_line_size = cpuid_out[EDX] & 0xFF;
+    s32 l1i_ways      = (cpuid_out[EDX] >> 16) & 0xFF;
+    if ((l1d_ways == 0xFF) && l1d_line_size)
+    {
+      l1d_ways = l1d_size / l1d_line_size;
+    }
+    if ((l1i_ways == 0xFF) && l1i_line_size)
+    {
+      l1i_ways = l1i_size / l1i_line_size;
+    }
+
+    cpu_specs_set_cache_geometry(l1d_specs, CACHE_TYPE_DATA,        l1d_size, l1d_line_size, l1d_ways);
+    cpu_specs_set_cache_geometry(l1i_specs, CACHE_TYPE_INSTRUCTION, l1i_size, l1i_line_size, l1i_ways);
+    l1d_specs->attached_core_count = 1;
+    l1i_specs->attached_core_count = 1;
+
+    if (cpuid_ctx.max_extended_func >= 0x80000006)
+    {
+      cpuid_snapshot_get(snapshot, cpuid_out, 0x80000006, 0x0);
+      struct cpu_cache_level_specs* l2_specs = &specs->cache_level_specs[L2];
+      struct cpu_cache_level_specs* l3_specs = &specs->cache_level_specs[L3];
+
+      s32 l2_size      = ((cpuid_out[ECX] >> 16) & 0xFFFF) * KiB(1);
+      s32 l2_line_size = cpuid_out[ECX] & 0xFF;
+      s32 l2_ways      = cpuid_amd_decode_associativity((cpuid_out[ECX] >> 12) & 0xF, l2_line_size ? l2_size / l2_line_size : 0);
+      cpu_specs_set_cache_geometry(l2_specs, CACHE_TYPE_UNIFIED, l2_size, l2_line_size, l2_ways);
+      l2_specs->attached_core_count = 1;
+
+      // EDX[31:18] * 512KB <= l3_data_cache_size < (EDX[31:18] + 1) * 512KB
+      s32 l3_size      = (((u32)cpuid_out[EDX] >> 18) & 0x3FFF) * KiB(512);
+      s32 l3_line_size = cpuid_out[EDX] & 0xFF;
+      s32 l3_ways      = cpuid_amd_decode_associativity((cpuid_out[EDX] >> 12) & 0xF, l3_line_size ? l3_size / l3_line_size : 0);
+      cpu_specs_set_cache_geometry(l3_specs, CACHE_TYPE_UNIFIED, l3_size, l3_line_size, l3_ways);
+      l3_specs->attached_core_count = specs->core_count;
+    }
+  }
+}
+
+static void cpu_specs_amd_get_caches_info(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx, struct cpu_specs* specs)
 {
   s32 cpuid_out[4];
   if (cpuid_ctx.max_extended_func >= 0x8000001D)
   {
-    __cpuidex(cpuid_out, 0x80000001, 0x0);
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000001, 0x0);
     s32 topology_extensions_supported = cpuid_out[ECX] & (1 << 22);
     
     if (topology_extensions_supported)
@@ -137,142 +366,108 @@ static void cpu_specs_amd_get_caches_info(struct cpuid_ctx cpuid_ctx)
       // Compared to the 0x80000005-0x80000006 functions, the 0x8000001D function provides one
       // additional detail: the number of logical processors sharing a cache
       s32 subfunc = 0x0;
-      __cpuidex(cpuid_out, 0x8000001D, subfunc);
+      cpuid_snapshot_get(snapshot, cpuid_out, 0x8000001D, subfunc);
 
       // Cache line sizes are provided for all enumerated caches, but in practice the cache line
       // size seems to always the same
-      cpu_specs.cache_line_size = (cpuid_out[EBX] & 0x7F) + 1;
+      specs->cache_line_size = (cpuid_out[EBX] & 0x7F) + 1;
       
       do
       {
-        // Filter out instruction caches, which cannot really be optimized at runtime. Only take
-        // data or unified (data + instructions) caches into account, until all caches have been
-        // enumerated
-        if (cpuid_out[EAX] & 0x1)
+        // Data or unified (data + instructions) caches go to cache_level_specs, and instruction
+        // caches to instruction_cache_level_specs, until all caches have been enumerated
+        struct cpu_cache_level_specs* cache_level_spec = cpu_specs_get_cache_level_spec(specs, cpuid_out);
+        if (cache_level_spec)
         {
-          s32 cache_level      = (cpuid_out[EAX] >> 5) & 0b11;
-          s32 cache_set_ways   = (cpuid_out[EBX] >> 22) + 1;
-          s32 cache_partitions = ((cpuid_out[EBX] >> 12) & 0x3FF) + 1;
-          s32 cache_set_count  = cpuid_out[ECX] + 1;
-          s32 cache_line_count = cache_partitions * cache_set_ways * cache_set_count;
-
-          s32 cache_idx = cache_level - 1;
-          struct cpu_cache_level_specs* cache_level_spec = &cpu_specs.cache_level_specs[cache_idx];
-          
-          cache_level_spec->data_cache_size     = cache_line_count * cpu_specs.cache_line_size;
-          s32 attached_thread_count             = ((cpuid_out[EAX] >> 14) & 0xFFF) + 1;
-          cache_level_spec->attached_core_count = attached_thread_count / cpu_specs.threads_per_core;
+          cpu_specs_get_deterministic_cache_specs(cpuid_out, cache_level_spec);
+
+          cache_level_spec->attached_core_count = cache_level_spec->max_attached_thread_count / specs->threads_per_core;
+
+          // AMD doesn't document any complex indexing flag
+          cache_level_spec->has_complex_indexing = 0;
         }
 
         // Move to the next iteration, if the new subfunction is valid (cpuid_out[EAX] & 0xF != 0)
         subfunc++;
-        __cpuidex(cpuid_out, 0x8000001D, subfunc);
+        cpuid_snapshot_get(snapshot, cpuid_out, 0x8000001D, subfunc);
       }
       while ((cpuid_out[EAX] & 0xF) != 0);
     }
   }
-  else if (cpuid_ctx.max_extended_func >= 0x80000005)
+  else
   {
-    // The count of threads attached to each cache is unknown. It is assumed that:
-    // - there is 1 L1 cache per physical CPU core
-    // - there is 1 L2 cache per physical CPU core
-    // - there is 1 L3 cache for the whole CPU
-    __cpuidex(cpuid_out, 0x80000005, 0x0);
-    
-    cpu_specs.cache_line_size = cpuid_out[ECX] & 0xFF;
-    cpu_specs.cache_level_specs[L1].data_cache_size = ((cpuid_out[ECX] >> 24) & 0xFF) * KiB(1);
-    cpu_specs.cache_level_specs[L1].attached_core_count = 1;
-    if (cpuid_ctx.max_extended_func >= 0x80000006)
-    {
-      __cpuidex(cpuid_out, 0x80000006, 0x0);
-      cpu_specs.cache_level_specs[L2].data_cache_size = ((cpuid_out[ECX] >> 16) & 0xFFFF) * KiB(1);
-      cpu_specs.cache_level_specs[L2].attached_core_count = 1;
-
-      // EDX[31:18] * 512KB <= l3_data_cache_size < (EDX[31:18] + 1) * 512KB
-      cpu_specs.cache_level_specs[L3].data_cache_size = ((cpuid_out[EDX] >> 18) & 0x3FFFF) * KiB(512);
-      cpu_specs.cache_level_specs[L3].attached_core_count = cpu_specs.core_count;
-    }
+    cpu_specs_amd_get_legacy_caches_info(snapshot, cpuid_ctx, specs);
   }
 }
 
-static void cpu_specs_amd_get_instructions(struct cpuid_ctx cpuid_ctx)
+static void cpu_specs_amd_get_instructions(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx, struct cpu_specs* specs)
 {
-  s32 cpuid_out[4];
-  
-  // This is not officially documented by AMD, but appears in CPUID dumps of Zen4 CPUs, which
-  // implement AVX512. So this is guesswork for now. See for instance:
-  // http://users.atw.hu/instlatx64/AuthenticAMD/AuthenticAMD0A10F11_K19_Genoa_02_CPUID.txt
-  if (cpuid_ctx.max_standard_func >= 0xB)
+  if (cpuid_ctx.max_extended_func >= 0x80000001)
   {
-    __cpuidex(cpuid_out, 0xD, 0x5);
-    s32 avx512_available    = (cpuid_out[EAX] == 0x40) && (cpuid_out[EBX] == 0x340);
-    cpu_specs.instructions ^= (-avx512_available ^ cpu_specs.instructions) & AVX512F;
-  }
-
-  if (cpuid_ctx.max_extended_func >= 0xB)
-  {
-    __cpuidex(cpuid_out, 0x80000001, 0x0);
-    cpu_specs.instructions = update_inst_availability(cpu_specs.instructions, cpuid_out[ECX], 21, TBM);
+    s32 cpuid_out[4];
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000001, 0x0);
+    specs->instructions = update_inst_availability(specs->instructions, cpuid_out[ECX], 21, TBM);
   }
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 //// Intel functions
-static void cpu_specs_intel_get_cores_info(struct cpuid_ctx cpuid_ctx)
+static void cpu_specs_intel_get_cores_info(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx, struct cpu_specs* specs)
 {
   s32 cpuid_out[4];
+  s32 topology_threads_per_core = 0;
+  s32 topology_thread_count     = 0;
   if (cpuid_ctx.max_standard_func >= 0xB)
   {
     // If available, Intel recommands using function 0x1F, which is a superset of function 0xB
     s32 higher_func = (cpuid_ctx.max_standard_func >= 0x1F) ? 0x1F : 0xB;
     
-    __cpuidex(cpuid_out, higher_func, 0x0);
-    cpu_specs.threads_per_core = cpuid_out[EBX] & 0xFFFF;
-    __cpuidex(cpuid_out, higher_func, 0x1);
-    s32 total_thread_count = cpuid_out[EBX] & 0xFFFF;
-    cpu_specs.core_count = total_thread_count / cpu_specs.threads_per_core;
+    cpuid_snapshot_get(snapshot, cpuid_out, higher_func, 0x0);
+    topology_threads_per_core = cpuid_out[EBX] & 0xFFFF;
+    cpuid_snapshot_get(snapshot, cpuid_out, higher_func, 0x1);
+    topology_thread_count     = cpuid_out[EBX] & 0xFFFF;
+  }
+
+  // As on AMD, function 0x1 is used when the topology function reports no logical processor
+  if ((topology_threads_per_core > 0) && (topology_thread_count >= topology_threads_per_core))
+  {
+    specs->threads_per_core = topology_threads_per_core;
+    specs->core_count       = topology_thread_count / topology_threads_per_core;
   }
   else
   {
-    __cpuidex(cpuid_out, 0x1, 0x0);
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
     s32 hyperthreaded = (cpuid_out[EDX] >> 28) & 0b1;
-    cpu_specs.threads_per_core = hyperthreaded + 1;
+    specs->threads_per_core = hyperthreaded + 1;
 
-    if (hyperthreaded)
+    // A count below 2 would contradict the flag, and leave core_count unchanged
+    s32 logical_processor_count = ((cpuid_out[EBX] >> 16) & 0xFF);
+    if (hyperthreaded && (logical_processor_count >= 2))
     {
-      s32 total_thread_count = ((cpuid_out[EBX] >> 16) & 0xFF);
-      cpu_specs.core_count = total_thread_count / cpu_specs.threads_per_core;
+      specs->core_count = logical_processor_count / specs->threads_per_core;
     }
   }
 }
 
-static void cpu_specs_intel_get_caches_info(struct cpuid_ctx cpuid_ctx)
+static void cpu_specs_intel_get_caches_info(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx, struct cpu_specs* specs)
 {
   if (cpuid_ctx.max_standard_func >= 0x4)
   {
     s32 cpuid_out[4];
     s32 subfunc = 0x0;
-    __cpuidex(cpuid_out, 0x4, subfunc);
-    cpu_specs.cache_line_size = (cpuid_out[EBX] & 0x7F) + 1;
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x4, subfunc);
+    specs->cache_line_size = (cpuid_out[EBX] & 0x7F) + 1;
     
     while ((cpuid_out[EAX] & 0xF) != 0)
     {
-      // Filter out instruction caches, which cannot really be optimized at runtime. Only take
-      // data or unified (data + instructions) caches into account, until all caches have been
-      // enumerated
-      if (cpuid_out[EAX] & 0b1)
+      // Data or unified (data + instructions) caches go to cache_level_specs, and instruction
+      // caches to instruction_cache_level_specs, until all caches have been enumerated
+      struct cpu_cache_level_specs* cache_level_spec = cpu_specs_get_cache_level_spec(specs, cpuid_out);
+      if (cache_level_spec)
       {
-        s32 cache_level      = (cpuid_out[EAX] >> 5) & 0b11;
-        s32 cache_set_ways   = (cpuid_out[EBX] >> 22) + 1;
-        s32 cache_partitions = ((cpuid_out[EBX] >> 12) & 0x3FF) + 1;
-        s32 cache_set_count  = cpuid_out[ECX] + 1;
-        s32 cache_line_count = cache_partitions * cache_set_ways * cache_set_count;
-
-        s32 cache_idx = cache_level - 1;
-        struct cpu_cache_level_specs* cache_level_spec = &cpu_specs.cache_level_specs[cache_idx];
-        
-        cache_level_spec->data_cache_size = cache_line_count * cpu_specs.cache_line_size;
+        cpu_specs_get_deterministic_cache_specs(cpuid_out, cache_level_spec);
+        cache_level_spec->has_complex_indexing = (cpuid_out[EDX] >> 2) & 0b1;
         
         // There's no known way of retrieving the amount of active logical processors attached to a
         // cache at or below this function. Only the maximum amount of logical processors can be
@@ -281,36 +476,24 @@ static void cpu_specs_intel_get_caches_info(struct cpuid_ctx cpuid_ctx)
         // (4 cores out of 8), but may actually be 4 (2 cores). In this case,
         // cpu_specs.caches[L2].attached_core_count will be wrong.
         // TODO: investigate whether this can happen in practice for Intel CPUs
-        s32 max_attached_thread_count = ((cpuid_out[EAX] >> 14) & 0xFFF) + 1;
-        s32 max_attached_core_count   = max_attached_thread_count / cpu_specs.threads_per_core;
-        if (max_attached_core_count <= cpu_specs.core_count)
+        s32 max_attached_core_count = cache_level_spec->max_attached_thread_count / specs->threads_per_core;
+        if (max_attached_core_count <= specs->core_count)
         {
           cache_level_spec->attached_core_count = max_attached_core_count;
         }
         else
         {
-          cache_level_spec->attached_core_count = cpu_specs.core_count;
+          cache_level_spec->attached_core_count = specs->core_count;
         }
       }
 
       // Move to the next iteration, if the new subfunction is valid (cpuid_out[EAX] & 0xF != 0)
       subfunc++;
-      __cpuidex(cpuid_out, 0x4, subfunc);
+      cpuid_snapshot_get(snapshot, cpuid_out, 0x4, subfunc);
     }
   }
 }
 
-static void cpu_specs_intel_get_instructions(struct cpuid_ctx cpuid_ctx)
-{
-  if (cpuid_ctx.max_standard_func >= 0x7)
-  {
-    s32 cpuid_out[4];
-    __cpuidex(cpuid_out, 0x7, 0x0);
-    cpu_specs.instructions = update_inst_availability(cpu_specs.instructions, cpuid_out[EBX], 16, AVX512F);
-  }
-}
-
-
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 //// CPU-independent functions
 u32 cpuid_is_available(void)
@@ -320,179 +503,1663 @@ u32 cpuid_is_available(void)
   // called even with bit 21 being 0.
   const eflags_type flags_cpuid_mask = (1 << 21);
 
+  CPU_SPECS_STATS_BEGIN(start_tsc);
   eflags_type orig_eflags     = __readeflags();
   eflags_type modified_eflags = orig_eflags ^ flags_cpuid_mask;
   __writeeflags(modified_eflags);
   eflags_type updated_eflags = __readeflags();
+  CPU_SPECS_STATS_END(start_tsc, CPU_SPECS_PHASE_CPUID_AVAILABILITY);
 
   return (modified_eflags == updated_eflags);
   // The original state of the FLAGS register is automatically restored to its previous state
 }
 
-static void cpu_specs_get_common_instructions(struct cpuid_ctx cpuid_ctx)
+// Read XCR0 from a backend if the OS enables XSAVE, as reported by the output of CPUID function
+// 0x1. Otherwise, XGETBV would fault, and 0 is returned
+static u64 cpuid_get_xcr0(const s32 features[4], const struct cpuid_backend* backend)
+{
+  s32 osxsave_enabled = (features[ECX] >> 27) & 0b1;
+
+  return osxsave_enabled ? backend->xcr0(backend->user_data) : 0;
+}
+
+// XCR0 register state components required by each class of instructions. VEX-encoded
+// instructions, except the ones only using general-purpose registers (BMI1, BMI2...), require the
+// SSE and AVX states. AVX-512 additionally requires the opmask, ZMM_Hi256 and Hi16_ZMM states
+#define XCR0_YMM_STATE (0x2 | 0x4)
+#define XCR0_ZMM_STATE (XCR0_YMM_STATE | 0x20 | 0x40 | 0x80)
+#define XCR0_AMX_STATE (0x20000 | 0x40000)
+
+#define YMM_STATE_INSTRUCTIONS (AVX1 | AVX2 | FMA3 | F16C | AVX_VNNI | VAES | VPCLMULQDQ)
+#define ZMM_STATE_INSTRUCTIONS (AVX512F | AVX512CD | AVX512BW | AVX512DQ | AVX512VL | AVX512VNNI | AVX512BF16 | AVX512FP16 | AVX512VBMI | AVX512VBMI2 | AVX512IFMA | AVX512VPOPCNTDQ)
+#define AMX_STATE_INSTRUCTIONS (AMX_TILE | AMX_INT8 | AMX_BF16)
+
+// Move instructions whose register state isn't enabled by the OS from specs->instructions to
+// specs->disabled_instructions. Both are expected to have been decoded from CPUID beforehand
+static void cpu_specs_get_os_disabled_instructions(u64 xcr0, struct cpu_specs* specs)
+{
+  u64 disabled_mask = 0;
+  if ((xcr0 & XCR0_YMM_STATE) != XCR0_YMM_STATE)
+  {
+    disabled_mask |= YMM_STATE_INSTRUCTIONS;
+  }
+  if ((xcr0 & XCR0_ZMM_STATE) != XCR0_ZMM_STATE)
+  {
+    disabled_mask |= ZMM_STATE_INSTRUCTIONS;
+  }
+
+  // On Linux, XCR0 enables the tile state, but each process must also request permission to use
+  // it with arch_prctl(ARCH_REQ_XCOMP_PERM), which is left to callers actually using AMX
+  if ((xcr0 & XCR0_AMX_STATE) != XCR0_AMX_STATE)
+  {
+    disabled_mask |= AMX_STATE_INSTRUCTIONS;
+  }
+
+  specs->disabled_instructions = specs->instructions & disabled_mask;
+  specs->instructions         &= ~disabled_mask;
+}
+
+// Decode the family and model from EAX of CPUID function 0x1 (the family, model and stepping
+// signature), as reported by cpu_identity
+static void cpu_get_family_model(s32 family_model_stepping, s32 manufacturer_ecx, s32* family, s32* model)
+{
+  *family = (family_model_stepping >> 8) & 0xF;
+  *model  = (family_model_stepping >> 4) & 0xF;
+
+  if (*family == 0xF)
+  {
+    s32 extended_family = (family_model_stepping >> 20) & 0xFF;
+    *family += extended_family;
+
+    s32 extended_model = (family_model_stepping >> 12) & 0xF0;
+    *model |= extended_model;
+  }
+
+  // Zhaoxin's CPUs of family 0x7 also use the extended model
+  if (cpu_is_intel_compatible(manufacturer_ecx) && ((*family == 0x6) || (*family == 0x7)))
+  {
+    s32 extended_model = (family_model_stepping >> 12) & 0xF0;
+    *model |= extended_model;
+  }
+}
+
+// Hypervisor functions start at 0x40000000. Hypervisors emulating Hyper-V there report their own
+// interface at the next base
+#define CPUID_HYPERVISOR_BASE        0x40000000
+#define CPUID_HYPERVISOR_NESTED_BASE 0x40000100
+
+struct cpu_hypervisor_signature
+{
+  // EBX, ECX and EDX of function 0x40000000, in this order
+  schar8 signature[13];
+  s32    hypervisor;
+};
+
+static const struct cpu_hypervisor_signature cpu_hypervisor_signatures[] =
+{
+  {"KVMKVMKVM\0\0\0", CPU_HYPERVISOR_KVM},
+  {"Linux KVM Hv", CPU_HYPERVISOR_HYPER_V}, // Hyper-V emulation, KVM's own interface is nested
+  {"Microsoft Hv", CPU_HYPERVISOR_HYPER_V},
+  {"VMwareVMware", CPU_HYPERVISOR_VMWARE},
+  {"XenVMMXenVMM", CPU_HYPERVISOR_XEN},
+  {"VBoxVBoxVBox", CPU_HYPERVISOR_VIRTUALBOX},
+  {"TCGTCGTCGTCG", CPU_HYPERVISOR_QEMU},
+  {" lrpepyh  vr", CPU_HYPERVISOR_PARALLELS},
+  {"bhyve bhyve ", CPU_HYPERVISOR_BHYVE},
+  {"ACRNACRNACRN", CPU_HYPERVISOR_ACRN}
+};
+
+// Identify the hypervisor from the output of its base function (0x40000000 or 0x40000100)
+static s32 cpu_get_hypervisor(const s32 hypervisor_base[4])
+{
+  const u32 registers[3] = {(u32)hypervisor_base[EBX], (u32)hypervisor_base[ECX], (u32)hypervisor_base[EDX]};
+  for (s32 i = 0; i < (s32)(sizeof(cpu_hypervisor_signatures) / sizeof(cpu_hypervisor_signatures[0])); i++)
+  {
+    const schar8* signature = cpu_hypervisor_signatures[i].signature;
+    s32 is_match = 1;
+    for (s32 byte_idx = 0; byte_idx < 12; byte_idx++)
+    {
+      u8 register_byte = (u8)(registers[byte_idx / 4] >> ((byte_idx % 4) * 8));
+      is_match &= (register_byte == (u8)signature[byte_idx]);
+    }
+
+    if (is_match)
+    {
+      return cpu_hypervisor_signatures[i].hypervisor;
+    }
+  }
+
+  return CPU_HYPERVISOR_UNKNOWN;
+}
+
+static void cpu_specs_get_common_instructions(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx, struct cpu_specs* specs)
 {
   s32 cpuid_out[4];
-  __cpuidex(cpuid_out, 0x1, 0x0);
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
 
   // Conditionally set or unset instructions. This prevents instructions expected to be available
   // by default from having their bit remaining set (1), when they are in fact not available (0)
-  s32 instructions = cpu_specs.instructions;
-  instructions = update_inst_availability(instructions, cpuid_out[EDX],  4, RDTSCP);
+  u64 instructions = specs->instructions;
+  instructions = update_inst_availability(instructions, cpuid_out[EDX],  4, TSC);
   instructions = update_inst_availability(instructions, cpuid_out[EDX], 25, SSE1);
   instructions = update_inst_availability(instructions, cpuid_out[EDX], 26, SSE2);
   instructions = update_inst_availability(instructions, cpuid_out[ECX],  0, SSE3);
   instructions = update_inst_availability(instructions, cpuid_out[ECX],  9, SSSE3);
   instructions = update_inst_availability(instructions, cpuid_out[ECX], 12, FMA3);
+  instructions = update_inst_availability(instructions, cpuid_out[ECX], 13, CX16);
   instructions = update_inst_availability(instructions, cpuid_out[ECX], 19, SSE4_1);
   instructions = update_inst_availability(instructions, cpuid_out[ECX], 20, SSE4_2);
+  instructions = update_inst_availability(instructions, cpuid_out[ECX], 22, MOVBE);
   instructions = update_inst_availability(instructions, cpuid_out[ECX], 23, POPCNT);
   instructions = update_inst_availability(instructions, cpuid_out[ECX], 28, AVX1);
   instructions = update_inst_availability(instructions, cpuid_out[ECX], 29, F16C);
   
   if (cpuid_ctx.max_standard_func >= 0x7)
   {
-    __cpuidex(cpuid_out, 0x7, 0x0);
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x7, 0x0);
     instructions = update_inst_availability(instructions, cpuid_out[EBX], 3, BMI1);
     instructions = update_inst_availability(instructions, cpuid_out[EBX], 3, TZCNT);
     instructions = update_inst_availability(instructions, cpuid_out[EBX], 5, AVX2);
     instructions = update_inst_availability(instructions, cpuid_out[EBX], 8, BMI2);
+    instructions = update_inst_availability(instructions, cpuid_out[EBX], 9, ERMS);
+    instructions = update_inst_availability(instructions, cpuid_out[EBX], 19, ADX);
+    instructions = update_inst_availability(instructions, cpuid_out[EBX], 23, CLFLUSHOPT);
+    instructions = update_inst_availability(instructions, cpuid_out[EBX], 24, CLWB);
+    instructions = update_inst_availability(instructions, cpuid_out[EBX], 29, SHA);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX],  0, PREFETCHWT1);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX],  8, GFNI);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX],  9, VAES);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX], 10, VPCLMULQDQ);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX], 22, RDPID);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX], 25, CLDEMOTE);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX], 27, MOVDIRI);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX], 28, MOVDIR64B);
+    instructions = update_inst_availability(instructions, cpuid_out[EDX],  4, FSRM);
+
+    // AVX-512 flags are reported the same way by Intel and AMD (since Zen 4)
+    instructions = update_inst_availability(instructions, cpuid_out[EBX], 16, AVX512F);
+    instructions = update_inst_availability(instructions, cpuid_out[EBX], 17, AVX512DQ);
+    instructions = update_inst_availability(instructions, cpuid_out[EBX], 21, AVX512IFMA);
+    instructions = update_inst_availability(instructions, cpuid_out[EBX], 28, AVX512CD);
+    instructions = update_inst_availability(instructions, cpuid_out[EBX], 30, AVX512BW);
+    instructions = update_inst_availability(instructions, cpuid_out[EBX], 31, AVX512VL);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX],  1, AVX512VBMI);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX],  6, AVX512VBMI2);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX], 11, AVX512VNNI);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX], 14, AVX512VPOPCNTDQ);
+    instructions = update_inst_availability(instructions, cpuid_out[EDX], 23, AVX512FP16);
+
+    // AMX
+    instructions = update_inst_availability(instructions, cpuid_out[EDX], 22, AMX_BF16);
+    instructions = update_inst_availability(instructions, cpuid_out[EDX], 24, AMX_TILE);
+    instructions = update_inst_availability(instructions, cpuid_out[EDX], 25, AMX_INT8);
+
+    // Subfunction 0x1 is valid if the highest valid subfunction (EAX of subfunction 0x0) is at
+    // least 0x1. Otherwise, it reads as zeros, which unsets its flags
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x7, 0x1);
+    instructions = update_inst_availability(instructions, cpuid_out[EAX], 4, AVX_VNNI);
+    instructions = update_inst_availability(instructions, cpuid_out[EAX], 5, AVX512BF16);
 
     if (cpuid_ctx.max_extended_func >= 0x80000001)
     {
-      __cpuidex(cpuid_out, 0x80000001, 0x0);
+      cpuid_snapshot_get(snapshot, cpuid_out, 0x80000001, 0x0);
       instructions = update_inst_availability(instructions, cpuid_out[ECX], 5, LZCNT);
     }
   }
 
-  cpu_specs.instructions = instructions;
+  if (cpuid_ctx.max_extended_func >= 0x80000001)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000001, 0x0);
+    instructions = update_inst_availability(instructions, cpuid_out[ECX], 0, LAHF_SAHF);
+    instructions = update_inst_availability(instructions, cpuid_out[EDX], 27, RDTSCP);
+
+    // PREFETCHW is 3DNow!'s, which Intel CPUs also report here since Broadwell
+    instructions = update_inst_availability(instructions, cpuid_out[ECX], 8, PREFETCHW);
+  }
+
+  specs->instructions = instructions;
 }
 
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-//// CPUID context
-struct cpuid_ctx cpuid_ctx_get(void)
+static void cpu_specs_get_tsc_info(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx, struct cpu_specs* specs)
 {
-  struct cpuid_ctx cpuid_ctx = {.max_standard_func = 0u, .max_extended_func = 0u};
-  if (cpuid_is_available())
+  s32 cpuid_out[4];
+
+  specs->has_invariant_tsc = 0;
+  if (cpuid_ctx.max_extended_func >= 0x80000007)
   {
-    
-    s32 cpuid_out[4];
-    __cpuidex(cpuid_out, 0x0, 0x0);
-    cpuid_ctx.max_standard_func = *(u32*)&cpuid_out[EAX];
-    
-    __cpuidex(cpuid_out, 0x80000000, 0x0);
-    cpuid_ctx.max_extended_func = *(u32*)&cpuid_out[EAX];
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000007, 0x0);
+    specs->has_invariant_tsc = (cpuid_out[EDX] >> 8) & 0b1;
   }
-  
-  return cpuid_ctx;
-}
 
+  specs->base_frequency_mhz = 0;
+  specs->max_frequency_mhz  = 0;
+  specs->bus_frequency_mhz  = 0;
+  if (cpuid_ctx.max_standard_func >= 0x16)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x16, 0x0);
+    specs->base_frequency_mhz = cpuid_out[EAX] & 0xFFFF;
+    specs->max_frequency_mhz  = cpuid_out[EBX] & 0xFFFF;
+    specs->bus_frequency_mhz  = cpuid_out[ECX] & 0xFFFF;
+  }
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-//// CPU specs
-void cpu_specs_init(void)
-{
-  if (cpuid_is_available())
+  // TSC frequency = crystal clock frequency * EBX / EAX. EAX or EBX being 0 means that the ratio
+  // is unknown. A crystal clock frequency (ECX) of 0 means that it isn't enumerated, which is the
+  // case on Skylake and Kaby Lake. For these, Intel documents that the TSC runs at the base
+  // frequency
+  specs->tsc_frequency = 0;
+  if (cpuid_ctx.max_standard_func >= 0x15)
   {
-    // CPUID must be available to initiliaze the CPU's specs. See cpuid_is_available()
-    struct cpuid_ctx cpuid_ctx;
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x15, 0x0);
+    u32 denominator   = (u32)cpuid_out[EAX];
+    u32 numerator     = (u32)cpuid_out[EBX];
+    u32 crystal_clock = (u32)cpuid_out[ECX];
+    if (denominator && numerator)
     {
-      s32 cpuid_out[4];
-      __cpuidex(cpuid_out, 0x0, 0x0);
-      cpuid_ctx.max_standard_func = *(u32*)&cpuid_out[EAX];
-      
-      __cpuidex(cpuid_out, 0x80000000, 0x0);
-      cpuid_ctx.max_extended_func = *(u32*)&cpuid_out[EAX];
+      if (crystal_clock)
+      {
+        specs->tsc_frequency = (u64)crystal_clock * numerator / denominator;
+      }
+      else
+      {
+        specs->tsc_frequency = (u64)specs->base_frequency_mhz * 1000000;
+      }
     }
+  }
+}
 
-    // Get details located at the same CPUID function regardless of the CPU's manucturer
-    cpu_specs_get_common_instructions(cpuid_ctx);
+static void cpu_specs_get_power_info(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx, struct cpu_specs* specs)
+{
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x0, 0x0);
+  s32 is_amd = cpu_is_amd_compatible(cpuid_out[ECX]);
 
-    s32 cpu_manufacturer_ecx;
+  // Function 0x6 (thermal and power management) is shared, but AMD only reports APERF/MPERF there
+  specs->has_turbo_boost                   = 0;
+  specs->has_hardware_pstates              = 0;
+  specs->has_energy_performance_preference = 0;
+  specs->has_aperf_mperf                   = 0;
+  if (cpuid_ctx.max_standard_func >= 0x6)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x6, 0x0);
+    specs->has_aperf_mperf = cpuid_out[ECX] & 0b1;
+    if (!is_amd)
     {
-      s32 cpuid_out[4];
-      __cpuidex(cpuid_out, 0x0, 0x0);
-      cpu_manufacturer_ecx = cpuid_out[ECX];
+      specs->has_turbo_boost                   = (cpuid_out[EAX] >> 1) & 0b1;
+      specs->has_hardware_pstates              = (cpuid_out[EAX] >> 7) & 0b1;
+      specs->has_energy_performance_preference = specs->has_hardware_pstates && ((cpuid_out[EAX] >> 10) & 0b1);
     }
+  }
 
-    if (cpu_manufacturer_ecx == CPU_MANUFACTURER_AMD)
-    {
-      // Call order matters here
-      cpu_specs_amd_get_cores_info(cpuid_ctx);
-      cpu_specs_amd_get_caches_info(cpuid_ctx);
-      cpu_specs_amd_get_instructions(cpuid_ctx);
-    }
-    else if (cpu_manufacturer_ecx == CPU_MANUFACTURER_INTEL)
-    {
-      // Call order matters here
-      cpu_specs_intel_get_cores_info(cpuid_ctx);
-      cpu_specs_intel_get_caches_info(cpuid_ctx);
-      cpu_specs_intel_get_instructions(cpuid_ctx);
-    }
-    
-    // TODO: would it be interesting to check for lesser known manufacturers?
-    // Check what their share is and was on the market
-    // - Centaur/Zhaoxin
-    // - Cyrix
-    // - Geode
-    // - Hygon
-    // - Qualcomm
-    // - Rise
-    // - Vortex
-    // - ...
+  if (is_amd && (cpuid_ctx.max_extended_func >= 0x80000007))
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000007, 0x0);
+    specs->has_turbo_boost = (cpuid_out[EDX] >> 9) & 0b1;
+  }
+  if (is_amd && (cpuid_ctx.max_extended_func >= 0x80000008))
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000008, 0x0);
+    specs->has_hardware_pstates = (cpuid_out[EBX] >> 27) & 0b1;
   }
 }
 
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-//// CPU identity
-void cpu_identity_init(void)
+// Must be called after cpu_specs_get_tsc_info(), whose TSC frequency it may override
+static void cpu_specs_get_hypervisor_info(const struct cpuid_snapshot* snapshot, struct cpu_specs* specs)
 {
-  if (cpuid_is_available())
-  {
-    // CPUID must be available to initiliaze the CPU's identity. See cpuid_is_available()
-    s32 cpuid_out[4];
-    __cpuidex(cpuid_out, 0x0, 0x0);
-
-    // Copy the CPU's manufacturer string in groups of 4 characters.
-    // EDX and ECX are intentionally swapped, this is how it is stored
-    u32* manufacturer_4bytes = (u32*)cpu_identity.manufacturer;
-    *manufacturer_4bytes++ = cpuid_out[EBX];
-    *manufacturer_4bytes++ = cpuid_out[EDX];
-    *manufacturer_4bytes   = cpuid_out[ECX];
+  s32 cpuid_out[4];
 
-    // Get the CPU family, model and stepping
-    __cpuidex(cpuid_out, 0x1, 0x0);
-    s32 family_model_stepping = cpuid_out[EAX];
-    cpu_identity.family       = (family_model_stepping >> 8) & 0xF;
-    cpu_identity.model        = (family_model_stepping >> 4) & 0xF;
-    cpu_identity.stepping     = family_model_stepping & 0xF;
+  specs->hypervisor            = CPU_HYPERVISOR_NONE;
+  specs->is_topology_untrusted = 0;
+  specs->has_paravirtual_clock = 0;
+  specs->apic_timer_frequency  = 0;
 
-    if (cpu_identity.family == 0xF)
-    {
-      s32 extended_family = (family_model_stepping >> 20) & 0xFF;
-      cpu_identity.family += extended_family;
+  // The hypervisor present bit is reserved, hence 0, on bare metal
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
+  if (((cpuid_out[ECX] >> 31) & 0b1) == 0)
+  {
+    return;
+  }
 
-      s32 extended_model = (family_model_stepping >> 12) & 0xF0;
-      cpu_identity.model |= extended_model;
-    }
+  specs->is_topology_untrusted = 1;
 
-    s32 manufacturer_ecx = *(s32*)(cpu_identity.manufacturer + 8);
-    if ((manufacturer_ecx == CPU_MANUFACTURER_INTEL) && (cpu_identity.family == 0x6))
+  u32 base = CPUID_HYPERVISOR_BASE;
+  cpuid_snapshot_get(snapshot, cpuid_out, base, 0x0);
+  specs->hypervisor = cpu_get_hypervisor(cpuid_out);
+  if (specs->hypervisor == CPU_HYPERVISOR_HYPER_V)
+  {
+    s32 nested_out[4];
+    if (cpuid_snapshot_get(snapshot, nested_out, CPUID_HYPERVISOR_NESTED_BASE, 0x0) && (cpu_get_hypervisor(nested_out) != CPU_HYPERVISOR_UNKNOWN))
     {
-      s32 extended_model = (family_model_stepping >> 12) & 0xF0;
-      cpu_identity.model |= extended_model;
+      base = CPUID_HYPERVISOR_NESTED_BASE;
+      specs->hypervisor = cpu_get_hypervisor(nested_out);
+      cpuid_snapshot_get(snapshot, cpuid_out, base, 0x0);
     }
+  }
 
-    // If available, get the processor name string
-    __cpuidex(cpuid_out, 0x80000000, 0x0);
-    u32 cpuid_max_extended_func = *(u32*)&cpuid_out[EAX];
-    if (cpuid_max_extended_func >= 0x80000004)
+  // Early KVM versions report 0 as their highest function, which then is base + 0x1
+  u32 max_hypervisor_func = (u32)cpuid_out[EAX];
+  if ((specs->hypervisor == CPU_HYPERVISOR_KVM) && (max_hypervisor_func < base))
+  {
+    max_hypervisor_func = base + 0x1;
+  }
+
+  switch (specs->hypervisor)
+  {
+    case CPU_HYPERVISOR_KVM:
+      // KVM_FEATURE_CLOCKSOURCE and KVM_FEATURE_CLOCKSOURCE2
+      if (max_hypervisor_func >= base + 0x1)
+      {
+        cpuid_snapshot_get(snapshot, cpuid_out, base + 0x1, 0x0);
+        specs->has_paravirtual_clock = (cpuid_out[EAX] & ((1 << 0) | (1 << 3))) != 0;
+      }
+      break;
+    case CPU_HYPERVISOR_HYPER_V:
+      // Partition privilege AccessPartitionReferenceTsc
+      if (max_hypervisor_func >= base + 0x3)
+      {
+        cpuid_snapshot_get(snapshot, cpuid_out, base + 0x3, 0x0);
+        specs->has_paravirtual_clock = (cpuid_out[EAX] >> 9) & 0b1;
+      }
+      break;
+  }
+
+  // Timing information, in kHz
+  if (max_hypervisor_func >= base + 0x10)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, base + 0x10, 0x0);
+    if (cpuid_out[EAX] != 0)
     {
-      // Writes the 48 bytes (3 x 4 x 4 bytes) of the processor name 
-      __cpuidex((s32*)(cpu_identity.name),      0x80000002, 0x0);
-      __cpuidex((s32*)(cpu_identity.name + 16), 0x80000003, 0x0);
-      __cpuidex((s32*)(cpu_identity.name + 32), 0x80000004, 0x0);
+      specs->tsc_frequency = (u64)(u32)cpuid_out[EAX] * 1000;
     }
+    specs->apic_timer_frequency = (u64)(u32)cpuid_out[EBX] * 1000;
   }
 }
+
+
+static void cpu_specs_get_x86_64_level(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx, struct cpu_specs* specs)
+{
+  s32 cpuid_out[4];
+  specs->x86_64_level = 0;
+
+  // x86-64-v1 CPUs support 64-bit mode (long mode), and have the FPU, CMPXCHG8B, CMOV, MMX, FXSR,
+  // SSE1 and SSE2 in function 0x1 EDX
+  s32 has_long_mode = 0;
+  if (cpuid_ctx.max_extended_func >= 0x80000001)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000001, 0x0);
+    has_long_mode = (cpuid_out[EDX] >> 29) & 0b1;
+  }
+
+  const s32 x86_64_v1_features_edx = (1 << 0) | (1 << 8) | (1 << 15) | (1 << 23) | (1 << 24) | (1 << 25) | (1 << 26);
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
+  if (!has_long_mode || ((cpuid_out[EDX] & x86_64_v1_features_edx) != x86_64_v1_features_edx))
+  {
+    return;
+  }
+
+  // Each level requires all the instructions of the previous ones. AVX1, AVX2, FMA3 and F16C only
+  // remain set if the OS enables XSAVE and the YMM state, which x86-64-v3 requires too
+  const u64 level_instructions[3] = {X86_64_V2_INSTRUCTIONS, X86_64_V3_INSTRUCTIONS, X86_64_V4_INSTRUCTIONS};
+  specs->x86_64_level = 1;
+  for (s32 i = 0; i < 3; i++)
+  {
+    if ((specs->instructions & level_instructions[i]) != level_instructions[i])
+    {
+      break;
+    }
+    specs->x86_64_level++;
+  }
+}
+
+// Minimum non-temporal store threshold, which is glibc's as well
+#define CPU_SPECS_MIN_NON_TEMPORAL_THRESHOLD 0x4040
+
+// Follow glibc's init_cacheinfo() (sysdeps/x86/dl-cacheinfo.h). REP MOVSB with ERMS doesn't
+// thrash the cache as much as regular stores, so it may stream more before bypassing it
+static s32 cpu_specs_get_non_temporal_threshold(const struct cpu_specs* specs)
+{
+  const struct cpu_cache_level_specs* shared_cache = &specs->cache_level_specs[L3];
+  if (shared_cache->data_cache_size == 0)
+  {
+    shared_cache = &specs->cache_level_specs[L2];
+    if (shared_cache->data_cache_size == 0)
+    {
+      return 0;
+    }
+  }
+
+  s32 threshold;
+  if (specs->instructions & ERMS)
+  {
+    threshold = shared_cache->data_cache_size / 4;
+  }
+  else
+  {
+    s32 threads_per_core     = (specs->threads_per_core > 0) ? specs->threads_per_core : 1;
+    s32 sharing_thread_count = (shared_cache->attached_core_count > 0) ? shared_cache->attached_core_count * threads_per_core : threads_per_core;
+    threshold = (s32)((s64)shared_cache->data_cache_size / sharing_thread_count * 3 / 4);
+  }
+
+  return (threshold > CPU_SPECS_MIN_NON_TEMPORAL_THRESHOLD) ? threshold : CPU_SPECS_MIN_NON_TEMPORAL_THRESHOLD;
+}
+
+// Intel models implementing AVX-512 on 512-bit wide units without frequency penalty
+#define INTEL_MODEL_KNIGHTS_LANDING 0x57
+#define INTEL_MODEL_KNIGHTS_MILL    0x85
+
+static void cpu_specs_get_preferred_vector_width(const struct cpuid_snapshot* snapshot, struct cpu_specs* specs)
+{
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x0, 0x0);
+  s32 manufacturer_ecx = cpuid_out[ECX];
+
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
+  s32 family;
+  s32 model;
+  cpu_get_family_model(cpuid_out[EAX], manufacturer_ecx, &family, &model);
+
+  s32 is_amd   = (manufacturer_ecx == CPU_MANUFACTURER_AMD);
+  s32 is_intel = (manufacturer_ecx == CPU_MANUFACTURER_INTEL);
+  s32 is_hygon = (manufacturer_ecx == CPU_MANUFACTURER_HYGON);
+
+  if ((specs->instructions & AVX1) == 0)
+  {
+    specs->preferred_vector_width = 128;
+  }
+  else if ((specs->instructions & AVX512F) == 0)
+  {
+    // Bulldozer (family 0x15), Jaguar (family 0x16) and Zen 1 (family 0x17, before model 0x30)
+    // split 256-bit operations in two 128-bit ones, which only adds register pressure. So do
+    // Hygon's Dhyana CPUs (family 0x18), derived from Zen 1
+    s32 has_128_bit_units = (is_amd && ((family == 0x15) || (family == 0x16) || ((family == 0x17) && (model < 0x30))))
+                         || (is_hygon && (family == 0x18));
+    specs->preferred_vector_width = has_128_bit_units ? 128 : 256;
+  }
+  else
+  {
+    // Intel CPUs before Sapphire Rapids, the first ones with AMX, lower the frequency of the whole
+    // core for a while after executing heavy 512-bit instructions, which slows down the
+    // surrounding scalar and 256-bit code. Knights Landing and Knights Mill don't, nor do Zen 4
+    // (family 0x19) and later, which split 512-bit operations in two 256-bit ones at full clock
+    s32 has_amx             = ((specs->instructions | specs->disabled_instructions) & AMX_TILE) != 0;
+    s32 is_knights          = is_intel && (family == 0x6) && ((model == INTEL_MODEL_KNIGHTS_LANDING) || (model == INTEL_MODEL_KNIGHTS_MILL));
+    s32 has_no_avx512_drops = (is_intel && (has_amx || is_knights)) || (is_amd && (family >= 0x19));
+    specs->preferred_vector_width = has_no_avx512_drops ? 512 : 256;
+  }
+}
+
+static void cpu_specs_get_interference_sizes(const struct cpuid_snapshot* snapshot, struct cpu_specs* specs)
+{
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x0, 0x0);
+  s32 manufacturer_ecx = cpuid_out[ECX];
+
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
+  s32 family;
+  s32 model;
+  cpu_get_family_model(cpuid_out[EAX], manufacturer_ecx, &family, &model);
+
+  // Intel's adjacent-line prefetcher completes each line into its 128-byte aligned pair since
+  // NetBurst (family 0xF) and Core (family 0x6). Zen's L2 up/down prefetcher fetches the next or
+  // previous line of each access, as do Hygon's CPUs derived from it
+  s32 is_intel       = (manufacturer_ecx == CPU_MANUFACTURER_INTEL) && ((family == 0x6) || (family == 0xF));
+  s32 is_zen         = (manufacturer_ecx == CPU_MANUFACTURER_AMD) && (family >= 0x17);
+  s32 is_hygon       = (manufacturer_ecx == CPU_MANUFACTURER_HYGON);
+  s32 has_line_pairs = is_intel || is_zen || is_hygon;
+
+  specs->constructive_interference_size = specs->cache_line_size;
+  specs->destructive_interference_size  = has_line_pairs ? 2 * specs->cache_line_size : specs->cache_line_size;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// CPUID context
+struct cpuid_ctx cpuid_ctx_get(void)
+{
+  struct cpuid_ctx cpuid_ctx = {.max_standard_func = 0u, .max_extended_func = 0u};
+  if (cpuid_is_available())
+  {
+    
+    s32 cpuid_out[4];
+    CPU_SPECS_CPUIDEX(cpuid_out, 0x0, 0x0);
+    cpuid_ctx.max_standard_func = *(u32*)&cpuid_out[EAX];
+    
+    CPU_SPECS_CPUIDEX(cpuid_out, 0x80000000, 0x0);
+    cpuid_ctx.max_extended_func = *(u32*)&cpuid_out[EAX];
+  }
+  
+  return cpuid_ctx;
+}
+
+static struct cpuid_ctx cpuid_ctx_get_from_snapshot(const struct cpuid_snapshot* snapshot)
+{
+  struct cpuid_ctx cpuid_ctx;
+  s32 cpuid_out[4];
+
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x0, 0x0);
+  cpuid_ctx.max_standard_func = *(u32*)&cpuid_out[EAX];
+
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x80000000, 0x0);
+  cpuid_ctx.max_extended_func = *(u32*)&cpuid_out[EAX];
+
+  return cpuid_ctx;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// CPUID backends
+static const s32 cpuid_snapshot_missing_leaf[4] = {0, 0, 0, 0};
+
+// Return the output of a function and subfunction among leaves, or 0 if missing
+static const s32* cpuid_find_leaf(const struct cpuid_leaf* leaves, s32 leaf_count, u32 func, u32 sub_func)
+{
+  for (s32 i = 0; i < leaf_count; i++)
+  {
+    if ((leaves[i].func == func) && (leaves[i].sub_func == sub_func))
+    {
+      return leaves[i].out;
+    }
+  }
+
+  return 0;
+}
+
+static void cpuid_native_cpuid(void* user_data, s32 out[4], u32 func, u32 sub_func)
+{
+  (void)user_data;
+  CPU_SPECS_CPUIDEX(out, (s32)func, (s32)sub_func);
+}
+
+static u64 cpuid_native_xcr0(void* user_data)
+{
+  (void)user_data;
+  return _xgetbv(0);
+}
+
+// The CPUID and XGETBV instructions of the current logical processor
+static const struct cpuid_backend cpuid_native_backend =
+{
+  .cpuid     = cpuid_native_cpuid,
+  .xcr0      = cpuid_native_xcr0,
+  .user_data = 0,
+  .is_local  = 1
+};
+
+static void cpuid_dump_cpuid(void* user_data, s32 out[4], u32 func, u32 sub_func)
+{
+  const struct cpuid_dump* dump = (const struct cpuid_dump*)user_data;
+  const s32* leaf_out = cpuid_find_leaf(dump->leaves, dump->leaf_count, func, sub_func);
+  leaf_out = leaf_out ? leaf_out : cpuid_snapshot_missing_leaf;
+
+  out[EAX] = leaf_out[EAX];
+  out[EBX] = leaf_out[EBX];
+  out[ECX] = leaf_out[ECX];
+  out[EDX] = leaf_out[EDX];
+}
+
+// Function 0xD, subfunction 0x0 reports the XCR0 bits the CPU supports in EDX:EAX
+static u64 cpuid_dump_xcr0(void* user_data)
+{
+  s32 cpuid_out[4];
+  cpuid_dump_cpuid(user_data, cpuid_out, 0xD, 0x0);
+
+  return ((u64)(u32)cpuid_out[EDX] << 32) | (u32)cpuid_out[EAX];
+}
+
+struct cpuid_backend cpuid_dump_backend(const struct cpuid_dump* dump)
+{
+  struct cpuid_backend backend =
+  {
+    .cpuid     = cpuid_dump_cpuid,
+    .xcr0      = cpuid_dump_xcr0,
+    .user_data = (void*)dump,
+    .is_local  = 0
+  };
+
+  return backend;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// CPUID dumps
+// Parse up to digit_count hexadecimal digits at text[*position], advancing *position past them.
+// Returns -1 if there is no digit
+static s64 cpuid_dump_parse_hex(const schar8* text, s32 text_length, s32* position, s32 digit_count)
+{
+  s64 value = -1;
+  for (s32 i = 0; (i < digit_count) && (*position < text_length); i++, (*position)++)
+  {
+    schar8 c = text[*position];
+    s32 digit = ((c >= '0') && (c <= '9')) ? (c - '0')
+              : ((c >= 'A') && (c <= 'F')) ? (c - 'A' + 10)
+              : ((c >= 'a') && (c <= 'f')) ? (c - 'a' + 10)
+              : -1;
+    if (digit < 0)
+    {
+      break;
+    }
+    value = ((value < 0) ? 0 : (value << 4)) | digit;
+  }
+
+  return value;
+}
+
+// Whether text[position] starts with the null-terminated prefix
+static s32 cpuid_dump_starts_with(const schar8* text, s32 text_length, s32 position, const schar8* prefix)
+{
+  for (; *prefix; prefix++, position++)
+  {
+    if ((position >= text_length) || (text[position] != *prefix))
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// Parse a "CPUID <func>: <EAX>-<EBX>-<ECX>-<EDX> [SL <sub_func>]" line between position and
+// line_end into leaf. Returns 1 on success
+static s32 cpuid_dump_parse_line(const schar8* text, s32 position, s32 line_end, struct cpuid_leaf* leaf)
+{
+  while ((position < line_end) && ((text[position] == ' ') || (text[position] == '\t')))
+  {
+    position++;
+  }
+  if (!cpuid_dump_starts_with(text, line_end, position, (const schar8*)"CPUID "))
+  {
+    return 0;
+  }
+  position += 6;
+
+  s64 func = cpuid_dump_parse_hex(text, line_end, &position, 8);
+  if ((func < 0) || !cpuid_dump_starts_with(text, line_end, position, (const schar8*)":"))
+  {
+    return 0;
+  }
+  position++;
+  while ((position < line_end) && (text[position] == ' '))
+  {
+    position++;
+  }
+
+  for (s32 reg = EAX; reg <= EDX; reg++)
+  {
+    if ((reg != EAX) && !cpuid_dump_starts_with(text, line_end, position++, (const schar8*)"-"))
+    {
+      return 0;
+    }
+
+    s64 value = cpuid_dump_parse_hex(text, line_end, &position, 8);
+    if (value < 0)
+    {
+      return 0;
+    }
+    leaf->out[reg] = (s32)(u32)value;
+  }
+
+  // The subfunction is 0 unless tagged, such as "[SL 01]"
+  leaf->func     = (u32)func;
+  leaf->sub_func = 0;
+  for (; position < line_end; position++)
+  {
+    if (cpuid_dump_starts_with(text, line_end, position, (const schar8*)"[SL "))
+    {
+      position += 4;
+      s64 sub_func = cpuid_dump_parse_hex(text, line_end, &position, 8);
+      leaf->sub_func = (sub_func > 0) ? (u32)sub_func : 0;
+      break;
+    }
+  }
+
+  return 1;
+}
+
+s32 cpuid_dump_parse(struct cpuid_dump* dump, const schar8* text, s32 text_length)
+{
+  dump->leaf_count = 0;
+
+  s32 line_start = 0;
+  while ((line_start < text_length) && (dump->leaf_count < CPUID_DUMP_MAX_LEAF_COUNT))
+  {
+    s32 line_end = line_start;
+    while ((line_end < text_length) && (text[line_end] != '\n'))
+    {
+      line_end++;
+    }
+
+    struct cpuid_leaf leaf;
+    if (cpuid_dump_parse_line(text, line_start, line_end, &leaf))
+    {
+      // Dumps of several logical processors repeat all functions for each of them
+      if (cpuid_find_leaf(dump->leaves, dump->leaf_count, leaf.func, leaf.sub_func))
+      {
+        if ((leaf.func == 0x0) && (leaf.sub_func == 0x0))
+        {
+          break;
+        }
+      }
+      else
+      {
+        dump->leaves[dump->leaf_count++] = leaf;
+      }
+    }
+
+    line_start = line_end + 1;
+  }
+
+  return dump->leaf_count;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// CPUID snapshot
+
+// Execute CPUID once through the backend and append its output to the snapshot. Returns the
+// captured output, which reads as zeroes if the snapshot is full
+static const s32* cpuid_snapshot_capture(struct cpuid_snapshot* snapshot, const struct cpuid_backend* backend, u32 func, u32 sub_func)
+{
+  if (snapshot->leaf_count >= CPUID_SNAPSHOT_MAX_LEAF_COUNT)
+  {
+    return cpuid_snapshot_missing_leaf;
+  }
+
+  struct cpuid_leaf* leaf = &snapshot->leaves[snapshot->leaf_count++];
+  leaf->func     = func;
+  leaf->sub_func = sub_func;
+  backend->cpuid(backend->user_data, leaf->out, func, sub_func);
+
+  return leaf->out;
+}
+
+// Capture all subfunctions of a deterministic cache parameters function (0x4 or 0x8000001D),
+// including the null subfunction ending the enumeration, since the decoders read it
+static void cpuid_snapshot_capture_caches(struct cpuid_snapshot* snapshot, const struct cpuid_backend* backend, u32 func)
+{
+  u32 subfunc = 0x0;
+  const s32* cpuid_out;
+
+  do
+  {
+    cpuid_out = cpuid_snapshot_capture(snapshot, backend, func, subfunc);
+    subfunc++;
+  }
+  while ((cpuid_out[EAX] & 0xF) != 0);
+}
+
+// Capture the functions read by the cpu_identity decoder
+static void cpuid_snapshot_capture_identity(struct cpuid_snapshot* snapshot, const struct cpuid_backend* backend)
+{
+  snapshot->leaf_count = 0;
+  snapshot->xcr0       = 0;
+  snapshot->is_local   = backend->is_local;
+
+  const s32* cpuid_out = cpuid_snapshot_capture(snapshot, backend, 0x0, 0x0);
+  u32 max_standard_func = *(u32*)&cpuid_out[EAX];
+
+  cpuid_out = cpuid_snapshot_capture(snapshot, backend, 0x80000000, 0x0);
+  u32 max_extended_func = *(u32*)&cpuid_out[EAX];
+
+  // CPU family, model and stepping
+  if (max_standard_func >= 0x1)
+  {
+    cpuid_snapshot_capture(snapshot, backend, 0x1, 0x0);
+  }
+
+  // Processor name string
+  if (max_extended_func >= 0x80000004)
+  {
+    cpuid_snapshot_capture(snapshot, backend, 0x80000002, 0x0);
+    cpuid_snapshot_capture(snapshot, backend, 0x80000003, 0x0);
+    cpuid_snapshot_capture(snapshot, backend, 0x80000004, 0x0);
+  }
+}
+
+// Capture all subfunctions of an extended topology enumeration function (0xB or 0x1F), including
+// the invalid subfunction ending the enumeration, since cpu_topology_init() reads it
+static void cpuid_snapshot_capture_topology(struct cpuid_snapshot* snapshot, const struct cpuid_backend* backend, u32 func)
+{
+  // Bound the enumeration in case a hypervisor never reports an invalid level
+  for (u32 subfunc = 0x0; subfunc < 0x8; subfunc++)
+  {
+    const s32* cpuid_out = cpuid_snapshot_capture(snapshot, backend, func, subfunc);
+    s32 level_type = (cpuid_out[ECX] >> 8) & 0xFF;
+    if (level_type == 0)
+    {
+      break;
+    }
+  }
+}
+
+// Capture the hypervisor functions read by cpu_specs_get_hypervisor_info()
+static void cpuid_snapshot_capture_hypervisor(struct cpuid_snapshot* snapshot, const struct cpuid_backend* backend)
+{
+  u32 base = CPUID_HYPERVISOR_BASE;
+  const s32* cpuid_out = cpuid_snapshot_capture(snapshot, backend, base, 0x0);
+  s32 hypervisor = cpu_get_hypervisor(cpuid_out);
+  if (hypervisor == CPU_HYPERVISOR_HYPER_V)
+  {
+    const s32* nested_out = cpuid_snapshot_capture(snapshot, backend, CPUID_HYPERVISOR_NESTED_BASE, 0x0);
+    if (cpu_get_hypervisor(nested_out) != CPU_HYPERVISOR_UNKNOWN)
+    {
+      base       = CPUID_HYPERVISOR_NESTED_BASE;
+      hypervisor = cpu_get_hypervisor(nested_out);
+      cpuid_out  = nested_out;
+    }
+  }
+
+  u32 max_hypervisor_func = (u32)cpuid_out[EAX];
+  if ((hypervisor == CPU_HYPERVISOR_KVM) && (max_hypervisor_func < base))
+  {
+    max_hypervisor_func = base + 0x1;
+  }
+
+  if ((hypervisor == CPU_HYPERVISOR_KVM) && (max_hypervisor_func >= base + 0x1))
+  {
+    cpuid_snapshot_capture(snapshot, backend, base + 0x1, 0x0);
+  }
+  else if ((hypervisor == CPU_HYPERVISOR_HYPER_V) && (max_hypervisor_func >= base + 0x3))
+  {
+    cpuid_snapshot_capture(snapshot, backend, base + 0x3, 0x0);
+  }
+
+  if (max_hypervisor_func >= base + 0x10)
+  {
+    cpuid_snapshot_capture(snapshot, backend, base + 0x10, 0x0);
+  }
+}
+
+void cpuid_snapshot_init_from_backend(struct cpuid_snapshot* snapshot, const struct cpuid_backend* backend)
+{
+  // The functions captured here mirror the ones read by the cpu_specs, cpu_identity, cpu_topology,
+  // cpu_tlb and cpu_rdt decoders, so that no CPUID instruction is executed twice nor needlessly.
+  // Update all sides together
+  cpuid_snapshot_capture_identity(snapshot, backend);
+
+  struct cpuid_ctx cpuid_ctx = cpuid_ctx_get_from_snapshot(snapshot);
+  u32 max_standard_func = cpuid_ctx.max_standard_func;
+  u32 max_extended_func = cpuid_ctx.max_extended_func;
+
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x0, 0x0);
+  s32 cpu_manufacturer_ecx = cpuid_out[ECX];
+
+  // Register states enabled by the OS, which gate instructions using them
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
+  snapshot->xcr0 = cpuid_get_xcr0(cpuid_out, backend);
+
+  // Common instructions
+  s32 structured_features_ebx = 0;
+  s32 structured_features_edx = 0;
+  if (max_standard_func >= 0x7)
+  {
+    const s32* structured_features = cpuid_snapshot_capture(snapshot, backend, 0x7, 0x0);
+    structured_features_ebx = structured_features[EBX];
+    structured_features_edx = structured_features[EDX];
+    if (structured_features[EAX] >= 0x1)
+    {
+      cpuid_snapshot_capture(snapshot, backend, 0x7, 0x1);
+    }
+  }
+
+  s32 extended_features_ecx = 0;
+  if (max_extended_func >= 0x80000001)
+  {
+    extended_features_ecx = cpuid_snapshot_capture(snapshot, backend, 0x80000001, 0x0)[ECX];
+  }
+
+  // Address widths, and AMD's core count without function 0xB
+  if (max_extended_func >= 0x80000008)
+  {
+    cpuid_snapshot_capture(snapshot, backend, 0x80000008, 0x0);
+  }
+
+  // Time stamp counter, frequencies and power management
+  if (max_standard_func >= 0x6)
+  {
+    cpuid_snapshot_capture(snapshot, backend, 0x6, 0x0);
+  }
+  if (max_extended_func >= 0x80000007)
+  {
+    cpuid_snapshot_capture(snapshot, backend, 0x80000007, 0x0);
+  }
+  if (max_standard_func >= 0x15)
+  {
+    cpuid_snapshot_capture(snapshot, backend, 0x15, 0x0);
+  }
+  if (max_standard_func >= 0x16)
+  {
+    cpuid_snapshot_capture(snapshot, backend, 0x16, 0x0);
+  }
+
+  // Hypervisor vendor, features and timing
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
+  if ((cpuid_out[ECX] >> 31) & 0b1)
+  {
+    cpuid_snapshot_capture_hypervisor(snapshot, backend);
+  }
+
+  // Resource monitoring and allocation (RDT on Intel, PQoS on AMD), only captured when reported
+  if ((max_standard_func >= 0xF) && ((structured_features_ebx >> 12) & 0b1))
+  {
+    if ((cpuid_snapshot_capture(snapshot, backend, 0xF, 0x0)[EDX] >> 1) & 0b1)
+    {
+      cpuid_snapshot_capture(snapshot, backend, 0xF, 0x1);
+    }
+  }
+  if ((max_standard_func >= 0x10) && ((structured_features_ebx >> 15) & 0b1))
+  {
+    u32 allocation_resources = (u32)cpuid_snapshot_capture(snapshot, backend, 0x10, 0x0)[EBX];
+    for (u32 resource_id = 0x1; resource_id <= 0x3; resource_id++)
+    {
+      if ((allocation_resources >> resource_id) & 0b1)
+      {
+        cpuid_snapshot_capture(snapshot, backend, 0x10, resource_id);
+      }
+    }
+  }
+
+  if (cpu_is_amd_compatible(cpu_manufacturer_ecx))
+  {
+    // Cores info
+    if (max_standard_func >= 0xB)
+    {
+      cpuid_snapshot_capture_topology(snapshot, backend, 0xB);
+    }
+
+    // Caches info, and TLBs info, which functions 0x80000005 and 0x80000006 also report
+    s32 topology_extensions_supported = extended_features_ecx & (1 << 22);
+    if ((max_extended_func >= 0x8000001D) && topology_extensions_supported)
+    {
+      cpuid_snapshot_capture_caches(snapshot, backend, 0x8000001D);
+    }
+    if (max_extended_func >= 0x80000005)
+    {
+      cpuid_snapshot_capture(snapshot, backend, 0x80000005, 0x0);
+    }
+    if (max_extended_func >= 0x80000006)
+    {
+      cpuid_snapshot_capture(snapshot, backend, 0x80000006, 0x0);
+    }
+    if (max_extended_func >= 0x80000019)
+    {
+      cpuid_snapshot_capture(snapshot, backend, 0x80000019, 0x0);
+    }
+
+    // Memory bandwidth enforcement
+    if ((max_extended_func >= 0x80000020) && ((structured_features_ebx >> 15) & 0b1))
+    {
+      if ((cpuid_snapshot_capture(snapshot, backend, 0x80000020, 0x0)[EBX] >> 1) & 0b1)
+      {
+        cpuid_snapshot_capture(snapshot, backend, 0x80000020, 0x1);
+      }
+    }
+  }
+  else if (cpu_is_intel_compatible(cpu_manufacturer_ecx))
+  {
+    // Cores info
+    if (max_standard_func >= 0xB)
+    {
+      u32 higher_func = (max_standard_func >= 0x1F) ? 0x1F : 0xB;
+      cpuid_snapshot_capture_topology(snapshot, backend, higher_func);
+    }
+
+    // Caches info
+    if (max_standard_func >= 0x4)
+    {
+      cpuid_snapshot_capture_caches(snapshot, backend, 0x4);
+    }
+    else if ((cpu_manufacturer_ecx != CPU_MANUFACTURER_INTEL) && (max_extended_func >= 0x80000005))
+    {
+      cpuid_snapshot_capture(snapshot, backend, 0x80000005, 0x0);
+      if (max_extended_func >= 0x80000006)
+      {
+        cpuid_snapshot_capture(snapshot, backend, 0x80000006, 0x0);
+      }
+    }
+
+    // TLBs info, where function 0x18 supersedes function 0x2
+    if (max_standard_func >= 0x2)
+    {
+      cpuid_snapshot_capture(snapshot, backend, 0x2, 0x0);
+    }
+    if (max_standard_func >= 0x18)
+    {
+      u32 max_tlb_subfunc = (u32)cpuid_snapshot_capture(snapshot, backend, 0x18, 0x0)[EAX];
+      for (u32 subfunc = 0x1; (subfunc <= max_tlb_subfunc) && (subfunc < CPUID_MAX_TLB_SUBFUNC_COUNT); subfunc++)
+      {
+        cpuid_snapshot_capture(snapshot, backend, 0x18, subfunc);
+      }
+    }
+
+    // Core type of the current core on hybrid CPUs
+    s32 is_hybrid = (structured_features_edx >> 15) & 0b1;
+    if (is_hybrid && (max_standard_func >= 0x1A))
+    {
+      cpuid_snapshot_capture(snapshot, backend, 0x1A, 0x0);
+    }
+  }
+}
+
+void cpuid_snapshot_init(struct cpuid_snapshot* snapshot)
+{
+  if (!cpuid_is_available())
+  {
+    snapshot->leaf_count = 0;
+    snapshot->xcr0       = 0;
+    snapshot->is_local   = 1;
+    return;
+  }
+
+  CPU_SPECS_STATS_BEGIN(start_tsc);
+  cpuid_snapshot_init_from_backend(snapshot, &cpuid_native_backend);
+  CPU_SPECS_STATS_END(start_tsc, CPU_SPECS_PHASE_SNAPSHOT);
+}
+
+u32 cpuid_snapshot_get(const struct cpuid_snapshot* snapshot, s32 out[4], u32 func, u32 sub_func)
+{
+  const s32* leaf_out = cpuid_find_leaf(snapshot->leaves, snapshot->leaf_count, func, sub_func);
+  u32        found    = (leaf_out != 0);
+  leaf_out = found ? leaf_out : cpuid_snapshot_missing_leaf;
+
+  out[EAX] = leaf_out[EAX];
+  out[EBX] = leaf_out[EBX];
+  out[ECX] = leaf_out[ECX];
+  out[EDX] = leaf_out[EDX];
+
+  return found;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// CPUID snapshot serialization
+// Blob layout, with all values stored as little-endian 32-bit integers:
+// - magic number: CPUID_SNAPSHOT_BLOB_MAGIC
+// - format version: CPUID_SNAPSHOT_BLOB_VERSION
+// - leaf count
+// - FNV-1a checksum of everything below
+// - XCR0 (low and high halves)
+// - is_local
+// - leaf count x (func, sub_func, EAX, EBX, ECX, EDX)
+#define CPUID_SNAPSHOT_BLOB_MAGIC       0x53555043 // "CPUS"
+#define CPUID_SNAPSHOT_BLOB_HEADER_SIZE 16
+#define CPUID_SNAPSHOT_BLOB_STATE_SIZE  12
+#define CPUID_SNAPSHOT_BLOB_LEAF_SIZE   24
+
+static void blob_write_u32(u8* blob, u32 value)
+{
+  blob[0] = (u8)value;
+  blob[1] = (u8)(value >> 8);
+  blob[2] = (u8)(value >> 16);
+  blob[3] = (u8)(value >> 24);
+}
+
+static u32 blob_read_u32(const u8* blob)
+{
+  return (u32)blob[0] | ((u32)blob[1] << 8) | ((u32)blob[2] << 16) | ((u32)blob[3] << 24);
+}
+
+static u32 blob_checksum(const u8* bytes, s32 size)
+{
+  u32 hash = 0x811C9DC5;
+  for (s32 i = 0; i < size; i++)
+  {
+    hash = (hash ^ bytes[i]) * 0x01000193;
+  }
+
+  return hash;
+}
+
+s32 cpuid_snapshot_serialize(const struct cpuid_snapshot* snapshot, void* blob, s32 blob_size)
+{
+  s32 body_size     = CPUID_SNAPSHOT_BLOB_STATE_SIZE + snapshot->leaf_count * CPUID_SNAPSHOT_BLOB_LEAF_SIZE;
+  s32 required_size = CPUID_SNAPSHOT_BLOB_HEADER_SIZE + body_size;
+  if (blob_size < required_size)
+  {
+    return 0;
+  }
+
+  u8* body = (u8*)blob + CPUID_SNAPSHOT_BLOB_HEADER_SIZE;
+  blob_write_u32(body,     (u32)snapshot->xcr0);
+  blob_write_u32(body + 4, (u32)(snapshot->xcr0 >> 32));
+  blob_write_u32(body + 8, (u32)snapshot->is_local);
+
+  u8* leaf_bytes = body + CPUID_SNAPSHOT_BLOB_STATE_SIZE;
+  for (s32 i = 0; i < snapshot->leaf_count; i++)
+  {
+    const struct cpuid_leaf* leaf = &snapshot->leaves[i];
+    u8* leaf_blob = leaf_bytes + i * CPUID_SNAPSHOT_BLOB_LEAF_SIZE;
+
+    blob_write_u32(leaf_blob,      leaf->func);
+    blob_write_u32(leaf_blob +  4, leaf->sub_func);
+    blob_write_u32(leaf_blob +  8, (u32)leaf->out[EAX]);
+    blob_write_u32(leaf_blob + 12, (u32)leaf->out[EBX]);
+    blob_write_u32(leaf_blob + 16, (u32)leaf->out[ECX]);
+    blob_write_u32(leaf_blob + 20, (u32)leaf->out[EDX]);
+  }
+
+  u8* header = (u8*)blob;
+  blob_write_u32(header,      CPUID_SNAPSHOT_BLOB_MAGIC);
+  blob_write_u32(header +  4, CPUID_SNAPSHOT_BLOB_VERSION);
+  blob_write_u32(header +  8, (u32)snapshot->leaf_count);
+  blob_write_u32(header + 12, blob_checksum(body, body_size));
+
+  return required_size;
+}
+
+u32 cpuid_snapshot_deserialize(struct cpuid_snapshot* snapshot, const void* blob, s32 blob_size)
+{
+  const u8* header = (const u8*)blob;
+  if (blob_size < CPUID_SNAPSHOT_BLOB_HEADER_SIZE)
+  {
+    return 0;
+  }
+
+  u32 magic      = blob_read_u32(header);
+  u32 version    = blob_read_u32(header + 4);
+  u32 leaf_count = blob_read_u32(header + 8);
+  u32 checksum   = blob_read_u32(header + 12);
+  if ((magic != CPUID_SNAPSHOT_BLOB_MAGIC) || (version != CPUID_SNAPSHOT_BLOB_VERSION)
+   || (leaf_count > CPUID_SNAPSHOT_MAX_LEAF_COUNT))
+  {
+    return 0;
+  }
+
+  s32 body_size = CPUID_SNAPSHOT_BLOB_STATE_SIZE + (s32)leaf_count * CPUID_SNAPSHOT_BLOB_LEAF_SIZE;
+  const u8* body = header + CPUID_SNAPSHOT_BLOB_HEADER_SIZE;
+  if ((blob_size - CPUID_SNAPSHOT_BLOB_HEADER_SIZE < body_size)
+   || (blob_checksum(body, body_size) != checksum))
+  {
+    return 0;
+  }
+
+  snapshot->xcr0     = (u64)blob_read_u32(body) | ((u64)blob_read_u32(body + 4) << 32);
+  snapshot->is_local = (s32)blob_read_u32(body + 8);
+
+  const u8* leaf_bytes = body + CPUID_SNAPSHOT_BLOB_STATE_SIZE;
+
+  for (s32 i = 0; i < (s32)leaf_count; i++)
+  {
+    struct cpuid_leaf* leaf = &snapshot->leaves[i];
+    const u8* leaf_blob = leaf_bytes + i * CPUID_SNAPSHOT_BLOB_LEAF_SIZE;
+
+    leaf->func     = blob_read_u32(leaf_blob);
+    leaf->sub_func = blob_read_u32(leaf_blob + 4);
+    leaf->out[EAX] = (s32)blob_read_u32(leaf_blob +  8);
+    leaf->out[EBX] = (s32)blob_read_u32(leaf_blob + 12);
+    leaf->out[ECX] = (s32)blob_read_u32(leaf_blob + 16);
+    leaf->out[EDX] = (s32)blob_read_u32(leaf_blob + 20);
+  }
+  snapshot->leaf_count = (s32)leaf_count;
+
+  return 1;
+}
+
+u32 cpuid_snapshot_matches_cpu(const struct cpuid_snapshot* snapshot)
+{
+  // An empty snapshot only matches CPUs without CPUID
+  if (!cpuid_is_available())
+  {
+    return snapshot->leaf_count == 0;
+  }
+
+  s32 cpuid_out[4];
+  s32 snapshot_out[4];
+
+  // The family, model and stepping signature changes with any CPU replacement, VM migration to
+  // another host model or microcode-visible revision
+  if (!cpuid_snapshot_get(snapshot, snapshot_out, 0x1, 0x0))
+  {
+    return 0;
+  }
+
+  CPU_SPECS_CPUIDEX(cpuid_out, 0x1, 0x0);
+  if (cpuid_out[EAX] != snapshot_out[EAX])
+  {
+    return 0;
+  }
+
+  // The register states enabled by the OS may differ between machines or VM images sharing the
+  // same CPU model. XGETBV is much cheaper than CPUID, as it never traps to the hypervisor
+  if (cpuid_get_xcr0(cpuid_out, &cpuid_native_backend) != snapshot->xcr0)
+  {
+    return 0;
+  }
+
+  // The processor name string tells apart different SKUs sharing the same signature
+  for (u32 func = 0x80000002; func <= 0x80000004; func++)
+  {
+    if (cpuid_snapshot_get(snapshot, snapshot_out, func, 0x0))
+    {
+      CPU_SPECS_CPUIDEX(cpuid_out, (s32)func, 0x0);
+      if ((cpuid_out[EAX] != snapshot_out[EAX]) || (cpuid_out[EBX] != snapshot_out[EBX])
+       || (cpuid_out[ECX] != snapshot_out[ECX]) || (cpuid_out[EDX] != snapshot_out[EDX]))
+      {
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// CPU specs
+// Core type reported by function 0x1A for Intel's efficient (Atom) cores
+#define INTEL_CORE_TYPE_ATOM 0x20
+
+static s32 cpu_specs_intel_get_core_type(const s32 hybrid_info[4])
+{
+  s32 core_type = ((u32)hybrid_info[EAX] >> 24) & 0xFF;
+  return (core_type == INTEL_CORE_TYPE_ATOM) ? CPU_CORE_TYPE_EFFICIENT : CPU_CORE_TYPE_PERFORMANCE;
+}
+
+// Hybrid CPUs have a few dozen cores at most. Cores beyond this count are all counted as distinct
+#define CPU_SPECS_MAX_HYBRID_CORE_COUNT 512
+
+struct cpu_specs_hybrid_pass
+{
+  // Highest valid standard CPUID function
+  u32 max_standard_func;
+
+  // Count of logical processors of each core type
+  s32 logical_processor_counts[CPU_CORE_TYPE_COUNT];
+
+  // Count of distinct physical cores of each core type, and their IDs, of all types. Counting
+  // cores rather than dividing logical processors by the SMT width stays right when the process
+  // may only run on some of the SMT siblings of a core
+  s32 core_counts[CPU_CORE_TYPE_COUNT];
+  s32 core_id_count;
+  u32 core_ids[CPU_SPECS_MAX_HYBRID_CORE_COUNT];
+
+  // x2APIC ID of the first logical processor seen on each core, which tells the cores sharing a
+  // cache apart. Without a usable topology function, there are none (0)
+  u32 core_x2apic_ids[CPU_SPECS_MAX_HYBRID_CORE_COUNT];
+  s32 has_x2apic_ids;
+
+  // Cores and caches functions, captured on the first logical processor of each core type
+  struct cpuid_snapshot snapshots[CPU_CORE_TYPE_COUNT];
+};
+
+// Count the core of the calling logical processor if it wasn't seen yet. SMT siblings share their
+// x2APIC ID but for its low SMT shift bits. Without a usable topology function, as on some
+// hypervisors, each logical processor is taken as its own core
+static void cpu_specs_hybrid_count_core(struct cpu_specs_hybrid_pass* pass, s32 os_cpu_index, s32 core_type)
+{
+  s32 cpuid_out[4];
+  u32 higher_func = (pass->max_standard_func >= 0x1F) ? 0x1F : 0xB;
+  CPU_SPECS_CPUIDEX(cpuid_out, (s32)higher_func, 0x0);
+
+  u32 core_id = (u32)os_cpu_index;
+  if (cpuid_out[EBX] & 0xFFFF)
+  {
+    core_id = (u32)cpuid_out[EDX] >> (cpuid_out[EAX] & 0x1F);
+  }
+  else
+  {
+    pass->has_x2apic_ids = 0;
+  }
+
+  for (s32 i = 0; i < pass->core_id_count; i++)
+  {
+    if (pass->core_ids[i] == core_id)
+    {
+      return;
+    }
+  }
+
+  if (pass->core_id_count < CPU_SPECS_MAX_HYBRID_CORE_COUNT)
+  {
+    pass->core_x2apic_ids[pass->core_id_count] = (u32)cpuid_out[EDX];
+    pass->core_ids[pass->core_id_count++]      = core_id;
+  }
+  pass->core_counts[core_type]++;
+}
+
+// Count the cores of all types sharing a cache with the logical processor of x2APIC ID x2apic_id,
+// among the ones the pass visited. Logical processors sharing a cache share their x2APIC ID but
+// for its low bits, enough to count max_attached_thread_count IDs
+static s32 cpu_specs_hybrid_count_sharing_cores(const struct cpu_specs_hybrid_pass* pass, u32 x2apic_id, s32 max_attached_thread_count)
+{
+  s32 cache_shift = 0;
+  while ((cache_shift < 31) && (((u32)1 << cache_shift) < (u32)max_attached_thread_count))
+  {
+    cache_shift++;
+  }
+
+  s32 sharing_core_count = 0;
+  for (s32 i = 0; i < pass->core_id_count; i++)
+  {
+    sharing_core_count += ((pass->core_x2apic_ids[i] >> cache_shift) == (x2apic_id >> cache_shift));
+  }
+
+  return sharing_core_count;
+}
+
+// Replace the attached core counts of a core type's caches, which were decoded as if the whole CPU
+// was made of this core type, by the cores of all types sharing them. For instance, the L3 cache of
+// Alder Lake is shared by P-cores of 2 threads and E-cores of 1 thread
+static void cpu_specs_hybrid_get_attached_core_counts(const struct cpu_specs_hybrid_pass* pass, s32 core_type, struct cpu_cache_level_specs* cache_level_specs)
+{
+  s32 cpuid_out[4];
+  u32 higher_func = (pass->max_standard_func >= 0x1F) ? 0x1F : 0xB;
+  if (!pass->has_x2apic_ids || !cpuid_snapshot_get(&pass->snapshots[core_type], cpuid_out, higher_func, 0x0))
+  {
+    return;
+  }
+
+  for (s32 cache_idx = 0; cache_idx < CACHE_LEVEL_COUNT; cache_idx++)
+  {
+    struct cpu_cache_level_specs* cache_level_spec = &cache_level_specs[cache_idx];
+    if ((cache_level_spec->data_cache_size != 0) && (cache_level_spec->max_attached_thread_count > 0))
+    {
+      s32 sharing_core_count = cpu_specs_hybrid_count_sharing_cores(pass, (u32)cpuid_out[EDX], cache_level_spec->max_attached_thread_count);
+      cache_level_spec->attached_core_count = (sharing_core_count > 0) ? sharing_core_count : 1;
+    }
+  }
+}
+
+static void cpu_specs_hybrid_visit_cpu(s32 os_cpu_index, void* user_data)
+{
+  struct cpu_specs_hybrid_pass* pass = (struct cpu_specs_hybrid_pass*)user_data;
+
+  s32 cpuid_out[4];
+  CPU_SPECS_CPUIDEX(cpuid_out, 0x1A, 0x0);
+  s32 core_type = cpu_specs_intel_get_core_type(cpuid_out);
+  cpu_specs_hybrid_count_core(pass, os_cpu_index, core_type);
+
+  if (pass->logical_processor_counts[core_type]++ == 0)
+  {
+    // Only capture what cpu_specs_intel_get_cores_info() and cpu_specs_intel_get_caches_info()
+    // read, which is what differs between core types
+    const struct cpuid_backend* backend  = &cpuid_native_backend;
+    struct cpuid_snapshot*      snapshot = &pass->snapshots[core_type];
+    snapshot->leaf_count = 0;
+    snapshot->xcr0       = 0;
+    snapshot->is_local   = 1;
+    cpuid_snapshot_capture(snapshot, backend, 0x0, 0x0);
+    cpuid_snapshot_capture(snapshot, backend, 0x80000000, 0x0);
+    cpuid_snapshot_capture(snapshot, backend, 0x1, 0x0);
+
+    u32 higher_func = (pass->max_standard_func >= 0x1F) ? 0x1F : 0xB;
+    cpuid_snapshot_capture_topology(snapshot, backend, higher_func);
+    cpuid_snapshot_capture_caches(snapshot, backend, 0x4);
+  }
+}
+
+// Describe each core type by visiting all logical processors. Returns 0 if that's not possible
+static u32 cpu_specs_intel_get_hybrid_info(struct cpuid_ctx cpuid_ctx, struct cpu_specs* specs)
+{
+  if (cpuid_ctx.max_standard_func < 0x1A)
+  {
+    return 0;
+  }
+
+  struct cpu_specs_hybrid_pass pass;
+  pass.max_standard_func = cpuid_ctx.max_standard_func;
+  pass.core_id_count     = 0;
+  pass.has_x2apic_ids    = 1;
+  for (s32 core_type = 0; core_type < CPU_CORE_TYPE_COUNT; core_type++)
+  {
+    pass.logical_processor_counts[core_type] = 0;
+    pass.core_counts[core_type]              = 0;
+  }
+
+  if (os_for_each_cpu(cpu_specs_hybrid_visit_cpu, &pass) == 0)
+  {
+    return 0;
+  }
+
+  // Decode each core type's snapshot as if the whole CPU was made of this core type, then only
+  // keep the core count of this core type
+  s32 total_core_count = 0;
+  for (s32 core_type = 0; core_type < CPU_CORE_TYPE_COUNT; core_type++)
+  {
+    struct cpu_core_type_specs* core_type_specs = &specs->core_type_specs[core_type];
+    if (pass.logical_processor_counts[core_type] == 0)
+    {
+      struct cpu_core_type_specs empty_core_type_specs = {0};
+      *core_type_specs = empty_core_type_specs;
+      continue;
+    }
+
+    struct cpu_specs core_type_cpu_specs = *specs;
+    cpu_specs_intel_get_cores_info(&pass.snapshots[core_type], cpuid_ctx, &core_type_cpu_specs);
+    cpu_specs_intel_get_caches_info(&pass.snapshots[core_type], cpuid_ctx, &core_type_cpu_specs);
+
+    core_type_specs->threads_per_core = core_type_cpu_specs.threads_per_core;
+    core_type_specs->core_count       = pass.core_counts[core_type];
+    for (s32 cache_idx = 0; cache_idx < CACHE_LEVEL_COUNT; cache_idx++)
+    {
+      core_type_specs->cache_level_specs[cache_idx]             = core_type_cpu_specs.cache_level_specs[cache_idx];
+      core_type_specs->instruction_cache_level_specs[cache_idx] = core_type_cpu_specs.instruction_cache_level_specs[cache_idx];
+    }
+    cpu_specs_hybrid_get_attached_core_counts(&pass, core_type, core_type_specs->cache_level_specs);
+    cpu_specs_hybrid_get_attached_core_counts(&pass, core_type, core_type_specs->instruction_cache_level_specs);
+
+    total_core_count += core_type_specs->core_count;
+  }
+
+  // The specs of the whole CPU are the ones of its performance cores, if any
+  s32 main_core_type = pass.logical_processor_counts[CPU_CORE_TYPE_PERFORMANCE] ? CPU_CORE_TYPE_PERFORMANCE : CPU_CORE_TYPE_EFFICIENT;
+  specs->core_count       = total_core_count;
+  specs->threads_per_core = specs->core_type_specs[main_core_type].threads_per_core;
+  for (s32 cache_idx = 0; cache_idx < CACHE_LEVEL_COUNT; cache_idx++)
+  {
+    specs->cache_level_specs[cache_idx]             = specs->core_type_specs[main_core_type].cache_level_specs[cache_idx];
+    specs->instruction_cache_level_specs[cache_idx] = specs->core_type_specs[main_core_type].instruction_cache_level_specs[cache_idx];
+  }
+
+  return 1;
+}
+
+// Describe all cores as the type of the core the snapshot was taken on
+static void cpu_specs_get_core_type_specs(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx, struct cpu_specs* specs)
+{
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x0, 0x0);
+  s32 is_intel = (cpuid_out[ECX] == CPU_MANUFACTURER_INTEL);
+
+  specs->is_hybrid = 0;
+  if (is_intel && (cpuid_ctx.max_standard_func >= 0x7))
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x7, 0x0);
+    specs->is_hybrid = (cpuid_out[EDX] >> 15) & 0b1;
+  }
+
+  s32 core_type = CPU_CORE_TYPE_PERFORMANCE;
+  if (specs->is_hybrid && cpuid_snapshot_get(snapshot, cpuid_out, 0x1A, 0x0))
+  {
+    core_type = cpu_specs_intel_get_core_type(cpuid_out);
+  }
+
+  for (s32 i = 0; i < CPU_CORE_TYPE_COUNT; i++)
+  {
+    struct cpu_core_type_specs empty_core_type_specs = {0};
+    specs->core_type_specs[i] = empty_core_type_specs;
+  }
+
+  struct cpu_core_type_specs* core_type_specs = &specs->core_type_specs[core_type];
+  core_type_specs->core_count       = specs->core_count;
+  core_type_specs->threads_per_core = specs->threads_per_core;
+  for (s32 cache_idx = 0; cache_idx < CACHE_LEVEL_COUNT; cache_idx++)
+  {
+    core_type_specs->cache_level_specs[cache_idx]             = specs->cache_level_specs[cache_idx];
+    core_type_specs->instruction_cache_level_specs[cache_idx] = specs->instruction_cache_level_specs[cache_idx];
+  }
+}
+
+// Get the fields derived from the caches and instructions. The hybrid pass replaces the caches
+// and core count once the snapshot is decoded, so it gets them again afterwards
+static void cpu_specs_get_cache_derived_info(const struct cpuid_snapshot* snapshot, struct cpu_specs* specs)
+{
+  specs->non_temporal_threshold = cpu_specs_get_non_temporal_threshold(specs);
+  cpu_specs_get_interference_sizes(snapshot, specs);
+}
+
+void cpu_specs_init_from_snapshot(const struct cpuid_snapshot* snapshot)
+{
+  // An empty snapshot means that CPUID was unavailable. See cpuid_is_available()
+  if (snapshot->leaf_count != 0)
+  {
+    struct cpuid_ctx cpuid_ctx = cpuid_ctx_get_from_snapshot(snapshot);
+
+    // Get details located at the same CPUID function regardless of the CPU's manucturer
+    CPU_SPECS_STATS_BEGIN(common_start_tsc);
+    cpu_specs_get_common_instructions(snapshot, cpuid_ctx, &cpu_specs);
+    cpu_specs_get_tsc_info(snapshot, cpuid_ctx, &cpu_specs);
+    cpu_specs_get_power_info(snapshot, cpuid_ctx, &cpu_specs);
+    cpu_specs_get_hypervisor_info(snapshot, &cpu_specs);
+    CPU_SPECS_STATS_END(common_start_tsc, CPU_SPECS_PHASE_COMMON_INSTRUCTIONS);
+
+    s32 cpu_manufacturer_ecx;
+    {
+      s32 cpuid_out[4];
+      cpuid_snapshot_get(snapshot, cpuid_out, 0x0, 0x0);
+      cpu_manufacturer_ecx = cpuid_out[ECX];
+    }
+
+    if (cpu_is_amd_compatible(cpu_manufacturer_ecx))
+    {
+      // Call order matters here
+      CPU_SPECS_STATS_BEGIN(cores_start_tsc);
+      cpu_specs_amd_get_cores_info(snapshot, cpuid_ctx, &cpu_specs);
+      CPU_SPECS_STATS_END(cores_start_tsc, CPU_SPECS_PHASE_CORES_INFO);
+
+      CPU_SPECS_STATS_BEGIN(caches_start_tsc);
+      cpu_specs_amd_get_caches_info(snapshot, cpuid_ctx, &cpu_specs);
+      CPU_SPECS_STATS_END(caches_start_tsc, CPU_SPECS_PHASE_CACHES_INFO);
+
+      CPU_SPECS_STATS_BEGIN(vendor_start_tsc);
+      cpu_specs_amd_get_instructions(snapshot, cpuid_ctx, &cpu_specs);
+      CPU_SPECS_STATS_END(vendor_start_tsc, CPU_SPECS_PHASE_VENDOR_INSTRUCTIONS);
+    }
+    else if (cpu_is_intel_compatible(cpu_manufacturer_ecx))
+    {
+      // Call order matters here
+      CPU_SPECS_STATS_BEGIN(cores_start_tsc);
+      cpu_specs_intel_get_cores_info(snapshot, cpuid_ctx, &cpu_specs);
+      CPU_SPECS_STATS_END(cores_start_tsc, CPU_SPECS_PHASE_CORES_INFO);
+
+      CPU_SPECS_STATS_BEGIN(caches_start_tsc);
+      cpu_specs_intel_get_caches_info(snapshot, cpuid_ctx, &cpu_specs);
+
+      // VIA's CPUs before Zhaoxin's lack function 0x4, and report their caches like AMD's
+      if ((cpu_manufacturer_ecx != CPU_MANUFACTURER_INTEL) && (cpuid_ctx.max_standard_func < 0x4))
+      {
+        cpu_specs_amd_get_legacy_caches_info(snapshot, cpuid_ctx, &cpu_specs);
+      }
+      CPU_SPECS_STATS_END(caches_start_tsc, CPU_SPECS_PHASE_CACHES_INFO);
+    }
+
+    CPU_SPECS_STATS_BEGIN(derived_start_tsc);
+
+    // The process may only be allowed to run on some of the cores, for instance in a container.
+    // This doesn't apply to snapshots of other machines
+    s32 allowed_core_count = snapshot->is_local ? os_get_allowed_core_count() : 0;
+    if ((allowed_core_count > 0) && (allowed_core_count < cpu_specs.core_count))
+    {
+      cpu_specs.core_count = allowed_core_count;
+    }
+
+    cpu_specs_get_core_type_specs(snapshot, cpuid_ctx, &cpu_specs);
+
+    // CPUID reports what the CPU supports, regardless of what the OS enables
+    cpu_specs_get_os_disabled_instructions(snapshot->xcr0, &cpu_specs);
+
+    // Depend on the instructions the OS enables
+    cpu_specs_get_preferred_vector_width(snapshot, &cpu_specs);
+    cpu_specs_get_x86_64_level(snapshot, cpuid_ctx, &cpu_specs);
+
+    cpu_specs_get_cache_derived_info(snapshot, &cpu_specs);
+    CPU_SPECS_STATS_END(derived_start_tsc, CPU_SPECS_PHASE_DERIVED_INFO);
+    
+    // TODO: would it be interesting to check for lesser known manufacturers?
+    // Check what their share is and was on the market
+    // - Cyrix
+    // - Geode
+    // - Rise
+    // - Vortex
+    // - ...
+  }
+
+  cpu_specs.is_initialized = 1;
+}
+
+void cpu_specs_init_hybrid_from_snapshot(const struct cpuid_snapshot* snapshot)
+{
+  // A single snapshot only describes the core it was taken on
+  if (cpu_specs.is_hybrid && snapshot->is_local)
+  {
+    CPU_SPECS_STATS_BEGIN(start_tsc);
+    if (cpu_specs_intel_get_hybrid_info(cpuid_ctx_get_from_snapshot(snapshot), &cpu_specs))
+    {
+      cpu_specs_get_cache_derived_info(snapshot, &cpu_specs);
+    }
+    CPU_SPECS_STATS_END(start_tsc, CPU_SPECS_PHASE_HYBRID_INFO);
+  }
+}
+
+void cpu_specs_init(void)
+{
+  struct cpuid_snapshot snapshot;
+  cpuid_snapshot_init(&snapshot);
+  cpu_specs_init_from_snapshot(&snapshot);
+  cpu_specs_init_hybrid_from_snapshot(&snapshot);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// CPU identity
+void cpu_identity_init_from_snapshot(const struct cpuid_snapshot* snapshot)
+{
+  // An empty snapshot means that CPUID was unavailable. See cpuid_is_available()
+  if (snapshot->leaf_count != 0)
+  {
+    s32 cpuid_out[4];
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x0, 0x0);
+
+    // Copy the CPU's manufacturer string in groups of 4 characters.
+    // EDX and ECX are intentionally swapped, this is how it is stored
+    u32* manufacturer_4bytes = (u32*)cpu_identity.manufacturer;
+    *manufacturer_4bytes++ = cpuid_out[EBX];
+    *manufacturer_4bytes++ = cpuid_out[EDX];
+    *manufacturer_4bytes   = cpuid_out[ECX];
+
+    // Get the CPU family, model and stepping
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
+    s32 family_model_stepping = cpuid_out[EAX];
+    s32 manufacturer_ecx      = *(s32*)(cpu_identity.manufacturer + 8);
+    cpu_get_family_model(family_model_stepping, manufacturer_ecx, &cpu_identity.family, &cpu_identity.model);
+    cpu_identity.stepping     = family_model_stepping & 0xF;
+
+    // If available, get the processor name string
+    struct cpuid_ctx cpuid_ctx = cpuid_ctx_get_from_snapshot(snapshot);
+    if (cpuid_ctx.max_extended_func >= 0x80000004)
+    {
+      // Writes the 48 bytes (3 x 4 x 4 bytes) of the processor name 
+      cpuid_snapshot_get(snapshot, (s32*)(cpu_identity.name),      0x80000002, 0x0);
+      cpuid_snapshot_get(snapshot, (s32*)(cpu_identity.name + 16), 0x80000003, 0x0);
+      cpuid_snapshot_get(snapshot, (s32*)(cpu_identity.name + 32), 0x80000004, 0x0);
+    }
+  }
+}
+
+void cpu_identity_init(void)
+{
+  // Only capture what the cpu_identity decoder reads
+  struct cpuid_snapshot snapshot;
+  snapshot.leaf_count = 0;
+  s32 is_available = cpuid_is_available();
+
+  CPU_SPECS_STATS_BEGIN(start_tsc);
+  if (is_available)
+  {
+    cpuid_snapshot_capture_identity(&snapshot, &cpuid_native_backend);
+  }
+  cpu_identity_init_from_snapshot(&snapshot);
+  CPU_SPECS_STATS_END(start_tsc, CPU_SPECS_PHASE_IDENTITY);
+}
+#endif
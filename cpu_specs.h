@@ -1,5 +1,6 @@
 #pragma once
 
+#include "isa.h"
 #include "types.h"
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -12,10 +13,32 @@ enum cpuid_output_register
   EDX = 3
 };
 
+// Identified by ECX of CPUID function 0x0. Hygon's Zen-derived CPUs are decoded like AMD's, and
+// Centaur's and Zhaoxin's like Intel's
 enum cpu_manufacturer
 {
-  CPU_MANUFACTURER_AMD   = 0x444D4163, // "cAMD" of "AuthenticAMD"
-  CPU_MANUFACTURER_INTEL = 0x6C65746E  // "ntel" of "GenuineIntel"
+  CPU_MANUFACTURER_AMD     = 0x444D4163, // "cAMD" of "AuthenticAMD"
+  CPU_MANUFACTURER_INTEL   = 0x6C65746E, // "ntel" of "GenuineIntel"
+  CPU_MANUFACTURER_HYGON   = 0x656E6975, // "uine" of "HygonGenuine"
+  CPU_MANUFACTURER_CENTAUR = 0x736C7561, // "auls" of "CentaurHauls"
+  CPU_MANUFACTURER_ZHAOXIN = 0x20206961  // "ai  " of "  Shanghai  "
+};
+
+// Hypervisors, identified by the vendor signature of CPUID function 0x40000000
+enum cpu_hypervisor
+{
+  CPU_HYPERVISOR_NONE = 0,   // Bare metal, or a hypervisor hiding itself
+  CPU_HYPERVISOR_UNKNOWN,    // Reported as present, with an unknown signature
+  CPU_HYPERVISOR_KVM,
+  CPU_HYPERVISOR_HYPER_V,
+  CPU_HYPERVISOR_VMWARE,
+  CPU_HYPERVISOR_XEN,
+  CPU_HYPERVISOR_VIRTUALBOX,
+  CPU_HYPERVISOR_QEMU,       // QEMU's TCG emulation, without KVM
+  CPU_HYPERVISOR_PARALLELS,
+  CPU_HYPERVISOR_BHYVE,
+  CPU_HYPERVISOR_ACRN,
+  CPU_HYPERVISOR_COUNT
 };
 
 enum cache_level
@@ -27,33 +50,152 @@ enum cache_level
   CACHE_LEVEL_COUNT
 };
 
-enum cpu_instruction
+enum cache_type
 {
-  // SIMD extensions
-  SSE1    = 1 <<  0,
-  SSE2    = 1 <<  1,
-  SSE3    = 1 <<  2, 
-  SSSE3   = 1 <<  3,
-  SSE4_1  = 1 <<  4,
-  SSE4_2  = 1 <<  5,
-  AVX1    = 1 <<  6,
-  AVX2    = 1 <<  7,
-  FMA3    = 1 <<  8,
-  AVX512F = 1 <<  9,
-
-  // Bitwise instruction
-  POPCNT  = 1 << 10,
-  LZCNT   = 1 << 11,
-  TZCNT   = 1 << 12,
-  BMI1    = 1 << 13,
-  BMI2    = 1 << 14,
-  TBM     = 1 << 15,
+  // Values match the cache type field of Intel's function 0x4 and AMD's function 0x8000001D
+  CACHE_TYPE_NULL        = 0,
+  CACHE_TYPE_DATA        = 1,
+  CACHE_TYPE_INSTRUCTION = 2,
+  CACHE_TYPE_UNIFIED     = 3
+};
 
-  // Utilities
-  RDTSCP  = 1 << 16,
-  F16C    = 1 << 17
+enum cpu_core_type
+{
+  // Cores of non-hybrid CPUs are all described as performance cores
+  CPU_CORE_TYPE_PERFORMANCE = 0,
+  CPU_CORE_TYPE_EFFICIENT,
+  CPU_CORE_TYPE_COUNT
 };
 
+// Instruction flags of cpu_specs.instructions. These are 64-bit macros rather than enum values,
+// since enum values are limited to the range of an int
+#define CPU_INSTRUCTION(bit) ((u64)1 << (bit))
+
+#if defined(ISA_arm64)
+// ARM64 flags, as reported by the OS since user mode can't read the ID registers everywhere. NEON
+// (Advanced SIMD) is part of the ARMv8-A baseline, so it is always set
+#define NEON            CPU_INSTRUCTION( 0)
+
+// Half-precision arithmetic (FEAT_FP16), dot products (FEAT_DotProd), 8-bit integer matrix
+// multiplication (FEAT_I8MM) and BFloat16 (FEAT_BF16)
+#define FP16            CPU_INSTRUCTION( 1)
+#define DOTPROD         CPU_INSTRUCTION( 2)
+#define I8MM            CPU_INSTRUCTION( 3)
+#define BF16            CPU_INSTRUCTION( 4)
+
+// Scalable Vector Extensions, see cpu_specs.sve_vector_length
+#define SVE             CPU_INSTRUCTION( 5)
+#define SVE2            CPU_INSTRUCTION( 6)
+
+// Large System Extensions atomics (FEAT_LSE), such as LDADD and CAS
+#define LSE             CPU_INSTRUCTION( 7)
+
+// CRC32 and cryptography
+#define CRC32           CPU_INSTRUCTION( 8)
+#define AES             CPU_INSTRUCTION( 9)
+#define PMULL           CPU_INSTRUCTION(10)
+#define SHA1            CPU_INSTRUCTION(11)
+#define SHA2            CPU_INSTRUCTION(12)
+#define SHA3            CPU_INSTRUCTION(13)
+#define SHA512          CPU_INSTRUCTION(14)
+#else
+// SIMD extensions
+#define SSE1            CPU_INSTRUCTION( 0)
+#define SSE2            CPU_INSTRUCTION( 1)
+#define SSE3            CPU_INSTRUCTION( 2)
+#define SSSE3           CPU_INSTRUCTION( 3)
+#define SSE4_1          CPU_INSTRUCTION( 4)
+#define SSE4_2          CPU_INSTRUCTION( 5)
+#define AVX1            CPU_INSTRUCTION( 6)
+#define AVX2            CPU_INSTRUCTION( 7)
+#define FMA3            CPU_INSTRUCTION( 8)
+#define AVX512F         CPU_INSTRUCTION( 9)
+
+// Bitwise instruction
+#define POPCNT          CPU_INSTRUCTION(10)
+#define LZCNT           CPU_INSTRUCTION(11)
+#define TZCNT           CPU_INSTRUCTION(12)
+#define BMI1            CPU_INSTRUCTION(13)
+#define BMI2            CPU_INSTRUCTION(14)
+#define TBM             CPU_INSTRUCTION(15)
+
+// Utilities. RDTSCP also returns the TSC_AUX register, see RDPID and TSC. This flag is function
+// 0x80000001 EDX bit 27, whereas it used to be the TSC bit of function 0x1, now the TSC flag
+#define RDTSCP          CPU_INSTRUCTION(16)
+#define F16C            CPU_INSTRUCTION(17)
+
+// AVX-512 subsets, which all require AVX512F
+#define AVX512BW        CPU_INSTRUCTION(18)
+#define AVX512DQ        CPU_INSTRUCTION(19)
+#define AVX512VL        CPU_INSTRUCTION(20)
+#define AVX512VNNI      CPU_INSTRUCTION(21)
+#define AVX512BF16      CPU_INSTRUCTION(22)
+#define AVX512FP16      CPU_INSTRUCTION(23)
+#define AVX512VBMI      CPU_INSTRUCTION(24)
+#define AVX512VBMI2     CPU_INSTRUCTION(25)
+#define AVX512IFMA      CPU_INSTRUCTION(26)
+#define AVX512VPOPCNTDQ CPU_INSTRUCTION(27)
+
+// VEX-encoded VNNI, available without AVX-512 (e.g. on Alder Lake)
+#define AVX_VNNI        CPU_INSTRUCTION(28)
+
+// Advanced Matrix Extensions
+#define AMX_TILE        CPU_INSTRUCTION(29)
+#define AMX_INT8        CPU_INSTRUCTION(30)
+#define AMX_BF16        CPU_INSTRUCTION(31)
+
+// Cryptography and Galois field arithmetic. VAES and VPCLMULQDQ are the 256-bit and 512-bit
+// forms of AES-NI and PCLMULQDQ
+#define GFNI            CPU_INSTRUCTION(32)
+#define VAES            CPU_INSTRUCTION(33)
+#define VPCLMULQDQ      CPU_INSTRUCTION(34)
+#define SHA             CPU_INSTRUCTION(35)
+
+// Multi-precision arithmetic (ADCX/ADOX)
+#define ADX             CPU_INSTRUCTION(36)
+
+// Miscellaneous instructions required by the x86-64 microarchitecture levels: 16-byte
+// compare-and-exchange (CMPXCHG16B), LAHF/SAHF in 64-bit mode and move with byte swap
+#define CX16            CPU_INSTRUCTION(37)
+#define LAHF_SAHF       CPU_INSTRUCTION(38)
+#define MOVBE           CPU_INSTRUCTION(39)
+
+// AVX-512 conflict detection, which requires AVX512F
+#define AVX512CD        CPU_INSTRUCTION(40)
+
+// Read processor ID, which reads the TSC_AUX register RDTSCP also returns, without the TSC. See
+// cpu_current.h
+#define RDPID           CPU_INSTRUCTION(41)
+
+// Cache control: prefetch for writing, with intent to write into L2 (PREFETCHWT1, Xeon Phi only),
+// optimized flush (CLFLUSHOPT), write back without eviction (CLWB) and demotion of a line to a
+// cache shared with other cores (CLDEMOTE)
+#define PREFETCHW       CPU_INSTRUCTION(42)
+#define PREFETCHWT1     CPU_INSTRUCTION(43)
+#define CLFLUSHOPT      CPU_INSTRUCTION(44)
+#define CLWB            CPU_INSTRUCTION(45)
+#define CLDEMOTE        CPU_INSTRUCTION(46)
+
+// Direct stores, which write a doubleword or quadword (MOVDIRI) or 64 bytes (MOVDIR64B) as
+// non-temporal stores, without caching. These are meant for device memory
+#define MOVDIRI         CPU_INSTRUCTION(47)
+#define MOVDIR64B       CPU_INSTRUCTION(48)
+
+// Enhanced REP MOVSB/STOSB, which are the fastest way to copy or fill more than a few hundred
+// bytes, and fast short REP MOVSB, which extends this to copies of less than 128 bytes
+#define ERMS            CPU_INSTRUCTION(49)
+#define FSRM            CPU_INSTRUCTION(50)
+
+// Read time stamp counter (RDTSC), which CPUs report apart from RDTSCP. See cpu_tsc.h
+#define TSC             CPU_INSTRUCTION(51)
+
+// Instructions added by each x86-64 microarchitecture level of the x86-64 psABI, on top of the
+// previous level. x86-64-v1 is the baseline of all x86-64 CPUs
+#define X86_64_V2_INSTRUCTIONS (CX16 | LAHF_SAHF | POPCNT | SSE3 | SSE4_1 | SSE4_2 | SSSE3)
+#define X86_64_V3_INSTRUCTIONS (AVX1 | AVX2 | BMI1 | BMI2 | F16C | FMA3 | LZCNT | MOVBE)
+#define X86_64_V4_INSTRUCTIONS (AVX512F | AVX512BW | AVX512CD | AVX512DQ | AVX512VL)
+#endif
+
 struct cpuid_ctx
 {
   // Highest valid standard CPUID function
@@ -63,34 +205,268 @@ struct cpuid_ctx
   u32 max_extended_func;
 };
 
+// Maximum count of CPUID functions and subfunctions a cpuid_snapshot can hold
+#define CPUID_SNAPSHOT_MAX_LEAF_COUNT 96
+
+// Version of the binary format written by cpuid_snapshot_serialize(). It changes along with the
+// set of captured CPUID functions, so that blobs written by another version of this library are
+// rejected rather than decoded with missing functions
+#define CPUID_SNAPSHOT_BLOB_VERSION 12
+
+// Maximum count of subfunctions of function 0x18 (TLBs) captured, see cpu_tlb.h. Intel CPUs list
+// less than 10 TLBs
+#define CPUID_MAX_TLB_SUBFUNC_COUNT 16
+
+// Size of a buffer large enough to hold any serialized cpuid_snapshot
+#define CPUID_SNAPSHOT_BLOB_MAX_SIZE (28 + CPUID_SNAPSHOT_MAX_LEAF_COUNT * 24)
+
+struct cpuid_leaf
+{
+  // CPUID function (EAX input) and subfunction (ECX input)
+  u32 func;
+  u32 sub_func;
+
+  // CPUID output, accessed with enum cpuid_output_register's values
+  s32 out[4];
+};
+
+struct cpuid_snapshot
+{
+  // Count of valid entries in leaves. This is 0 when CPUID is unavailable
+  s32 leaf_count;
+
+  // Extended control register 0 (XCR0), read with XGETBV, telling which register states the OS
+  // saves on context switches. This is 0 when the OS doesn't enable XSAVE (OSXSAVE unset)
+  u64 xcr0;
+
+  // Whether the snapshot describes the CPU of this machine (1), or was replayed from another one,
+  // such as a CPUID dump (0). The process' allowed cores only restrict core_count in the former case
+  s32 is_local;
+
+  // Raw output of every CPUID function and subfunction read to initialize cpu_specs, cpu_identity,
+  // cpu_topology, cpu_tlb_specs and cpu_rdt_specs, each captured exactly once
+  struct cpuid_leaf leaves[CPUID_SNAPSHOT_MAX_LEAF_COUNT];
+};
+
+// Source of the CPUID output captured by cpuid_snapshot_init_from_backend(): the CPUID instruction
+// itself, a dump of another CPU (see cpuid_dump_backend()), or any user-provided replacement
+typedef void cpuid_backend_func(void* user_data, s32 out[4], u32 func, u32 sub_func);
+typedef u64  cpuid_backend_xcr0_func(void* user_data);
+
+struct cpuid_backend
+{
+  // Write the output of a CPUID function and subfunction to out, the same way __cpuidex() would
+  cpuid_backend_func* cpuid;
+
+  // Return XCR0, as XGETBV would. Only called when function 0x1 reports OSXSAVE
+  cpuid_backend_xcr0_func* xcr0;
+
+  // Passed as is to both functions
+  void* user_data;
+
+  // Whether the backend describes the CPU of this machine (1) or not (0), see cpuid_snapshot
+  s32 is_local;
+};
+
+// Maximum count of CPUID functions and subfunctions a cpuid_dump can hold, which is enough for the
+// first logical processor of any dump
+#define CPUID_DUMP_MAX_LEAF_COUNT 256
+
+// CPUID functions and subfunctions parsed from a text dump by cpuid_dump_parse()
+struct cpuid_dump
+{
+  s32               leaf_count;
+  struct cpuid_leaf leaves[CPUID_DUMP_MAX_LEAF_COUNT];
+};
+
 struct cpu_cache_level_specs
 {
-  // Size of the data cache
+  // Size of the data cache. For instruction caches, this is the size of the instruction cache
   s32 data_cache_size;
 
-  // Count of logical thread sharing this cache
+  // Count of physical cores sharing this cache, on all backends. Logical processors sharing it are
+  // this times threads_per_core
   s32 attached_core_count;
+
+  // Maximum count of logical processors sharing this cache, as reported by the hardware regardless
+  // of the ones the process may run on: by CPUID's function 0x4 or 0x8000001D, which count APIC
+  // IDs so may exceed the actual count, or by the OS on ARM64. This is 0 if unreported, as by AMD's
+  // functions 0x80000005 and 0x80000006
+  s32 max_attached_thread_count;
+
+  // Type of the cache, as an enum cache_type value. This is CACHE_TYPE_NULL if there is no cache at
+  // this level, or if it wasn't enumerated
+  s32 type;
+
+  // Size of a cache line, in bytes
+  s32 line_size;
+
+  // Associativity, as the count of ways (cache lines per set). Fully associative caches have as
+  // many ways as cache lines, and a single set
+  s32 ways;
+
+  // Count of physical line partitions, which is 1 on virtually all CPUs
+  s32 partitions;
+
+  // Count of sets. Addresses (line_size * sets) bytes apart map to the same set, unless the cache
+  // has complex indexing
+  s32 sets;
+
+  // Whether the cache is inclusive of the lower cache levels (1) or not (0)
+  s32 is_inclusive;
+
+  // Whether the cache maps addresses to sets with a complex hash function (1), such as Intel's
+  // sliced L3 caches, or directly with address bits (0). AMD doesn't report this, so it is 0
+  s32 has_complex_indexing;
 };
 
+struct cpu_core_type_specs
+{
+  // Count of physical cores of this type
+  s32 core_count;
+
+  // Count of thread per core of this type
+  s32 threads_per_core;
+
+  // Cache level specs, as seen from a core of this type
+  struct cpu_cache_level_specs cache_level_specs[CACHE_LEVEL_COUNT];
+  struct cpu_cache_level_specs instruction_cache_level_specs[CACHE_LEVEL_COUNT];
+};
+
+// Bounds of cpu_specs' interference sizes on all supported CPUs, as compile-time constants for
+// static alignment and padding. Only Apple's ARM64 CPUs have 128-byte cache lines
+#define CPU_MIN_CONSTRUCTIVE_INTERFERENCE_SIZE 64
+#define CPU_MAX_DESTRUCTIVE_INTERFERENCE_SIZE  128
+
 struct cpu_specs
 {
   // Cache level specs accessed with enum cache_level's values. All physical caches at the same
   // level are expected to have the same features
   struct cpu_cache_level_specs cache_level_specs[CACHE_LEVEL_COUNT];
 
+  // Same as cache_level_specs, for instruction caches. In practice, only L1 instruction caches
+  // exist, L2 and L3 caches being unified
+  struct cpu_cache_level_specs instruction_cache_level_specs[CACHE_LEVEL_COUNT];
+
   // The cache line size seems to always be the same across all types of caches
   s32 cache_line_size;
 
+  // Interference sizes in bytes, as C++17's std::hardware_constructive_interference_size and
+  // std::hardware_destructive_interference_size, known at runtime. Data within constructive bytes
+  // is loaded together, while data written by different threads should be destructive bytes apart
+  // to avoid false sharing. The destructive size is twice the line size on CPUs whose prefetchers
+  // fetch lines in pairs: Intel's adjacent-line (spatial) prefetcher, and the L2 up/down
+  // prefetcher of AMD's Zen CPUs. See CPU_MAX_DESTRUCTIVE_INTERFERENCE_SIZE for static alignment
+  s32 constructive_interference_size;
+  s32 destructive_interference_size;
+
+  // Size in bytes from which copies and fills should use non-temporal stores, which bypass the
+  // caches, rather than evict the shared cache of the other cores. This follows glibc's x86 memcpy:
+  // a quarter of the L3 cache (or of the L2 cache without L3) with ERMS, or three quarters of the
+  // share of one thread (see attached_core_count) without, and at least 16 KiB. This is 0 without
+  // L2 and L3 caches
+  s32 non_temporal_threshold;
+
   // Count of thread per CPU core
   s32 threads_per_core;
 
-  // Count of logical processor in this CPU. This is always less than or equal to threads_per_core
+  // Count of logical processor in this CPU. This is always less than or equal to threads_per_core.
+  // Only the cores the process may run on are counted when the OS reports them, such as on Linux
+  // where cgroup cpusets restrict containers to some of the cores
   s32 core_count;
 
-  // Instruction flags
-  s32 instructions;
+  // Instruction flags, as a combination of the CPU_INSTRUCTION() macros above. Instructions using
+  // YMM, ZMM/opmask or AMX tile registers are only set if the OS enables these register states
+  u64 instructions;
+
+  // Instructions supported by the CPU, but unusable because the OS doesn't enable their register
+  // state (see cpuid_snapshot.xcr0). Executing them would fault. This is only meant for diagnostics
+  u64 disabled_instructions;
+
+  // Recommended width of vector code in bits (128, 256 or 512), among the widths the CPU and the
+  // OS support. This is narrower than the widest supported one when wider code runs slower, for
+  // instance 256 on Intel CPUs whose frequency drops on AVX-512 code, such as Skylake-SP, or 128 on
+  // AMD CPUs with 128-bit wide units, such as Zen 1
+  s32 preferred_vector_width;
+
+  // Length of SVE vectors in bits, from 128 to 2048, or 0 without SVE. This is always 0 on x86
+  s32 sve_vector_length;
+
+  // Highest x86-64 microarchitecture level (1 to 4) whose instructions are all set in
+  // instructions, such as 3 for x86-64-v3. This is 0 if the CPU doesn't support 64-bit mode, and on
+  // ARM64
+  s32 x86_64_level;
+
+  // Whether the CPU mixes performance and efficient cores, such as Intel's Alder Lake. On such
+  // CPUs, cache_level_specs and threads_per_core describe the performance cores, while core_count
+  // is the total count of physical cores of both types
+  s32 is_hybrid;
+
+  // Per core type specs, accessed with enum cpu_core_type's values. On non-hybrid CPUs, only
+  // CPU_CORE_TYPE_PERFORMANCE is filled, with the same values as above
+  struct cpu_core_type_specs core_type_specs[CPU_CORE_TYPE_COUNT];
+
+  // Whether the time stamp counter runs at a constant rate in all power states (1) or not (0).
+  // Only an invariant TSC can be used as a wall clock, see cpu_tsc.h
+  s32 has_invariant_tsc;
+
+  // Frequency of the time stamp counter in Hz, as reported by CPUID. This is 0 when CPUID doesn't
+  // report it, which is the case on AMD CPUs and Intel CPUs older than Skylake. On virtual machines,
+  // the hypervisor's timing function takes precedence, as the TSC may be scaled
+  u64 tsc_frequency;
+
+  // Base (nominal), maximum (turbo) and bus (reference) frequencies in MHz, as reported by
+  // CPUID. Each is 0 when unreported. Only Intel CPUs since Skylake report them
+  s32 base_frequency_mhz;
+  s32 max_frequency_mhz;
+  s32 bus_frequency_mhz;
+
+  // Whether cores may run above the base frequency when power and thermal headroom allow (1) or
+  // not (0): Intel's Turbo Boost, or AMD's Core Performance Boost. The BIOS or the OS may still
+  // disable it, and Intel CPUs whose turbo is disabled may not report it at all
+  s32 has_turbo_boost;
+
+  // Whether the CPU selects its own P-states within bounds set by the OS (1) or not (0): Intel's
+  // Hardware P-states (HWP, Speed Shift) or AMD's Collaborative Processor Performance Control
+  // (CPPC). Frequency then reacts to load within a millisecond, without waiting for the governor
+  s32 has_hardware_pstates;
+
+  // Whether the OS can bias hardware P-states towards performance or power saving with an energy
+  // performance preference (EPP) (1) or not (0). Only Intel's HWP reports it
+  s32 has_energy_performance_preference;
+
+  // Whether the APERF and MPERF counters are available (1) or not (0). Their ratio over a period
+  // is the effective frequency relative to the TSC's, see cpu_frequency.h
+  s32 has_aperf_mperf;
+
+  // Hypervisor this code runs under, as an enum cpu_hypervisor value. Hypervisors emulating
+  // Hyper-V's interface, such as KVM and Xen with enlightenments on, are reported as themselves
+  s32 hypervisor;
+
+  // Whether the topology may not describe the physical CPU (1) or not (0), which is the case under
+  // any hypervisor. Virtual CPUs are scheduled on host logical processors regardless of the
+  // virtual sockets, cores and SMT siblings the topology functions (0xB, 0x1F, 0x8000001E) report.
+  // Two vCPUs reported as SMT siblings may run on different physical cores, and vCPUs reported as
+  // distinct cores may share one. threads_per_core, core_count, the caches' attached_core_count
+  // and cpu_topology's IDs should then only be taken as hints
+  s32 is_topology_untrusted;
+
+  // Whether the hypervisor provides a paravirtual clock (1) or not (0): KVM's kvmclock or Hyper-V's
+  // reference TSC page. OS clocks built on them are cheap and stable on virtual machines
+  s32 has_paravirtual_clock;
+
+  // Frequency of the local APIC timer in Hz, as reported by the hypervisor's timing function
+  // (0x40000010, defined by VMware and also implemented by KVM, VirtualBox and ACRN), or 0
+  u64 apic_timer_frequency;
+
+  // Whether cpu_specs_init() or cpu_specs_init_from_snapshot() has been called (1) or not (0). The
+  // fields above hold conservative defaults until then, see cpu_dispatch.h
+  s32 is_initialized;
 };
 
+// On ARM64, family, model and stepping hold the implementer, part number, and variant and revision
+// of the Main ID Register (MIDR_EL1): 0x41 ("ARM"), 0xD0C (Neoverse N1) and 0x31 for r3p1, as
+// stepping is (variant << 4) | revision
 struct cpu_identity
 {
   // CPU family, which represents one or more processors belonging to a group that possesses some
@@ -110,20 +486,164 @@ struct cpu_identity
   schar8 name[48];
 };
 
+#if defined(CPU_SPECS_STATS) && !defined(ISA_arm64)
+// Optional instrumentation of the cost of detection, enabled by defining CPU_SPECS_STATS in all
+// files including this header. Without it, the counting and timing compile to nothing. Each CPUID
+// instruction may be a VM exit costing thousands of cycles under hypervisors
+
+// Phases of cpu_specs_init() and cpu_identity_init() timed by cpu_specs_stats. All CPUID
+// instructions are executed while capturing the snapshot, or by the hybrid pass, the other phases
+// decoding the snapshot
+enum cpu_specs_phase
+{
+  CPU_SPECS_PHASE_CPUID_AVAILABILITY = 0, // cpuid_is_available()
+  CPU_SPECS_PHASE_SNAPSHOT,               // cpuid_snapshot_init()'s captures
+  CPU_SPECS_PHASE_COMMON_INSTRUCTIONS,    // Instructions, TSC and hypervisor shared by all vendors
+  CPU_SPECS_PHASE_CORES_INFO,
+  CPU_SPECS_PHASE_CACHES_INFO,
+  CPU_SPECS_PHASE_VENDOR_INSTRUCTIONS,    // AMD-specific instructions
+  CPU_SPECS_PHASE_DERIVED_INFO,           // Allowed cores (read from the OS), vector width...
+  CPU_SPECS_PHASE_HYBRID_INFO,            // Visiting all logical processors of hybrid CPUs
+  CPU_SPECS_PHASE_IDENTITY,               // cpu_identity_init(), after cpuid_is_available()
+  CPU_SPECS_PHASE_COUNT
+};
+
+// Maximum count of distinct CPUID functions and subfunctions counted by cpu_specs_stats
+#define CPU_SPECS_STATS_MAX_LEAF_COUNT 128
+
+struct cpu_specs_leaf_stats
+{
+  // CPUID function and subfunction
+  u32 func;
+  u32 sub_func;
+
+  // Count of executions, and TSC cycles spent in them
+  u32 call_count;
+  u64 cycles;
+};
+
+struct cpu_specs_stats
+{
+  // Count of CPUID instructions executed by cpu_specs.c, including the ones beyond
+  // CPU_SPECS_STATS_MAX_LEAF_COUNT distinct leaves
+  u32 cpuid_call_count;
+
+  // Count of valid entries in leaves, in order of first execution
+  s32                         leaf_count;
+  struct cpu_specs_leaf_stats leaves[CPU_SPECS_STATS_MAX_LEAF_COUNT];
+
+  // TSC cycles spent in each phase, accessed with enum cpu_specs_phase's values, accumulated over
+  // all calls since the last cpu_specs_stats_reset(). These are RDTSC ticks at the TSC frequency,
+  // not core clock cycles
+  u64 phase_cycles[CPU_SPECS_PHASE_COUNT];
+};
+#endif
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 //// Implementation
 extern struct cpu_specs    cpu_specs;
 extern struct cpu_identity cpu_identity;
 
+#if defined(CPU_SPECS_STATS) && !defined(ISA_arm64)
+// Updated by every CPUID instruction and phase of cpu_specs.c. This isn't thread-safe, so
+// initialization should be done by a single thread
+extern struct cpu_specs_stats cpu_specs_stats;
+
+// Zero cpu_specs_stats, such as between two measured initializations
+void cpu_specs_stats_reset(void);
+#endif
+
+#if !defined(ISA_arm64)
 // Check whether the CPUID instruction is available. If available, returns 1. Otherwise, returns 0.
-// To avoid an invalid-opcode exception, cpu_specs_init(), cpu_identity_init() and cpuid_ctx_get()
-// should be called only if this returns 1
+// To avoid an invalid-opcode exception, cpuid_ctx_get() should be called only if this returns 1.
+// The other functions below check it by themselves
 u32 cpuid_is_available(void);
 
-// Initialize or refresh the global cpu_specs struct
+// Execute, exactly once each, every CPUID function and subfunction needed to initialize
+// cpu_specs, cpu_identity, cpu_topology, cpu_tlb_specs and cpu_rdt_specs, and store their output in
+// the snapshot. When CPUID is unavailable, the snapshot is left empty.
+// The snapshot is about 2.3 KiB large. Prefer this followed by cpu_specs_init_from_snapshot() and
+// cpu_identity_init_from_snapshot() over cpu_specs_init() and cpu_identity_init() when both globals
+// are needed, which would otherwise execute some CPUID functions twice. cpu_all_init() of
+// cpu_all.h does the same for every module
+void cpuid_snapshot_init(struct cpuid_snapshot* snapshot);
+
+// Same as cpuid_snapshot_init(), reading CPUID output from a backend instead of the CPUID
+// instruction. CPUID availability isn't checked, the backend being expected to provide it
+void cpuid_snapshot_init_from_backend(struct cpuid_snapshot* snapshot, const struct cpuid_backend* backend);
+
+// Parse a text CPUID dump, as published by InstLatx64 and written by AIDA64, with one function per
+// line such as "CPUID 00000004: 1C004121-01C0003F-0000003F-00000000 [SL 00]", the bracketed
+// subfunction being optional. Other lines are skipped, and parsing stops at the second logical
+// processor of multi-processor dumps, which restarts from function 0x0. Returns the count of
+// functions parsed, or 0 if the text holds none
+s32 cpuid_dump_parse(struct cpuid_dump* dump, const schar8* text, s32 text_length);
+
+// Return a backend replaying a parsed dump, which must outlive it. Functions missing from the dump
+// read as zeroes. A dump doesn't record XCR0, so the OS is assumed to enable every register state
+// the CPU supports (function 0xD, subfunction 0x0), as Linux and Windows do.
+// For instance, cpu_specs of any CPU model can be computed offline with:
+//   cpuid_dump_parse(&dump, text, text_length);
+//   struct cpuid_backend backend = cpuid_dump_backend(&dump);
+//   cpuid_snapshot_init_from_backend(&snapshot, &backend);
+//   cpu_specs_init_from_snapshot(&snapshot);
+struct cpuid_backend cpuid_dump_backend(const struct cpuid_dump* dump);
+
+// Decode the 4-bit associativity encoding of AMD's functions 0x80000006, 0x80000019 and later,
+// shared by caches and TLBs. line_count, the count of lines or entries, is returned for fully
+// associative ones, and 0 for disabled or reserved encodings
+s32 cpuid_amd_decode_associativity(s32 encoding, s32 line_count);
+
+// Copy the captured output of a CPUID function and subfunction to out, the same way __cpuidex()
+// would. If it wasn't captured, out is zeroed and returns 0. Otherwise, returns 1
+u32 cpuid_snapshot_get(const struct cpuid_snapshot* snapshot, s32 out[4], u32 func, u32 sub_func);
+
+// Write a versioned, checksummed binary copy of the snapshot to blob, which can then be handed to
+// other processes through a file, a shared memory section or any other channel. Returns the count
+// of bytes written, or 0 if blob_size is too small. CPUID_SNAPSHOT_BLOB_MAX_SIZE bytes are always
+// enough
+s32 cpuid_snapshot_serialize(const struct cpuid_snapshot* snapshot, void* blob, s32 blob_size);
+
+// Read a snapshot written by cpuid_snapshot_serialize(). Returns 1 on success, or 0 if the blob is
+// truncated, corrupted or was written with another CPUID_SNAPSHOT_BLOB_VERSION. This doesn't check
+// whether the snapshot describes the current CPU, see cpuid_snapshot_matches_cpu()
+u32 cpuid_snapshot_deserialize(struct cpuid_snapshot* snapshot, const void* blob, s32 blob_size);
+
+// Cheaply check whether a snapshot, typically deserialized, was taken on the same CPU model as the
+// current one, by comparing the family, model and stepping signature (function 0x1 EAX) and the
+// processor name string, and under the same OS state, by comparing XCR0. An OS or hypervisor
+// enabling other register states, such as AVX-512's with the same CPU, also invalidates the
+// snapshot, since the instructions decoded from it depend on them. This executes at most 4 CPUID
+// instructions and one XGETBV. Returns 1 if it matches. Otherwise, returns 0, and a new snapshot
+// should be taken
+u32 cpuid_snapshot_matches_cpu(const struct cpuid_snapshot* snapshot);
+
+#endif
+
+// Initialize or refresh the global cpu_specs struct.
+// On ARM64, features, caches and cores are read from the OS: IsProcessorFeaturePresent() and
+// GetLogicalProcessorInformationEx() on Windows, or getauxval() and sysfs on Linux, with cores
+// grouped by performance class on big.LITTLE CPUs.
+// On hybrid CPUs, core types differ in thread count and caches, so the calling thread is pinned to
+// each logical processor the process may run on in turn, to read its core type and the specs of
+// each core type. Its affinity is restored afterwards
 void cpu_specs_init(void);
 
+#if !defined(ISA_arm64)
+// Initialize or refresh the global cpu_specs struct from a snapshot. No CPUID instruction is
+// executed. An empty snapshot leaves cpu_specs untouched.
+// On hybrid CPUs, a single snapshot only describes the type of the core it was taken on, which is
+// then reported as the only core type. Prefer cpu_specs_init() on such CPUs, or follow this with
+// cpu_specs_init_hybrid_from_snapshot()
+void cpu_specs_init_from_snapshot(const struct cpuid_snapshot* snapshot);
+
+// Complete cpu_specs_init_from_snapshot() on hybrid CPUs by reading the specs of each core type,
+// pinning the calling thread as cpu_specs_init() does. cpu_specs_init() is cpuid_snapshot_init()
+// followed by both. This does nothing on other CPUs, or with a snapshot of another machine
+void cpu_specs_init_hybrid_from_snapshot(const struct cpuid_snapshot* snapshot);
+#endif
+
 // Initialize or refresh the global cpu_identity struct.
 // This is useful for statistics, dumps or to tune some performance-sensitive code to avoid certain
 // instructions which may behave abnormally on specific CPUs. Since this is a very specialized way
@@ -131,6 +651,12 @@ void cpu_specs_init(void);
 // struct
 void cpu_identity_init(void);
 
+#if !defined(ISA_arm64)
+// Initialize or refresh the global cpu_identity struct from a snapshot. No CPUID instruction is
+// executed. An empty snapshot leaves cpu_identity untouched
+void cpu_identity_init_from_snapshot(const struct cpuid_snapshot* snapshot);
+
 // Initialize and return a cpuid_ctx structure.
-// This is used by cpu_specs_init(), but may be useful for debugging purposes.
+// This may be useful for debugging purposes.
 struct cpuid_ctx cpuid_ctx_get(void);
+#endif
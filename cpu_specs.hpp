@@ -0,0 +1,161 @@
+#pragma once
+
+// C++17 wrapper around cpu_specs.h and cpu_baseline.h, in namespace cpu. The library itself stays
+// in C: cpu_specs.c (cpu_specs_arm64.c on ARM64) and os.c are still compiled and linked as usual.
+// Unlike the C headers, this one uses the C++ standard library, for std::call_once
+
+extern "C"
+{
+#include "cpu_specs.h"
+#include "cpu_baseline.h"
+}
+
+#include <cstddef>
+#include <mutex>
+#include <type_traits>
+
+namespace cpu
+{
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Instructions
+// Set of instruction flags, as a combination of the CPU_INSTRUCTION() macros such as AVX2 | FMA3
+struct instruction_set
+{
+  u64 flags;
+
+  constexpr instruction_set(u64 instruction_flags = 0) : flags(instruction_flags) {}
+
+  // Whether all instructions of other are in this set
+  constexpr bool contains(instruction_set other) const
+  {
+    return (flags & other.flags) == other.flags;
+  }
+
+  constexpr instruction_set operator|(instruction_set other) const
+  {
+    return instruction_set(flags | other.flags);
+  }
+
+  constexpr instruction_set operator&(instruction_set other) const
+  {
+    return instruction_set(flags & other.flags);
+  }
+
+  constexpr bool operator==(instruction_set other) const
+  {
+    return flags == other.flags;
+  }
+
+  constexpr bool operator!=(instruction_set other) const
+  {
+    return flags != other.flags;
+  }
+};
+
+// Instructions guaranteed by the compiler's target, see cpu_baseline.h
+inline constexpr instruction_set baseline_instructions = CPU_BASELINE_INSTRUCTIONS;
+
+// Whether the compiler's target guarantees all of Flags, as a compile-time constant
+template <u64 Flags>
+inline constexpr bool baseline_has = baseline_instructions.contains(Flags);
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Lazy initialization
+// Initialize the global cpu_specs struct on first use, exactly once even when several threads get
+// there at the same time, and return it. This replaces calling cpu_specs_init() at startup before
+// any other initialization reading cpu_specs, including the ones of other static objects
+inline const struct cpu_specs& specs()
+{
+  static std::once_flag once;
+  std::call_once(once, [] { cpu_specs_init(); });
+
+  return ::cpu_specs;
+}
+
+// Same as specs(), for the global cpu_identity struct
+inline const struct cpu_identity& identity()
+{
+  static std::once_flag once;
+  std::call_once(once, [] { cpu_identity_init(); });
+
+  return ::cpu_identity;
+}
+
+// Instructions available on this CPU and enabled by the OS
+inline instruction_set instructions()
+{
+  return specs().instructions;
+}
+
+// Whether all of Flags are available. This is the constant true, without initializing cpu_specs,
+// when the compiler's target guarantees them, as cpu_has() is
+template <u64 Flags>
+inline bool has()
+{
+  if constexpr (baseline_has<Flags>)
+  {
+    return true;
+  }
+  else
+  {
+    return instructions().contains(Flags);
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Interference sizes
+// Compile-time bounds of the interference sizes, as std::hardware_constructive_interference_size
+// and std::hardware_destructive_interference_size, for alignas() and padding. These hold on all
+// supported CPUs, unlike the standard ones, which some compilers don't provide or warn about
+inline constexpr std::size_t hardware_constructive_interference_size = CPU_MIN_CONSTRUCTIVE_INTERFERENCE_SIZE;
+inline constexpr std::size_t hardware_destructive_interference_size  = CPU_MAX_DESTRUCTIVE_INTERFERENCE_SIZE;
+
+// Detected interference sizes of this CPU, which are at least as tight as the bounds above
+inline std::size_t constructive_interference_size()
+{
+  return static_cast<std::size_t>(specs().constructive_interference_size);
+}
+
+inline std::size_t destructive_interference_size()
+{
+  return static_cast<std::size_t>(specs().destructive_interference_size);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Dispatch
+// Select the first variant of a kernel whose instructions are all available, given from the most
+// to the least specialized, with one instruction set of Features per variant. The last variant is
+// the fallback: its instructions must be guaranteed by the compiler's target, such as 0. Returns
+// the selected function pointer, meant to initialize a static variable, which C++ initializes
+// exactly once and thread-safely:
+//
+//   static const auto sum = cpu::dispatch<AVX512F | AVX512BW, AVX2, 0>(sum_avx512, sum_avx2, sum_c);
+//   sum(values, count);
+//
+// Variants whose instructions the compiler's target guarantees are selected at compile time, along
+// with the ones listed after them. With -march=x86-64-v4, the call above then folds to a direct
+// call to sum_avx512, without initializing cpu_specs
+template <u64... Features, typename Func, typename... Funcs>
+constexpr Func dispatch(Func func, Funcs... funcs)
+{
+  static_assert(sizeof...(Features) == 1 + sizeof...(Funcs), "Each variant needs an instruction set");
+  static_assert((std::is_same_v<Func, Funcs> && ...), "All variants must have the same type");
+
+  constexpr u64 features[] = {Features...};
+  static_assert(baseline_has<features[sizeof...(Funcs)]>, "The last variant must be runnable on the compiler's target");
+
+  const Func variants[] = {func, funcs...};
+  for (std::size_t i = 0; i < sizeof...(Funcs); i++)
+  {
+    if (baseline_instructions.contains(features[i]) || instructions().contains(features[i]))
+    {
+      return variants[i];
+    }
+  }
+
+  return variants[sizeof...(Funcs)];
+}
+}
@@ -0,0 +1,483 @@
+#include "cpu_specs.h"
+#include "cpu_intrinsics.h"
+#include "os.h"
+
+// x86 CPUs are described by cpu_specs.c instead
+#if defined(ISA_arm64)
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Globals
+struct cpu_specs cpu_specs =
+{
+  .cache_level_specs[L1].data_cache_size     = 4 * 1024,
+  .cache_level_specs[L1].attached_core_count = 1,
+  .cache_level_specs[L1].type                = CACHE_TYPE_DATA,
+  .cache_level_specs[L1].line_size           = 64,
+  .cache_line_size                           = 64,
+  .constructive_interference_size            = 64,
+  .destructive_interference_size             = 64,
+  .non_temporal_threshold                    = 0,
+  .threads_per_core                          = 1,
+  .core_count                                = 1,
+  .instructions                              = NEON,
+  .disabled_instructions                     = 0,
+  .preferred_vector_width                    = 128,
+  .sve_vector_length                         = 0,
+  .x86_64_level                              = 0,
+  .is_hybrid                                 = 0,
+  .has_invariant_tsc                         = 0,
+  .tsc_frequency                             = 0,
+  .hypervisor                                = CPU_HYPERVISOR_NONE,
+  .is_initialized                            = 0,
+  .core_type_specs[CPU_CORE_TYPE_PERFORMANCE] =
+  {
+    .core_count                                = 1,
+    .threads_per_core                          = 1,
+    .cache_level_specs[L1].data_cache_size     = 4 * 1024,
+    .cache_level_specs[L1].attached_core_count = 1,
+    .cache_level_specs[L1].type                = CACHE_TYPE_DATA,
+    .cache_level_specs[L1].line_size           = 64
+  }
+};
+
+struct cpu_identity cpu_identity =
+{
+  .family       = 0,
+  .model        = 0,
+  .stepping     = 0,
+  .manufacturer = "Unknown",
+  .name         = "Unknown"
+};
+
+// Cores reported by the OS. Linux' CPU sets cover at most 1024 logical processors, see os.c
+#define CPU_SPECS_MAX_OS_CORE_COUNT 1024
+static struct os_core cpu_specs_os_cores[CPU_SPECS_MAX_OS_CORE_COUNT];
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// OS features
+#if defined(_WIN32)
+// Declare the few Windows functions used below rather than including windows.h, see os.c
+extern __declspec(dllimport) s32 __stdcall IsProcessorFeaturePresent(u32 feature);
+extern __declspec(dllimport) s32 __stdcall RegGetValueA(void* key, const schar8* sub_key, const schar8* value, u32 flags, u32* type, void* data, u32* data_size);
+
+#pragma comment(lib, "advapi32.lib")
+
+// HKEY_LOCAL_MACHINE is a sign-extended 32-bit handle, and RRF_RT_* restrict the value's type
+#define OS_HKEY_LOCAL_MACHINE ((void*)(os_uptr)0xFFFFFFFF80000002)
+#define OS_RRF_RT_REG_SZ      0x02
+#define OS_RRF_RT_REG_QWORD   0x40
+
+// Registry key describing the first logical processor
+#define OS_CENTRAL_PROCESSOR_KEY "HARDWARE\\DESCRIPTION\\System\\CentralProcessor\\0"
+
+// PF_ARM_* values of IsProcessorFeaturePresent(), and the flags they report. The crypto feature
+// covers AES, PMULL, SHA1 and SHA2
+static const struct
+{
+  u32 feature;
+  u64 instructions;
+} cpu_specs_windows_features[] =
+{
+  {19, NEON},                         // PF_ARM_NEON_INSTRUCTIONS_AVAILABLE
+  {30, AES | PMULL | SHA1 | SHA2},    // PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE
+  {31, CRC32},                        // PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE
+  {34, LSE},                          // PF_ARM_V81_ATOMIC_INSTRUCTIONS_AVAILABLE
+  {43, DOTPROD},                      // PF_ARM_V82_DP_INSTRUCTIONS_AVAILABLE
+  {46, SVE},                          // PF_ARM_SVE_INSTRUCTIONS_AVAILABLE
+  {47, SVE2},                         // PF_ARM_SVE2_INSTRUCTIONS_AVAILABLE
+  {64, SHA3},                         // PF_ARM_SHA3_INSTRUCTIONS_AVAILABLE
+  {65, SHA512},                       // PF_ARM_SHA512_INSTRUCTIONS_AVAILABLE
+  {66, I8MM},                         // PF_ARM_V82_I8MM_INSTRUCTIONS_AVAILABLE
+  {67, FP16},                         // PF_ARM_V82_FP16_INSTRUCTIONS_AVAILABLE
+  {68, BF16}                          // PF_ARM_V86_BF16_INSTRUCTIONS_AVAILABLE
+};
+
+static u64 cpu_specs_get_os_instructions(void)
+{
+  u64 instructions = NEON;
+  for (s32 i = 0; i < (s32)(sizeof(cpu_specs_windows_features) / sizeof(cpu_specs_windows_features[0])); i++)
+  {
+    if (IsProcessorFeaturePresent(cpu_specs_windows_features[i].feature))
+    {
+      instructions |= cpu_specs_windows_features[i].instructions;
+    }
+  }
+
+  return instructions;
+}
+
+// Windows has no API reporting the SVE vector length, and MSVC can't emit RDVL, so it is left at
+// the architectural minimum
+static s32 cpu_specs_get_os_sve_vector_length(void)
+{
+  return 128;
+}
+
+// Windows caches MIDR_EL1 in the registry, as EL0 can't read it
+static u64 cpu_specs_get_os_midr(void)
+{
+  u64 midr      = 0;
+  u32 data_size = sizeof(midr);
+  if (RegGetValueA(OS_HKEY_LOCAL_MACHINE, (const schar8*)OS_CENTRAL_PROCESSOR_KEY, (const schar8*)"CP 4000", OS_RRF_RT_REG_QWORD, 0, &midr, &data_size) != 0)
+  {
+    return 0;
+  }
+
+  return midr;
+}
+
+// Copy the processor name of the registry to name. Returns 1 on success
+static s32 cpu_specs_get_os_name(schar8* name, u32 name_size)
+{
+  return RegGetValueA(OS_HKEY_LOCAL_MACHINE, (const schar8*)OS_CENTRAL_PROCESSOR_KEY, (const schar8*)"ProcessorNameString", OS_RRF_RT_REG_SZ, 0, name, &name_size) == 0;
+}
+
+// Windows doesn't allow EL0 to read CTR_EL0, so the line size is the one of the caches the OS
+// reports
+static s32 cpu_specs_get_os_cache_line_size(void)
+{
+  return 0;
+}
+#elif defined(__linux__)
+// Declare the few libc functions used below rather than including sys/auxv.h and sys/prctl.h, see
+// os.c
+extern unsigned long getauxval(unsigned long type);
+extern s32           prctl(s32 option, ...);
+
+#define OS_AT_HWCAP        16
+#define OS_AT_HWCAP2       26
+#define OS_PR_SVE_GET_VL   51
+#define OS_PR_SVE_VL_MASK  0xFFFF
+
+// HWCAP_CPUID tells that the kernel emulates EL0 reads of the ID registers, such as MIDR_EL1
+#define OS_HWCAP_CPUID     (1 << 11)
+
+// HWCAP_* and HWCAP2_* bits of getauxval(), and the flags they report
+static const struct
+{
+  s32 is_hwcap2;
+  s32 bit;
+  u64 instructions;
+} cpu_specs_linux_features[] =
+{
+  {0,  1, NEON},     // HWCAP_ASIMD
+  {0,  3, AES},      // HWCAP_AES
+  {0,  4, PMULL},    // HWCAP_PMULL
+  {0,  5, SHA1},     // HWCAP_SHA1
+  {0,  6, SHA2},     // HWCAP_SHA2
+  {0,  7, CRC32},    // HWCAP_CRC32
+  {0,  8, LSE},      // HWCAP_ATOMICS
+  {0, 10, FP16},     // HWCAP_ASIMDHP
+  {0, 17, SHA3},     // HWCAP_SHA3
+  {0, 20, DOTPROD},  // HWCAP_ASIMDDP
+  {0, 21, SHA512},   // HWCAP_SHA512
+  {0, 22, SVE},      // HWCAP_SVE
+  {1,  1, SVE2},     // HWCAP2_SVE2
+  {1, 13, I8MM},     // HWCAP2_I8MM
+  {1, 14, BF16}      // HWCAP2_BF16
+};
+
+static u64 cpu_specs_get_os_instructions(void)
+{
+  u64 hwcaps[2] = {getauxval(OS_AT_HWCAP), getauxval(OS_AT_HWCAP2)};
+  u64 instructions = NEON;
+  for (s32 i = 0; i < (s32)(sizeof(cpu_specs_linux_features) / sizeof(cpu_specs_linux_features[0])); i++)
+  {
+    if ((hwcaps[cpu_specs_linux_features[i].is_hwcap2] >> cpu_specs_linux_features[i].bit) & 0b1)
+    {
+      instructions |= cpu_specs_linux_features[i].instructions;
+    }
+  }
+
+  return instructions;
+}
+
+// The vector length may be lowered per thread, so this is the one of the calling thread
+static s32 cpu_specs_get_os_sve_vector_length(void)
+{
+  s32 vector_length = prctl(OS_PR_SVE_GET_VL);
+
+  return (vector_length > 0) ? (vector_length & OS_PR_SVE_VL_MASK) * 8 : 0;
+}
+
+static u64 cpu_specs_get_os_midr(void)
+{
+  return (getauxval(OS_AT_HWCAP) & OS_HWCAP_CPUID) ? (u64)_ReadStatusReg(ARM64_MIDR_EL1) : 0;
+}
+
+// Linux doesn't name ARM CPUs, so names come from cpu_specs_arm64_parts
+static s32 cpu_specs_get_os_name(schar8* name, u32 name_size)
+{
+  (void)name;
+  (void)name_size;
+
+  return 0;
+}
+
+// Linux allows EL0 to read CTR_EL0, whose DminLine field is the log2 of the smallest data cache
+// line size in 4-byte words
+static s32 cpu_specs_get_os_cache_line_size(void)
+{
+  u64 ctr = (u64)_ReadStatusReg(ARM64_CTR_EL0);
+
+  return 4 << ((ctr >> 16) & 0xF);
+}
+#else
+#  error Unsupported operating system
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Caches and cores
+// Fill the cache level specs of a core type from the caches of one of its logical processors, on
+// a core of threads_per_core logical processors
+static void cpu_specs_get_os_caches(s32 os_cpu_index, s32 threads_per_core, struct cpu_core_type_specs* core_type_specs)
+{
+  struct os_cache caches[OS_MAX_CACHE_COUNT];
+  s32 cache_count = os_get_caches(os_cpu_index, caches, OS_MAX_CACHE_COUNT);
+  for (s32 i = 0; i < cache_count; i++)
+  {
+    const struct os_cache* cache = &caches[i];
+    s32 cache_idx = cache->level - 1;
+    if ((cache_idx < 0) || (cache_idx >= CACHE_LEVEL_COUNT))
+    {
+      continue;
+    }
+
+    struct cpu_cache_level_specs* cache_level_spec = (cache->type == CACHE_TYPE_INSTRUCTION)
+      ? &core_type_specs->instruction_cache_level_specs[cache_idx]
+      : &core_type_specs->cache_level_specs[cache_idx];
+
+    // The OS doesn't report inclusiveness nor indexing. It counts the logical processors sharing a
+    // cache, while attached_core_count counts cores, as on x86
+    s32 cache_line_count    = cache->line_size ? (cache->size / cache->line_size) : 0;
+    s32 attached_core_count = cache->shared_logical_processor_count / threads_per_core;
+    cache_level_spec->data_cache_size           = cache->size;
+    cache_level_spec->attached_core_count       = (attached_core_count > 0) ? attached_core_count : 1;
+    cache_level_spec->max_attached_thread_count = cache->shared_logical_processor_count;
+    cache_level_spec->type                      = cache->type;
+    cache_level_spec->line_size                 = cache->line_size;
+    cache_level_spec->ways                      = cache->ways;
+    cache_level_spec->partitions                = 1;
+    cache_level_spec->sets                      = cache->ways ? (cache_line_count / cache->ways) : 0;
+    cache_level_spec->is_inclusive              = 0;
+    cache_level_spec->has_complex_indexing      = 0;
+  }
+}
+
+// Group cores by performance class. big.LITTLE CPUs may have more than two classes, such as
+// Cortex-X, Cortex-A7xx and Cortex-A5xx cores: only the lowest one is reported as efficient
+static void cpu_specs_get_cores_info(struct cpu_specs* specs)
+{
+  s32 core_count = os_get_cores(cpu_specs_os_cores, CPU_SPECS_MAX_OS_CORE_COUNT);
+  if (core_count == 0)
+  {
+    return;
+  }
+
+  s32 min_efficiency_class = cpu_specs_os_cores[0].efficiency_class;
+  s32 max_efficiency_class = cpu_specs_os_cores[0].efficiency_class;
+  for (s32 i = 1; i < core_count; i++)
+  {
+    s32 efficiency_class = cpu_specs_os_cores[i].efficiency_class;
+    min_efficiency_class = (efficiency_class < min_efficiency_class) ? efficiency_class : min_efficiency_class;
+    max_efficiency_class = (efficiency_class > max_efficiency_class) ? efficiency_class : max_efficiency_class;
+  }
+  specs->is_hybrid  = (min_efficiency_class != max_efficiency_class);
+  specs->core_count = core_count;
+
+  for (s32 core_type = 0; core_type < CPU_CORE_TYPE_COUNT; core_type++)
+  {
+    struct cpu_core_type_specs* core_type_specs = &specs->core_type_specs[core_type];
+    core_type_specs->core_count       = 0;
+    core_type_specs->threads_per_core = 0;
+    for (s32 cache_idx = 0; cache_idx < CACHE_LEVEL_COUNT; cache_idx++)
+    {
+      core_type_specs->cache_level_specs[cache_idx]             = (struct cpu_cache_level_specs){0};
+      core_type_specs->instruction_cache_level_specs[cache_idx] = (struct cpu_cache_level_specs){0};
+    }
+  }
+
+  for (s32 i = 0; i < core_count; i++)
+  {
+    const struct os_core* core = &cpu_specs_os_cores[i];
+    s32 is_efficient = specs->is_hybrid && (core->efficiency_class == min_efficiency_class);
+    struct cpu_core_type_specs* core_type_specs = &specs->core_type_specs[is_efficient ? CPU_CORE_TYPE_EFFICIENT : CPU_CORE_TYPE_PERFORMANCE];
+
+    // Caches are read from the first core of each type
+    if (core_type_specs->core_count == 0)
+    {
+      cpu_specs_get_os_caches(core->first_os_cpu_index, (core->logical_processor_count > 0) ? core->logical_processor_count : 1, core_type_specs);
+    }
+    core_type_specs->core_count++;
+    core_type_specs->threads_per_core = (core->logical_processor_count > core_type_specs->threads_per_core) ? core->logical_processor_count : core_type_specs->threads_per_core;
+  }
+
+  // The top-level specs describe the performance cores, as on x86 hybrid CPUs
+  const struct cpu_core_type_specs* performance_specs = &specs->core_type_specs[CPU_CORE_TYPE_PERFORMANCE];
+  specs->threads_per_core = performance_specs->threads_per_core;
+  for (s32 cache_idx = 0; cache_idx < CACHE_LEVEL_COUNT; cache_idx++)
+  {
+    specs->cache_level_specs[cache_idx]             = performance_specs->cache_level_specs[cache_idx];
+    specs->instruction_cache_level_specs[cache_idx] = performance_specs->instruction_cache_level_specs[cache_idx];
+  }
+
+  s32 cache_line_size = specs->cache_level_specs[L1].line_size;
+  if (cache_line_size == 0)
+  {
+    cache_line_size = cpu_specs_get_os_cache_line_size();
+  }
+  specs->cache_line_size = (cache_line_size != 0) ? cache_line_size : specs->cache_line_size;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// CPU specs
+void cpu_specs_init(void)
+{
+  cpu_specs.instructions          = cpu_specs_get_os_instructions();
+  cpu_specs.disabled_instructions = 0;
+  cpu_specs.sve_vector_length     = (cpu_specs.instructions & SVE) ? cpu_specs_get_os_sve_vector_length() : 0;
+
+  // SVE code runs at the vector length, which is 128 bits on most SVE CPUs but 256 bits on
+  // Neoverse V1 and 512 bits on A64FX
+  cpu_specs.preferred_vector_width = (cpu_specs.sve_vector_length > 128) ? cpu_specs.sve_vector_length : 128;
+
+  cpu_specs_get_cores_info(&cpu_specs);
+
+  // ARM64 prefetchers don't pair lines, but Apple's CPUs have 128-byte lines
+  cpu_specs.constructive_interference_size = cpu_specs.cache_line_size;
+  cpu_specs.destructive_interference_size  = cpu_specs.cache_line_size;
+
+  // As on x86 without ERMS, see cpu_specs.c: three quarters of one thread's share of the last
+  // level cache, and at least 16 KiB
+  const struct cpu_cache_level_specs* shared_cache = &cpu_specs.cache_level_specs[(cpu_specs.cache_level_specs[L3].data_cache_size != 0) ? L3 : L2];
+  cpu_specs.non_temporal_threshold = 0;
+  if (shared_cache->data_cache_size != 0)
+  {
+    s32 threads_per_core     = (cpu_specs.threads_per_core > 0) ? cpu_specs.threads_per_core : 1;
+    s32 sharing_thread_count = (shared_cache->attached_core_count > 0) ? shared_cache->attached_core_count * threads_per_core : threads_per_core;
+    s32 threshold = (s32)((s64)shared_cache->data_cache_size / sharing_thread_count * 3 / 4);
+    cpu_specs.non_temporal_threshold = (threshold > 0x4040) ? threshold : 0x4040;
+  }
+
+  // The generic timer's virtual count (CNTVCT_EL0) runs at a constant rate in all power states,
+  // which CNTFRQ_EL0 reports
+  cpu_specs.has_invariant_tsc = 1;
+  cpu_specs.tsc_frequency     = (u64)_ReadStatusReg(ARM64_CNTFRQ_EL0) & 0xFFFFFFFF;
+
+  cpu_specs.is_initialized = 1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// CPU identity
+// Implementers of MIDR_EL1, as assigned by ARM
+static const struct
+{
+  s32           implementer;
+  const schar8* name;
+} cpu_specs_arm64_implementers[] =
+{
+  {0x41, (const schar8*)"ARM"},
+  {0x42, (const schar8*)"Broadcom"},
+  {0x43, (const schar8*)"Cavium"},
+  {0x46, (const schar8*)"Fujitsu"},
+  {0x48, (const schar8*)"HiSilicon"},
+  {0x4E, (const schar8*)"NVIDIA"},
+  {0x51, (const schar8*)"Qualcomm"},
+  {0x61, (const schar8*)"Apple"},
+  {0x6D, (const schar8*)"Microsoft"},
+  {0xC0, (const schar8*)"Ampere"}
+};
+
+// Names of common cores, by implementer and part number
+static const struct
+{
+  s32           implementer;
+  s32           part;
+  const schar8* name;
+} cpu_specs_arm64_parts[] =
+{
+  {0x41, 0xD03, (const schar8*)"ARM Cortex-A53"},
+  {0x41, 0xD05, (const schar8*)"ARM Cortex-A55"},
+  {0x41, 0xD07, (const schar8*)"ARM Cortex-A57"},
+  {0x41, 0xD08, (const schar8*)"ARM Cortex-A72"},
+  {0x41, 0xD0B, (const schar8*)"ARM Cortex-A76"},
+  {0x41, 0xD0C, (const schar8*)"ARM Neoverse N1"},
+  {0x41, 0xD0D, (const schar8*)"ARM Cortex-A77"},
+  {0x41, 0xD40, (const schar8*)"ARM Neoverse V1"},
+  {0x41, 0xD41, (const schar8*)"ARM Cortex-A78"},
+  {0x41, 0xD44, (const schar8*)"ARM Cortex-X1"},
+  {0x41, 0xD46, (const schar8*)"ARM Cortex-A510"},
+  {0x41, 0xD47, (const schar8*)"ARM Cortex-A710"},
+  {0x41, 0xD48, (const schar8*)"ARM Cortex-X2"},
+  {0x41, 0xD49, (const schar8*)"ARM Neoverse N2"},
+  {0x41, 0xD4A, (const schar8*)"ARM Neoverse E1"},
+  {0x41, 0xD4D, (const schar8*)"ARM Cortex-A715"},
+  {0x41, 0xD4E, (const schar8*)"ARM Cortex-X3"},
+  {0x41, 0xD4F, (const schar8*)"ARM Neoverse V2"},
+  {0x41, 0xD80, (const schar8*)"ARM Cortex-A520"},
+  {0x41, 0xD81, (const schar8*)"ARM Cortex-A720"},
+  {0x41, 0xD82, (const schar8*)"ARM Cortex-X4"},
+  {0x41, 0xD84, (const schar8*)"ARM Neoverse V3"},
+  {0x41, 0xD8E, (const schar8*)"ARM Neoverse N3"},
+  {0x46, 0x001, (const schar8*)"Fujitsu A64FX"},
+  {0x48, 0xD01, (const schar8*)"HiSilicon TaiShan v110"},
+  {0x4E, 0x004, (const schar8*)"NVIDIA Carmel"},
+  {0x51, 0x001, (const schar8*)"Qualcomm Oryon"},
+  {0xC0, 0xAC3, (const schar8*)"AmpereOne"},
+  {0xC0, 0xAC4, (const schar8*)"AmpereOne AC04"}
+};
+
+// Copy a null-terminated string to a buffer of size bytes, truncating it if needed
+static void cpu_identity_copy_string(schar8* buffer, s32 size, const schar8* string)
+{
+  s32 length = 0;
+  while (*string && (length < size - 1))
+  {
+    buffer[length++] = *string++;
+  }
+  buffer[length] = 0;
+}
+
+void cpu_identity_init(void)
+{
+  // MIDR_EL1 describes the core the calling thread runs on, which may be either core type on
+  // big.LITTLE CPUs
+  u64 midr = cpu_specs_get_os_midr();
+  if (midr == 0)
+  {
+    return;
+  }
+
+  cpu_identity.family   = (s32)((midr >> 24) & 0xFF);
+  cpu_identity.model    = (s32)((midr >> 4) & 0xFFF);
+  cpu_identity.stepping = (s32)((((midr >> 20) & 0xF) << 4) | (midr & 0xF));
+
+  // manufacturer isn't null-terminated, so it is padded with spaces like CPUID's vendor strings
+  const schar8* manufacturer = (const schar8*)"Unknown";
+  for (s32 i = 0; i < (s32)(sizeof(cpu_specs_arm64_implementers) / sizeof(cpu_specs_arm64_implementers[0])); i++)
+  {
+    manufacturer = (cpu_specs_arm64_implementers[i].implementer == cpu_identity.family) ? cpu_specs_arm64_implementers[i].name : manufacturer;
+  }
+  for (s32 i = 0; i < (s32)sizeof(cpu_identity.manufacturer); i++)
+  {
+    cpu_identity.manufacturer[i] = *manufacturer ? *manufacturer++ : ' ';
+  }
+
+  if (cpu_specs_get_os_name(cpu_identity.name, sizeof(cpu_identity.name)))
+  {
+    return;
+  }
+
+  for (s32 i = 0; i < (s32)(sizeof(cpu_specs_arm64_parts) / sizeof(cpu_specs_arm64_parts[0])); i++)
+  {
+    if ((cpu_specs_arm64_parts[i].implementer == cpu_identity.family) && (cpu_specs_arm64_parts[i].part == cpu_identity.model))
+    {
+      cpu_identity_copy_string(cpu_identity.name, sizeof(cpu_identity.name), cpu_specs_arm64_parts[i].name);
+      break;
+    }
+  }
+}
+#endif
@@ -0,0 +1,371 @@
+#include "cpu_tlb.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Globals
+struct cpu_tlb_specs cpu_tlb_specs =
+{
+  .has_1g_pages          = 0,
+  .has_pcid              = 0,
+  .has_invpcid           = 0,
+  .physical_address_bits = 32,
+  .linear_address_bits   = 32
+};
+
+static const u64 cpu_tlb_page_sizes[CPU_PAGE_SIZE_COUNT] = {(u64)4 << 10, (u64)2 << 20, (u64)1 << 30};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Helpers
+static void cpu_tlb_reset(void)
+{
+  struct cpu_tlb_specs empty_specs = {0};
+  cpu_tlb_specs = empty_specs;
+  cpu_tlb_specs.physical_address_bits = 32;
+  cpu_tlb_specs.linear_address_bits   = 32;
+}
+
+#if !defined(ISA_arm64)
+// TLB types of function 0x18, also used by the descriptors of function 0x2. Load-only and
+// store-only TLBs are counted as data TLBs
+#define CPU_TLB_TYPE_DATA        1
+#define CPU_TLB_TYPE_INSTRUCTION 2
+#define CPU_TLB_TYPE_UNIFIED     3
+#define CPU_TLB_TYPE_LOAD_ONLY   4
+#define CPU_TLB_TYPE_STORE_ONLY  5
+
+// Page size flags, as bits of enum cpu_page_size's values
+#define CPU_TLB_4K (1 << CPU_PAGE_SIZE_4K)
+#define CPU_TLB_2M (1 << CPU_PAGE_SIZE_2M)
+#define CPU_TLB_1G (1 << CPU_PAGE_SIZE_1G)
+
+// Record a TLB holding the pages of page_flags. When several TLBs of the same level and type hold
+// the same page size, such as Silvermont's micro TLB and DTLB, the largest one is kept
+static void cpu_tlb_add(s32 type, s32 level, s32 page_flags, s32 entries, s32 ways)
+{
+  if ((level < CPU_TLB_L1) || (level >= CPU_TLB_LEVEL_COUNT) || (entries <= 0))
+  {
+    return;
+  }
+
+  struct cpu_tlb_level_specs* level_specs[2] = {0, 0};
+  if ((type == CPU_TLB_TYPE_DATA) || (type == CPU_TLB_TYPE_LOAD_ONLY) || (type == CPU_TLB_TYPE_STORE_ONLY) || (type == CPU_TLB_TYPE_UNIFIED))
+  {
+    level_specs[0] = &cpu_tlb_specs.data_tlb_level_specs[level];
+  }
+  if ((type == CPU_TLB_TYPE_INSTRUCTION) || (type == CPU_TLB_TYPE_UNIFIED))
+  {
+    level_specs[1] = &cpu_tlb_specs.instruction_tlb_level_specs[level];
+  }
+
+  for (s32 i = 0; i < 2; i++)
+  {
+    for (s32 page_size = 0; level_specs[i] && (page_size < CPU_PAGE_SIZE_COUNT); page_size++)
+    {
+      if (((page_flags >> page_size) & 0b1) && (entries > level_specs[i]->entries[page_size]))
+      {
+        level_specs[i]->entries[page_size] = entries;
+        level_specs[i]->ways[page_size]    = ways;
+      }
+    }
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Intel
+// TLB descriptors of function 0x2, from the Intel SDM. Descriptors 0x63 and 0xC3 describe two TLBs
+// each. Fully associative TLBs have as many ways as entries, and 0 ways means unreported
+static const struct
+{
+  u8  descriptor;
+  u8  type;
+  u8  level;
+  u8  page_flags;
+  u16 entries;
+  u16 ways;
+} cpu_tlb_descriptors[] =
+{
+  {0x01, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_4K,                32,    4},
+  {0x02, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_2M,                 2,    2},
+  {0x03, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K,                64,    4},
+  {0x04, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_2M,                 8,    4},
+  {0x05, CPU_TLB_TYPE_DATA,        CPU_TLB_L2, CPU_TLB_2M,                32,    4},
+  {0x0B, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_2M,                 4,    4},
+  {0x4F, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_4K,                32,    0},
+  {0x50, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_4K | CPU_TLB_2M,   64,    0},
+  {0x51, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_4K | CPU_TLB_2M,  128,    0},
+  {0x52, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_4K | CPU_TLB_2M,  256,    0},
+  {0x55, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_2M,                 7,    7},
+  {0x56, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_2M,                16,    4},
+  {0x57, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K,                16,    4},
+  {0x59, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K,                16,   16},
+  {0x5A, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_2M,                32,    4},
+  {0x5B, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K | CPU_TLB_2M,   64,    0},
+  {0x5C, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K | CPU_TLB_2M,  128,    0},
+  {0x5D, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K | CPU_TLB_2M,  256,    0},
+  {0x61, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_4K,                48,   48},
+  {0x63, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_2M,                32,    4},
+  {0x63, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_1G,                 4,    4},
+  {0x64, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K,               512,    4},
+  {0x6A, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K,                64,    8},
+  {0x6B, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K,               256,    8},
+  {0x6C, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_2M,               128,    8},
+  {0x6D, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_1G,                16,   16},
+  {0x76, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_2M,                 8,    8},
+  {0xA0, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K,                32,   32},
+  {0xB0, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_4K,               128,    4},
+  {0xB1, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_2M,                 8,    4},
+  {0xB2, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_4K,                64,    4},
+  {0xB3, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K,               128,    4},
+  {0xB4, CPU_TLB_TYPE_DATA,        CPU_TLB_L2, CPU_TLB_4K,               256,    4},
+  {0xB5, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_4K,                64,    8},
+  {0xB6, CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, CPU_TLB_4K,               128,    8},
+  {0xBA, CPU_TLB_TYPE_DATA,        CPU_TLB_L2, CPU_TLB_4K,                64,    4},
+  {0xC0, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K | CPU_TLB_2M,    8,    4},
+  {0xC1, CPU_TLB_TYPE_UNIFIED,     CPU_TLB_L2, CPU_TLB_4K | CPU_TLB_2M, 1024,    8},
+  {0xC2, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_4K | CPU_TLB_2M,   16,    4},
+  {0xC3, CPU_TLB_TYPE_UNIFIED,     CPU_TLB_L2, CPU_TLB_4K | CPU_TLB_2M, 1536,    6},
+  {0xC3, CPU_TLB_TYPE_UNIFIED,     CPU_TLB_L2, CPU_TLB_1G,                16,    4},
+  {0xC4, CPU_TLB_TYPE_DATA,        CPU_TLB_L1, CPU_TLB_2M,                32,    4},
+  {0xCA, CPU_TLB_TYPE_UNIFIED,     CPU_TLB_L2, CPU_TLB_4K,               512,    4}
+};
+
+// Decode the one-byte descriptors of function 0x2. Each register holds 4 descriptors unless its
+// bit 31 is set, and the low byte of EAX is the count of times to execute CPUID, always 1 since
+// the Pentium 4
+static void cpu_tlb_intel_get_descriptors(const struct cpuid_snapshot* snapshot)
+{
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x2, 0x0);
+  cpuid_out[EAX] &= ~0xFF;
+
+  for (s32 reg = EAX; reg <= EDX; reg++)
+  {
+    if ((u32)cpuid_out[reg] >> 31)
+    {
+      continue;
+    }
+
+    for (s32 byte_idx = 0; byte_idx < 4; byte_idx++)
+    {
+      u8 descriptor = (u8)((u32)cpuid_out[reg] >> (byte_idx * 8));
+      for (s32 i = 0; (descriptor != 0) && (i < (s32)(sizeof(cpu_tlb_descriptors) / sizeof(cpu_tlb_descriptors[0]))); i++)
+      {
+        if (cpu_tlb_descriptors[i].descriptor == descriptor)
+        {
+          cpu_tlb_add(cpu_tlb_descriptors[i].type, cpu_tlb_descriptors[i].level, cpu_tlb_descriptors[i].page_flags, cpu_tlb_descriptors[i].entries, cpu_tlb_descriptors[i].ways);
+        }
+      }
+    }
+  }
+}
+
+// Decode the deterministic address translation parameters of function 0x18. Returns the count of
+// TLBs found, which is 0 on CPUs only listing them in function 0x2
+static s32 cpu_tlb_intel_get_deterministic_tlbs(const struct cpuid_snapshot* snapshot)
+{
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x18, 0x0);
+  u32 max_subfunc = (u32)cpuid_out[EAX];
+
+  // At most CPUID_MAX_TLB_SUBFUNC_COUNT subfunctions are captured, see cpu_specs.h
+  s32 tlb_count = 0;
+  for (u32 subfunc = 0x0; (subfunc <= max_subfunc) && (subfunc < CPUID_MAX_TLB_SUBFUNC_COUNT); subfunc++)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x18, subfunc);
+    s32 type = cpuid_out[EDX] & 0x1F;
+    if (type == 0)
+    {
+      continue;
+    }
+
+    // Page sizes are 4K, 2M, 4M and 1G from bit 0 to 3, 4M pages being held by 2M entries
+    s32 level      = ((cpuid_out[EDX] >> 5) & 0b111) - 1;
+    s32 ways       = ((u32)cpuid_out[EBX] >> 16) & 0xFFFF;
+    s32 entries    = ways * cpuid_out[ECX];
+    s32 page_flags = 0;
+    page_flags |= (cpuid_out[EBX] & 0b0001) ? CPU_TLB_4K : 0;
+    page_flags |= (cpuid_out[EBX] & 0b0110) ? CPU_TLB_2M : 0;
+    page_flags |= (cpuid_out[EBX] & 0b1000) ? CPU_TLB_1G : 0;
+    cpu_tlb_add(type, (level < CPU_TLB_LEVEL_COUNT) ? level : CPU_TLB_LEVEL_COUNT - 1, page_flags, entries, ways);
+    tlb_count++;
+  }
+
+  return tlb_count;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// AMD
+// Decode a register of functions 0x80000006 and 0x80000019: a data TLB in the upper 16 bits and an
+// instruction TLB in the lower ones, each with a 4-bit associativity and a 12-bit entry count. A
+// null associativity means that there is no such TLB
+static void cpu_tlb_amd_add_encoded(s32 reg, s32 level, s32 page_flags)
+{
+  s32 data_entries        = (reg >> 16) & 0xFFF;
+  s32 data_ways           = cpuid_amd_decode_associativity(((u32)reg >> 28) & 0xF, data_entries);
+  s32 instruction_entries = reg & 0xFFF;
+  s32 instruction_ways    = cpuid_amd_decode_associativity((reg >> 12) & 0xF, instruction_entries);
+  if (data_ways)
+  {
+    cpu_tlb_add(CPU_TLB_TYPE_DATA, level, page_flags, data_entries, data_ways);
+  }
+  if (instruction_ways)
+  {
+    cpu_tlb_add(CPU_TLB_TYPE_INSTRUCTION, level, page_flags, instruction_entries, instruction_ways);
+  }
+}
+
+static void cpu_tlb_amd_get_tlbs(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx)
+{
+  s32 cpuid_out[4];
+  if (cpuid_ctx.max_extended_func >= 0x80000005)
+  {
+    // L1 TLBs have plain 8-bit ways counts, where 0xFF means fully associative. EAX describes the
+    // 2M/4M TLBs, and EBX the 4K TLBs
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000005, 0x0);
+    for (s32 reg = EAX; reg <= EBX; reg++)
+    {
+      s32 page_flags          = (reg == EAX) ? CPU_TLB_2M : CPU_TLB_4K;
+      s32 data_entries        = (cpuid_out[reg] >> 16) & 0xFF;
+      s32 data_ways           = ((u32)cpuid_out[reg] >> 24) & 0xFF;
+      s32 instruction_entries = cpuid_out[reg] & 0xFF;
+      s32 instruction_ways    = (cpuid_out[reg] >> 8) & 0xFF;
+      cpu_tlb_add(CPU_TLB_TYPE_DATA,        CPU_TLB_L1, page_flags, data_entries,        (data_ways == 0xFF) ? data_entries : data_ways);
+      cpu_tlb_add(CPU_TLB_TYPE_INSTRUCTION, CPU_TLB_L1, page_flags, instruction_entries, (instruction_ways == 0xFF) ? instruction_entries : instruction_ways);
+    }
+  }
+
+  if (cpuid_ctx.max_extended_func >= 0x80000006)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000006, 0x0);
+    cpu_tlb_amd_add_encoded(cpuid_out[EAX], CPU_TLB_L2, CPU_TLB_2M);
+    cpu_tlb_amd_add_encoded(cpuid_out[EBX], CPU_TLB_L2, CPU_TLB_4K);
+  }
+
+  // 1G TLBs, since family 0x10
+  if (cpuid_ctx.max_extended_func >= 0x80000019)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000019, 0x0);
+    cpu_tlb_amd_add_encoded(cpuid_out[EAX], CPU_TLB_L1, CPU_TLB_1G);
+    cpu_tlb_amd_add_encoded(cpuid_out[EBX], CPU_TLB_L2, CPU_TLB_1G);
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Initialization
+void cpu_tlb_init_from_snapshot(const struct cpuid_snapshot* snapshot)
+{
+  cpu_tlb_reset();
+
+  // An empty snapshot means that CPUID was unavailable. See cpuid_is_available()
+  if (snapshot->leaf_count == 0)
+  {
+    return;
+  }
+
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x0, 0x0);
+  struct cpuid_ctx cpuid_ctx = {.max_standard_func = (u32)cpuid_out[EAX]};
+  s32 manufacturer_ecx = cpuid_out[ECX];
+
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x80000000, 0x0);
+  cpuid_ctx.max_extended_func = (u32)cpuid_out[EAX];
+
+  // Paging features. Without function 0x80000008, physical addresses are 36 bits wide with PAE
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
+  cpu_tlb_specs.has_pcid              = (cpuid_out[ECX] >> 17) & 0b1;
+  cpu_tlb_specs.physical_address_bits = ((cpuid_out[EDX] >> 6) & 0b1) ? 36 : 32;
+  if (cpuid_ctx.max_standard_func >= 0x7)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x7, 0x0);
+    cpu_tlb_specs.has_invpcid = (cpuid_out[EBX] >> 10) & 0b1;
+  }
+  if (cpuid_ctx.max_extended_func >= 0x80000001)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000001, 0x0);
+    cpu_tlb_specs.has_1g_pages = (cpuid_out[EDX] >> 26) & 0b1;
+  }
+  if (cpuid_ctx.max_extended_func >= 0x80000008)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000008, 0x0);
+    cpu_tlb_specs.physical_address_bits = cpuid_out[EAX] & 0xFF;
+    cpu_tlb_specs.linear_address_bits   = (cpuid_out[EAX] >> 8) & 0xFF;
+  }
+
+  // Same split as cpu_specs.c's cpu_is_amd_compatible()
+  if ((manufacturer_ecx == CPU_MANUFACTURER_AMD) || (manufacturer_ecx == CPU_MANUFACTURER_HYGON))
+  {
+    cpu_tlb_amd_get_tlbs(snapshot, cpuid_ctx);
+  }
+  else
+  {
+    if ((cpuid_ctx.max_standard_func < 0x18) || (cpu_tlb_intel_get_deterministic_tlbs(snapshot) == 0))
+    {
+      if (cpuid_ctx.max_standard_func >= 0x2)
+      {
+        cpu_tlb_intel_get_descriptors(snapshot);
+      }
+    }
+  }
+}
+#endif
+
+void cpu_tlb_init(void)
+{
+#if defined(ISA_arm64)
+  cpu_tlb_reset();
+#else
+  struct cpuid_snapshot snapshot;
+  cpuid_snapshot_init(&snapshot);
+  cpu_tlb_init_from_snapshot(&snapshot);
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Page size selection
+u64 cpu_tlb_get_reach(s32 level, s32 page_size)
+{
+  if ((level < CPU_TLB_L1) || (level >= CPU_TLB_LEVEL_COUNT) || (page_size < 0) || (page_size >= CPU_PAGE_SIZE_COUNT))
+  {
+    return 0;
+  }
+
+  return (u64)cpu_tlb_specs.data_tlb_level_specs[level].entries[page_size] * cpu_tlb_page_sizes[page_size];
+}
+
+s32 cpu_tlb_choose_page_size(u64 working_set_size)
+{
+  s32 best_page_size = CPU_PAGE_SIZE_4K;
+  u64 best_reach     = 0;
+  for (s32 page_size = 0; page_size < CPU_PAGE_SIZE_COUNT; page_size++)
+  {
+    if ((page_size == CPU_PAGE_SIZE_1G) && !cpu_tlb_specs.has_1g_pages)
+    {
+      continue;
+    }
+
+    // The last level holding this page size, as some CPUs only hold 1G pages in their L1 TLB
+    u64 reach = 0;
+    for (s32 level = 0; level < CPU_TLB_LEVEL_COUNT; level++)
+    {
+      u64 level_reach = cpu_tlb_get_reach(level, page_size);
+      reach = (level_reach > reach) ? level_reach : reach;
+    }
+
+    if ((reach != 0) && (reach >= working_set_size))
+    {
+      return page_size;
+    }
+
+    if (reach > best_reach)
+    {
+      best_page_size = page_size;
+      best_reach     = reach;
+    }
+  }
+
+  return best_page_size;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "cpu_specs.h"
+
+// Translation lookaside buffers (TLBs) and paging features, to pick the page size of large
+// allocations. A working set larger than the TLB reach (entries * page size) of the last level
+// TLB causes page walks on most accesses, which large pages avoid
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// enums and structs
+// Page sizes of x86-64. 2 MiB entries also hold the 4 MiB pages of 32-bit paging without PAE
+enum cpu_page_size
+{
+  CPU_PAGE_SIZE_4K = 0,
+  CPU_PAGE_SIZE_2M,
+  CPU_PAGE_SIZE_1G,
+  CPU_PAGE_SIZE_COUNT
+};
+
+// TLB levels. Intel's second level TLB (STLB) and AMD's L2 TLBs are the last level ones
+enum cpu_tlb_level
+{
+  CPU_TLB_L1 = 0,
+  CPU_TLB_L2,
+  CPU_TLB_LEVEL_COUNT
+};
+
+struct cpu_tlb_level_specs
+{
+  // Count of entries holding pages of each size, accessed with enum cpu_page_size's values, or 0
+  // if this TLB doesn't hold them. Entries shared by several page sizes are counted for each
+  s32 entries[CPU_PAGE_SIZE_COUNT];
+
+  // Associativity as the count of ways, for each page size. Fully associative TLBs have as many
+  // ways as entries. This is 0 when unreported
+  s32 ways[CPU_PAGE_SIZE_COUNT];
+};
+
+struct cpu_tlb_specs
+{
+  // TLB specs accessed with enum cpu_tlb_level's values. TLBs shared by instructions and data,
+  // such as Intel's STLB, are reported in both arrays
+  struct cpu_tlb_level_specs data_tlb_level_specs[CPU_TLB_LEVEL_COUNT];
+  struct cpu_tlb_level_specs instruction_tlb_level_specs[CPU_TLB_LEVEL_COUNT];
+
+  // Whether the CPU supports 1 GiB pages (1) or not (0)
+  s32 has_1g_pages;
+
+  // Whether the CPU supports process-context identifiers (PCID), which spare TLB flushes on
+  // address space switches, and the INVPCID instruction (1) or not (0). Kernels use them to keep
+  // TLB entries across system calls with page table isolation
+  s32 has_pcid;
+  s32 has_invpcid;
+
+  // Widths of physical and linear (virtual) addresses in bits, such as 46 and 48. Linear
+  // addresses are 57 bits wide on CPUs with 5-level paging
+  s32 physical_address_bits;
+  s32 linear_address_bits;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Implementation
+extern struct cpu_tlb_specs cpu_tlb_specs;
+
+#if !defined(ISA_arm64)
+// Initialize or refresh the global cpu_tlb_specs struct from a snapshot, see cpuid_snapshot_init().
+// TLBs are read from functions 0x2 and 0x18 on Intel, and 0x80000005, 0x80000006 and 0x80000019
+// on AMD. Function 0x18 supersedes function 0x2 when available, as function 0x2 stops listing
+// TLBs on recent CPUs
+void cpu_tlb_init_from_snapshot(const struct cpuid_snapshot* snapshot);
+#endif
+
+// Initialize or refresh the global cpu_tlb_specs struct. On ARM64, and when CPUID is unavailable,
+// TLBs are unknown, and address widths are those of 32-bit x86 CPUs without PAE
+void cpu_tlb_init(void);
+
+// Return the reach in bytes of the data TLB of a level for a page size: the memory its entries
+// map without page walks. This is 0 if unknown
+u64 cpu_tlb_get_reach(s32 level, s32 page_size);
+
+// Return the smallest page size, as an enum cpu_page_size value, whose last level data TLB reach
+// covers working_set_size bytes, among the ones the CPU supports. If none does, this is the one
+// with the largest reach. This is CPU_PAGE_SIZE_4K if TLBs are unknown. cpu_tlb_init() must be
+// called beforehand. Whether the OS can provide large pages is up to the allocator
+s32 cpu_tlb_choose_page_size(u64 working_set_size);
@@ -0,0 +1,641 @@
+#include "cpu_topology.h"
+#include "cpu_intrinsics.h"
+#include "os.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Globals
+struct cpu_topology cpu_topology;
+
+#if !defined(ISA_arm64)
+// Scratch arrays used to turn raw IDs into dense IDs. AMD node IDs can't be derived from APIC IDs,
+// so they are read on each logical processor and kept in cpu_topology_node_ids
+static u32 cpu_topology_raw_ids[CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS];
+static s32 cpu_topology_dense_ids[CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS];
+static u32 cpu_topology_node_ids[CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS];
+
+// OS indices of logical processors and their NUMA node numbers, as exchanged with os.h
+static s32 cpu_topology_os_cpu_indices[CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS];
+static s32 cpu_topology_numa_node_numbers[CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS];
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Helpers
+static s32 ceil_log2(u32 value)
+{
+  s32 shift = 0;
+  while ((shift < 32) && (((u64)1 << shift) < value))
+  {
+    shift++;
+  }
+
+  return shift;
+}
+
+// Turn raw IDs into dense IDs starting at 0, in order of first appearance. Returns the count of
+// distinct IDs
+static s32 cpu_topology_densify(const u32* raw_ids, s32* dense_ids, s32 count)
+{
+  s32 id_count = 0;
+  for (s32 i = 0; i < count; i++)
+  {
+    s32 first_match = i;
+    for (s32 j = 0; j < i; j++)
+    {
+      if (raw_ids[j] == raw_ids[i])
+      {
+        first_match = j;
+        break;
+      }
+    }
+
+    dense_ids[i] = (first_match == i) ? id_count++ : dense_ids[first_match];
+  }
+
+  return id_count;
+}
+
+// Fill cpu_topology_raw_ids with the (apic_id >> shift) of each logical processor
+static void cpu_topology_get_raw_ids(s32 shift)
+{
+  for (s32 i = 0; i < cpu_topology.logical_processor_count; i++)
+  {
+    u32 apic_id = cpu_topology.logical_processors[i].apic_id;
+    cpu_topology_raw_ids[i] = (shift < 32) ? (apic_id >> shift) : 0;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Topology decoding
+struct cpu_topology_pass
+{
+  // CPUID function whose output holds the APIC ID (0x1F, 0xB, 0x8000001E or 0x1)
+  u32 apic_id_func;
+
+  // Whether AMD's function 0x8000001E is available to read node IDs and the thread count per core
+  u32 amd_topology_extensions;
+
+  // Count of threads per core, as reported by function 0x8000001E on the first logical processor
+  s32 amd_threads_per_core;
+
+  // Whether function 0x1A reports the core type of each logical processor
+  u32 is_hybrid;
+
+  // On hybrid CPUs, L2 caches are shared by a different count of logical processors depending on
+  // the core type. -1 until known, from the caller's snapshot for the core type it was taken on,
+  // or from the first logical processor of each other core type
+  s32 hybrid_l2_shifts[CPU_CORE_TYPE_COUNT];
+};
+
+// Get the L2 and L3 shifts from the count of logical processors sharing each cache, enumerated by
+// function 0x4 or 0x8000001D. Shifts of missing levels are left untouched. Returns a bit mask of
+// the cache levels found
+static s32 cpu_topology_get_cache_shifts(const struct cpuid_snapshot* snapshot, u32 func, s32* l2_shift, s32* l3_shift)
+{
+  s32 cpuid_out[4];
+  s32 found_levels = 0;
+
+  u32 subfunc = 0x0;
+  cpuid_snapshot_get(snapshot, cpuid_out, func, subfunc);
+  while ((cpuid_out[EAX] & 0xF) != 0)
+  {
+    // Skip instruction caches
+    s32 cache_type  = cpuid_out[EAX] & 0x1F;
+    s32 cache_level = (cpuid_out[EAX] >> 5) & 0b111;
+    if ((cache_type != 2) && ((cache_level == 2) || (cache_level == 3)))
+    {
+      s32 max_sharing_ids = ((cpuid_out[EAX] >> 14) & 0xFFF) + 1;
+      s32 shift           = ceil_log2((u32)max_sharing_ids);
+      if (cache_level == 2)
+      {
+        *l2_shift = shift;
+      }
+      else
+      {
+        *l3_shift = shift;
+      }
+
+      found_levels |= 1 << cache_level;
+    }
+
+    subfunc++;
+    cpuid_snapshot_get(snapshot, cpuid_out, func, subfunc);
+  }
+
+  return found_levels;
+}
+
+// Capture function 0x4 on the current logical processor into a snapshot of its own. The caller's
+// snapshot describes the core type it was taken on, so this is only done on the first logical
+// processor of each other core type
+static void cpu_topology_capture_caches(struct cpuid_snapshot* snapshot)
+{
+  snapshot->leaf_count = 0;
+  snapshot->xcr0       = 0;
+  snapshot->is_local   = 1;
+  for (u32 subfunc = 0x0; snapshot->leaf_count < CPUID_SNAPSHOT_MAX_LEAF_COUNT; subfunc++)
+  {
+    struct cpuid_leaf* leaf = &snapshot->leaves[snapshot->leaf_count++];
+    leaf->func     = 0x4;
+    leaf->sub_func = subfunc;
+    __cpuidex(leaf->out, 0x4, (s32)subfunc);
+    if ((leaf->out[EAX] & 0xF) == 0)
+    {
+      break;
+    }
+  }
+}
+
+static void cpu_topology_visit_cpu(s32 os_cpu_index, void* user_data)
+{
+  struct cpu_topology_pass* pass = (struct cpu_topology_pass*)user_data;
+
+  s32 lp_idx = cpu_topology.logical_processor_count;
+  if (lp_idx >= CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS)
+  {
+    return;
+  }
+
+  struct cpu_logical_processor* logical_processor = &cpu_topology.logical_processors[lp_idx];
+  logical_processor->os_index = os_cpu_index;
+
+  s32 cpuid_out[4];
+  __cpuidex(cpuid_out, (s32)pass->apic_id_func, 0x0);
+  switch (pass->apic_id_func)
+  {
+    case 0x1F:
+    case 0xB:
+      logical_processor->apic_id = (u32)cpuid_out[EDX];
+      break;
+    case 0x8000001E:
+      logical_processor->apic_id = (u32)cpuid_out[EAX];
+      break;
+    default:
+      logical_processor->apic_id = ((u32)cpuid_out[EBX] >> 24) & 0xFF;
+      break;
+  }
+
+  if (pass->amd_topology_extensions)
+  {
+    if (pass->apic_id_func != 0x8000001E)
+    {
+      __cpuidex(cpuid_out, 0x8000001E, 0x0);
+    }
+
+    cpu_topology_node_ids[lp_idx] = cpuid_out[ECX] & 0xFF;
+    if (lp_idx == 0)
+    {
+      pass->amd_threads_per_core = ((cpuid_out[EBX] >> 8) & 0xFF) + 1;
+    }
+  }
+
+  // Intel's efficient (Atom) cores are reported as core type 0x20
+  logical_processor->core_type = CPU_CORE_TYPE_PERFORMANCE;
+  if (pass->is_hybrid)
+  {
+    __cpuidex(cpuid_out, 0x1A, 0x0);
+    if ((((u32)cpuid_out[EAX] >> 24) & 0xFF) == 0x20)
+    {
+      logical_processor->core_type = CPU_CORE_TYPE_EFFICIENT;
+    }
+
+    if (pass->hybrid_l2_shifts[logical_processor->core_type] < 0)
+    {
+      s32 l3_shift;
+      struct cpuid_snapshot core_snapshot;
+      cpu_topology_capture_caches(&core_snapshot);
+      cpu_topology_get_cache_shifts(&core_snapshot, 0x4, &pass->hybrid_l2_shifts[logical_processor->core_type], &l3_shift);
+    }
+  }
+
+  cpu_topology.logical_processor_count++;
+}
+
+// Get the SMT, die and package shifts from function 0x1F or 0xB. Returns 0 if the function doesn't
+// enumerate any level
+static u32 cpu_topology_get_extended_shifts(const struct cpuid_snapshot* snapshot, u32 func)
+{
+  s32 cpuid_out[4];
+  s32 previous_shift = 0;
+  s32 die_shift      = -1;
+
+  cpu_topology.smt_shift = 0;
+
+  u32 subfunc = 0x0;
+  for (; subfunc < 0x8; subfunc++)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, func, subfunc);
+    s32 level_type = (cpuid_out[ECX] >> 8) & 0xFF;
+    if (level_type == 0)
+    {
+      break;
+    }
+
+    // Each level's shift identifies the next level up, so a die is identified by the shift of the
+    // level below it. Level types: 1 = SMT, 2 = core, 3 = module, 4 = tile, 5 = die
+    s32 shift = cpuid_out[EAX] & 0x1F;
+    if (level_type == 1)
+    {
+      cpu_topology.smt_shift = shift;
+    }
+    else if (level_type == 5)
+    {
+      die_shift = previous_shift;
+    }
+
+    previous_shift = shift;
+  }
+
+  cpu_topology.package_shift = previous_shift;
+  cpu_topology.die_shift     = (die_shift >= 0) ? die_shift : previous_shift;
+
+  return subfunc != 0x0;
+}
+
+// Get the SMT and package shifts for CPUs lacking functions 0xB and 0x1F
+static void cpu_topology_get_legacy_shifts(const struct cpuid_snapshot* snapshot, struct cpuid_ctx cpuid_ctx, u32 is_amd, s32 amd_threads_per_core)
+{
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
+  s32 hyperthreaded          = (cpuid_out[EDX] >> 28) & 0b1;
+  s32 max_logical_processors = hyperthreaded ? ((cpuid_out[EBX] >> 16) & 0xFF) : 1;
+
+  cpu_topology.package_shift = ceil_log2((u32)max_logical_processors);
+  cpu_topology.smt_shift     = 0;
+
+  if (is_amd)
+  {
+    if (cpuid_ctx.max_extended_func >= 0x80000008)
+    {
+      cpuid_snapshot_get(snapshot, cpuid_out, 0x80000008, 0x0);
+      s32 apic_id_core_id_size = (cpuid_out[ECX] >> 12) & 0xF;
+      s32 thread_count         = (cpuid_out[ECX] & 0xFF) + 1;
+      cpu_topology.package_shift = apic_id_core_id_size ? apic_id_core_id_size : ceil_log2((u32)thread_count);
+    }
+
+    cpu_topology.smt_shift = ceil_log2((u32)amd_threads_per_core);
+  }
+  else if (cpuid_ctx.max_standard_func >= 0x4)
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x4, 0x0);
+    s32 max_core_count = ((cpuid_out[EAX] >> 26) & 0x3F) + 1;
+    s32 core_shift     = ceil_log2((u32)max_core_count);
+    cpu_topology.smt_shift = (cpu_topology.package_shift > core_shift) ? (cpu_topology.package_shift - core_shift) : 0;
+  }
+  else
+  {
+    // Early hyperthreaded CPUs with a single core
+    cpu_topology.smt_shift = cpu_topology.package_shift;
+  }
+
+  cpu_topology.die_shift = cpu_topology.package_shift;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// NUMA
+// Join the NUMA nodes reported by the OS with the logical processors, and read node distances
+static void cpu_topology_get_numa_nodes(void)
+{
+  s32 lp_count = cpu_topology.logical_processor_count;
+  struct cpu_logical_processor* logical_processors = cpu_topology.logical_processors;
+  for (s32 i = 0; i < lp_count; i++)
+  {
+    cpu_topology_os_cpu_indices[i] = logical_processors[i].os_index;
+  }
+
+  // Without NUMA support in the OS, the whole system is node 0
+  if (os_get_numa_nodes(cpu_topology_os_cpu_indices, cpu_topology_numa_node_numbers, lp_count) == 0)
+  {
+    for (s32 i = 0; i < lp_count; i++)
+    {
+      cpu_topology_numa_node_numbers[i] = 0;
+    }
+  }
+
+  // Turn node numbers into dense IDs, in order of first appearance
+  for (s32 i = 0; i < lp_count; i++)
+  {
+    s32 node_number = cpu_topology_numa_node_numbers[i];
+    s32 node_id     = -1;
+    for (s32 j = 0; (j < cpu_topology.numa_node_count) && (node_id < 0); j++)
+    {
+      node_id = (cpu_topology.numa_node_numbers[j] == node_number) ? j : -1;
+    }
+
+    if ((node_id < 0) && (node_number >= 0) && (cpu_topology.numa_node_count < CPU_TOPOLOGY_MAX_NUMA_NODES))
+    {
+      node_id = cpu_topology.numa_node_count++;
+      cpu_topology.numa_node_numbers[node_id] = node_number;
+    }
+
+    logical_processors[i].numa_node_id = node_id;
+  }
+
+  // Distances are listed in node number order, so nodes numbered beyond OS_MAX_NUMA_NODE_COUNT
+  // are left unknown
+  u8 distances[OS_MAX_NUMA_NODE_COUNT];
+  for (s32 i = 0; i < cpu_topology.numa_node_count; i++)
+  {
+    s32 distance_count = os_get_numa_distances(cpu_topology.numa_node_numbers[i], distances, OS_MAX_NUMA_NODE_COUNT);
+    for (s32 j = 0; j < cpu_topology.numa_node_count; j++)
+    {
+      s32 node_number = cpu_topology.numa_node_numbers[j];
+      cpu_topology.numa_node_distances[i][j] = (node_number < distance_count) ? distances[node_number] : (u8)((i == j) ? 10 : 0);
+    }
+  }
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Topology
+static void cpu_topology_reset(void)
+{
+  cpu_topology.logical_processor_count = 0;
+  cpu_topology.core_count              = 0;
+  cpu_topology.die_count               = 0;
+  cpu_topology.package_count           = 0;
+  cpu_topology.l2_count                = 0;
+  cpu_topology.l3_count                = 0;
+  cpu_topology.numa_node_count         = 0;
+  cpu_topology.is_untrusted            = 0;
+}
+
+#if !defined(ISA_arm64)
+void cpu_topology_init_from_snapshot(const struct cpuid_snapshot* snapshot)
+{
+  cpu_topology_reset();
+
+  // APIC IDs are still read live on each logical processor, so the shifts decoded from the
+  // snapshot must be the current CPU's
+  if ((snapshot->leaf_count == 0) || !snapshot->is_local)
+  {
+    return;
+  }
+
+  s32 cpuid_out[4];
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x0, 0x0);
+  struct cpuid_ctx cpuid_ctx = {.max_standard_func = (u32)cpuid_out[EAX]};
+  u32 is_amd = (cpuid_out[ECX] == CPU_MANUFACTURER_AMD) || (cpuid_out[ECX] == CPU_MANUFACTURER_HYGON);
+
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x80000000, 0x0);
+  cpuid_ctx.max_extended_func = (u32)cpuid_out[EAX];
+
+  // Hypervisors make up the topology their virtual CPUs report
+  cpuid_snapshot_get(snapshot, cpuid_out, 0x1, 0x0);
+  cpu_topology.is_untrusted = ((u32)cpuid_out[ECX] >> 31) & 0b1;
+
+  struct cpu_topology_pass pass = {.apic_id_func = 0x1, .amd_topology_extensions = 0, .amd_threads_per_core = 1, .is_hybrid = 0, .hybrid_l2_shifts = {-1, -1}};
+  if (is_amd && (cpuid_ctx.max_extended_func >= 0x8000001E))
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000001, 0x0);
+    pass.amd_topology_extensions = (cpuid_out[ECX] >> 22) & 0b1;
+  }
+
+  if (!is_amd && (cpuid_ctx.max_standard_func >= 0x1A))
+  {
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x7, 0x0);
+    pass.is_hybrid = (cpuid_out[EDX] >> 15) & 0b1;
+  }
+
+  // The snapshot gives the L2 shift of the core type it was taken on, see cpu_topology_visit_cpu()
+  if (pass.is_hybrid)
+  {
+    s32 l3_shift;
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x1A, 0x0);
+    s32 core_type = ((((u32)cpuid_out[EAX] >> 24) & 0xFF) == 0x20) ? CPU_CORE_TYPE_EFFICIENT : CPU_CORE_TYPE_PERFORMANCE;
+    cpu_topology_get_cache_shifts(snapshot, 0x4, &pass.hybrid_l2_shifts[core_type], &l3_shift);
+  }
+
+  // Prefer the x2APIC ID of functions 0x1F and 0xB, whose shifts also describe the topology
+  u32 extended_topology_func = 0;
+  if (!is_amd && (cpuid_ctx.max_standard_func >= 0x1F))
+  {
+    extended_topology_func = 0x1F;
+  }
+  else if (cpuid_ctx.max_standard_func >= 0xB)
+  {
+    extended_topology_func = 0xB;
+  }
+
+  if (extended_topology_func && cpu_topology_get_extended_shifts(snapshot, extended_topology_func))
+  {
+    pass.apic_id_func = extended_topology_func;
+  }
+  else
+  {
+    extended_topology_func = 0;
+    if (pass.amd_topology_extensions)
+    {
+      pass.apic_id_func = 0x8000001E;
+    }
+  }
+
+  if (os_for_each_cpu(cpu_topology_visit_cpu, &pass) == 0)
+  {
+    return;
+  }
+
+  if (!extended_topology_func)
+  {
+    cpu_topology_get_legacy_shifts(snapshot, cpuid_ctx, is_amd, pass.amd_threads_per_core);
+  }
+
+  s32 cache_levels = 0;
+  if (is_amd && pass.amd_topology_extensions && (cpuid_ctx.max_extended_func >= 0x8000001D))
+  {
+    cache_levels = cpu_topology_get_cache_shifts(snapshot, 0x8000001D, &cpu_topology.l2_shift, &cpu_topology.l3_shift);
+  }
+  else if (!is_amd && (cpuid_ctx.max_standard_func >= 0x4))
+  {
+    cache_levels = cpu_topology_get_cache_shifts(snapshot, 0x4, &cpu_topology.l2_shift, &cpu_topology.l3_shift);
+  }
+  else if (is_amd && (cpuid_ctx.max_extended_func >= 0x80000006))
+  {
+    // Without topology extensions, AMD CPUs have one L2 cache per core, and at most one L3 cache
+    // per package
+    cpuid_snapshot_get(snapshot, cpuid_out, 0x80000006, 0x0);
+    cpu_topology.l2_shift = cpu_topology.smt_shift;
+    cpu_topology.l3_shift = cpu_topology.package_shift;
+    cache_levels = (1 << 2) | ((((u32)cpuid_out[EDX] >> 18) != 0) << 3);
+  }
+
+  // Turn raw IDs into dense IDs
+  s32 lp_count = cpu_topology.logical_processor_count;
+  struct cpu_logical_processor* logical_processors = cpu_topology.logical_processors;
+
+  cpu_topology_get_raw_ids(cpu_topology.smt_shift);
+  cpu_topology.core_count = cpu_topology_densify(cpu_topology_raw_ids, cpu_topology_dense_ids, lp_count);
+  for (s32 i = 0; i < lp_count; i++)
+  {
+    logical_processors[i].core_id = cpu_topology_dense_ids[i];
+    logical_processors[i].smt_id  = 0;
+    for (s32 j = 0; j < i; j++)
+    {
+      logical_processors[i].smt_id += (logical_processors[j].core_id == logical_processors[i].core_id);
+    }
+  }
+
+  cpu_topology_get_raw_ids(cpu_topology.package_shift);
+  cpu_topology.package_count = cpu_topology_densify(cpu_topology_raw_ids, cpu_topology_dense_ids, lp_count);
+  for (s32 i = 0; i < lp_count; i++)
+  {
+    logical_processors[i].package_id = cpu_topology_dense_ids[i];
+  }
+
+  // AMD node IDs identify Zen 1's dies, which APIC IDs alone don't. From Zen 2 on, the CCDs share
+  // one node per package (or NPS node), so node IDs don't identify them
+  if (pass.amd_topology_extensions)
+  {
+    cpu_topology.die_count = cpu_topology_densify(cpu_topology_node_ids, cpu_topology_dense_ids, lp_count);
+  }
+  else
+  {
+    cpu_topology_get_raw_ids(cpu_topology.die_shift);
+    cpu_topology.die_count = cpu_topology_densify(cpu_topology_raw_ids, cpu_topology_dense_ids, lp_count);
+  }
+  for (s32 i = 0; i < lp_count; i++)
+  {
+    logical_processors[i].die_id = cpu_topology_dense_ids[i];
+  }
+
+  for (s32 i = 0; i < lp_count; i++)
+  {
+    logical_processors[i].l2_id = -1;
+    logical_processors[i].l3_id = -1;
+  }
+
+  if (cache_levels & (1 << 2))
+  {
+    cpu_topology_get_raw_ids(cpu_topology.l2_shift);
+    if (pass.is_hybrid)
+    {
+      // Tell apart the L2 caches of each core type, which may not share the same shift
+      for (s32 i = 0; i < lp_count; i++)
+      {
+        s32 core_type = logical_processors[i].core_type;
+        u32 raw_l2_id  = logical_processors[i].apic_id >> pass.hybrid_l2_shifts[core_type];
+        cpu_topology_raw_ids[i] = (raw_l2_id << 1) | (u32)core_type;
+      }
+    }
+    cpu_topology.l2_count = cpu_topology_densify(cpu_topology_raw_ids, cpu_topology_dense_ids, lp_count);
+    for (s32 i = 0; i < lp_count; i++)
+    {
+      logical_processors[i].l2_id = cpu_topology_dense_ids[i];
+    }
+  }
+
+  if (cache_levels & (1 << 3))
+  {
+    cpu_topology_get_raw_ids(cpu_topology.l3_shift);
+    cpu_topology.l3_count = cpu_topology_densify(cpu_topology_raw_ids, cpu_topology_dense_ids, lp_count);
+    for (s32 i = 0; i < lp_count; i++)
+    {
+      logical_processors[i].l3_id = cpu_topology_dense_ids[i];
+    }
+  }
+
+  cpu_topology_get_numa_nodes();
+}
+#endif
+
+void cpu_topology_init(void)
+{
+  // On ARM64, MPIDR_EL1 isn't readable from user mode, and its affinity levels don't follow a
+  // fixed layout like APIC IDs do, so the topology is left empty
+#if defined(ISA_arm64)
+  cpu_topology_reset();
+#else
+  struct cpuid_snapshot snapshot;
+  cpuid_snapshot_init(&snapshot);
+  cpu_topology_init_from_snapshot(&snapshot);
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Affinity
+static s32 cpu_topology_get_domain_id(const struct cpu_logical_processor* logical_processor, s32 domain)
+{
+  switch (domain)
+  {
+    case CPU_TOPOLOGY_DOMAIN_CORE:
+      return logical_processor->core_id;
+    case CPU_TOPOLOGY_DOMAIN_DIE:
+      return logical_processor->die_id;
+    case CPU_TOPOLOGY_DOMAIN_PACKAGE:
+      return logical_processor->package_id;
+    case CPU_TOPOLOGY_DOMAIN_L2:
+      return logical_processor->l2_id;
+    case CPU_TOPOLOGY_DOMAIN_L3:
+      return logical_processor->l3_id;
+    case CPU_TOPOLOGY_DOMAIN_NUMA_NODE:
+      return logical_processor->numa_node_id;
+    default:
+      return -1;
+  }
+}
+
+s32 cpu_topology_get_affinities(s32 domain, s32 domain_id, struct cpu_affinity* affinities, s32 max_affinity_count)
+{
+  if (domain_id < 0)
+  {
+    return 0;
+  }
+
+  // Logical processors are sorted by OS index, hence by group, so each group starts a new mask
+  s32 affinity_count = 0;
+  s32 group          = -1;
+  for (s32 i = 0; i < cpu_topology.logical_processor_count; i++)
+  {
+    const struct cpu_logical_processor* logical_processor = &cpu_topology.logical_processors[i];
+    if (cpu_topology_get_domain_id(logical_processor, domain) != domain_id)
+    {
+      continue;
+    }
+
+    if (logical_processor->os_index / OS_CPU_GROUP_SIZE != group)
+    {
+      group = logical_processor->os_index / OS_CPU_GROUP_SIZE;
+      if (affinity_count < max_affinity_count)
+      {
+        affinities[affinity_count].mask  = 0;
+        affinities[affinity_count].group = group;
+      }
+      affinity_count++;
+    }
+
+    if (affinity_count <= max_affinity_count)
+    {
+      affinities[affinity_count - 1].mask |= (u64)1 << (logical_processor->os_index % OS_CPU_GROUP_SIZE);
+    }
+  }
+
+  return affinity_count;
+}
+
+s32 cpu_topology_get_numa_node_id(s32 domain, s32 domain_id)
+{
+  if (domain_id < 0)
+  {
+    return -1;
+  }
+
+  s32 numa_node_id = -1;
+  for (s32 i = 0; i < cpu_topology.logical_processor_count; i++)
+  {
+    const struct cpu_logical_processor* logical_processor = &cpu_topology.logical_processors[i];
+    if (cpu_topology_get_domain_id(logical_processor, domain) != domain_id)
+    {
+      continue;
+    }
+
+    if ((logical_processor->numa_node_id < 0) || ((numa_node_id >= 0) && (logical_processor->numa_node_id != numa_node_id)))
+    {
+      return -1;
+    }
+    numa_node_id = logical_processor->numa_node_id;
+  }
+
+  return numa_node_id;
+}
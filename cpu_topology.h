@@ -0,0 +1,150 @@
+#pragma once
+
+#include "cpu_specs.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// enums and structs
+// Maximum count of logical processors described by cpu_topology. May be overridden at compile time
+#if !defined(CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS)
+#  define CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS 512
+#endif
+
+// Maximum count of NUMA nodes described by cpu_topology. May be overridden at compile time
+#if !defined(CPU_TOPOLOGY_MAX_NUMA_NODES)
+#  define CPU_TOPOLOGY_MAX_NUMA_NODES 64
+#endif
+
+struct cpu_logical_processor
+{
+  // OS index of this logical processor, see os.h. On Windows systems with several processor
+  // groups, this is (group * 64 + index in the group)
+  s32 os_index;
+
+  // x2APIC ID if the CPU supports it, or the 8-bit initial APIC ID otherwise
+  u32 apic_id;
+
+  // Index of this logical processor among the ones of the same physical core. This is 0 for the
+  // first SMT sibling
+  s32 smt_id;
+
+  // The following IDs are dense indices starting at 0, shared by all logical processors belonging
+  // to the same physical core, die, package, L2 cache and L3 cache. The cache IDs are -1 if there
+  // is no such cache. On AMD, dies are the nodes of function 0x8000001E: the dies of Zen 1 and
+  // Hygon's CPUs, but the packages (or NPS nodes) of Zen 2 and later, whose CCDs aren't
+  // identified. Most Zen 3 and later CCDs have their own L3 cache, see l3_id
+  s32 core_id;
+  s32 die_id;
+  s32 package_id;
+  s32 l2_id;
+  s32 l3_id;
+
+  // Type of the physical core, as an enum cpu_core_type value. This is always
+  // CPU_CORE_TYPE_PERFORMANCE on non-hybrid CPUs
+  s32 core_type;
+
+  // Dense index of the NUMA node whose memory is local to this logical processor, as reported by
+  // the OS, see cpu_topology.numa_node_numbers. This is -1 if the OS doesn't tell, or if there are
+  // more than CPU_TOPOLOGY_MAX_NUMA_NODES nodes
+  s32 numa_node_id;
+};
+
+struct cpu_topology
+{
+  // Count of logical processors described below. These are the ones the process may run on, in
+  // all processor groups on Windows
+  s32 logical_processor_count;
+
+  // Count of distinct core, die, package, L2 and L3 IDs in logical_processors. These only count
+  // the ones with at least one logical processor the process may run on, so core_count is the
+  // count of usable physical cores
+  s32 core_count;
+  s32 die_count;
+  s32 package_count;
+  s32 l2_count;
+  s32 l3_count;
+
+  // Count of distinct NUMA node IDs in logical_processors. Systems, or OSes, without NUMA support
+  // have a single node, whose OS number is 0
+  s32 numa_node_count;
+
+  // Whether the IDs above may not describe the physical CPU (1) or not (0), which is the case under
+  // a hypervisor. See cpu_specs.is_topology_untrusted
+  s32 is_untrusted;
+
+  // Bit widths decomposing APIC IDs: (apic_id >> x_shift) identifies the physical core, die,
+  // package, L2 or L3 cache of a logical processor. For instance, (apic_id >> smt_shift) is the
+  // same for all the SMT siblings of a core. On hybrid CPUs, l2_shift is the one of the core
+  // cpu_topology_init() was called on, since it differs between core types
+  s32 smt_shift;
+  s32 die_shift;
+  s32 package_shift;
+  s32 l2_shift;
+  s32 l3_shift;
+
+  // Logical processors, sorted by OS index
+  struct cpu_logical_processor logical_processors[CPU_TOPOLOGY_MAX_LOGICAL_PROCESSORS];
+
+  // OS number of each NUMA node ID, as taken by mbind() or VirtualAllocExNuma() to allocate memory
+  // on that node
+  s32 numa_node_numbers[CPU_TOPOLOGY_MAX_NUMA_NODES];
+
+  // Distances between NUMA nodes, accessed with two NUMA node IDs, as reported by the ACPI SLIT:
+  // 10 from a node to itself, and larger values to nodes whose memory is proportionally slower to
+  // access, such as 21 for the other socket of a 2-socket system. Distances to other nodes are 0
+  // if unknown, which is always the case on Windows
+  u8 numa_node_distances[CPU_TOPOLOGY_MAX_NUMA_NODES][CPU_TOPOLOGY_MAX_NUMA_NODES];
+};
+
+// Domains logical processors are grouped by, matching the IDs of struct cpu_logical_processor
+enum cpu_topology_domain
+{
+  CPU_TOPOLOGY_DOMAIN_CORE = 0,
+  CPU_TOPOLOGY_DOMAIN_DIE,
+  CPU_TOPOLOGY_DOMAIN_PACKAGE,
+  CPU_TOPOLOGY_DOMAIN_L2,
+  CPU_TOPOLOGY_DOMAIN_L3,
+  CPU_TOPOLOGY_DOMAIN_NUMA_NODE
+};
+
+// Logical processors of a single processor group, laid out as Windows' GROUP_AFFINITY: bit i of
+// mask is the logical processor of OS index (group * 64 + i). On Linux, groups are the 64-bit
+// words of CPU sets
+struct cpu_affinity
+{
+  u64 mask;
+  s32 group;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Implementation
+extern struct cpu_topology cpu_topology;
+
+// Initialize or refresh the global cpu_topology struct.
+// The calling thread is pinned to each logical processor the process may run on in turn, to read
+// its APIC ID, then its affinity is restored. This costs one thread migration per logical
+// processor, so should be done once at startup. If CPUID is unavailable, as on ARM64, or the thread
+// can't be pinned, cpu_topology is left empty. NUMA nodes are then read from the OS
+void cpu_topology_init(void);
+
+#if !defined(ISA_arm64)
+// Initialize or refresh the global cpu_topology struct from a snapshot of the current CPU, see
+// cpuid_snapshot_init(). The shifts of the APIC ID fields are decoded from the snapshot, while
+// APIC IDs are still read on each logical processor, as cpu_topology_init() does. A snapshot of
+// another machine (see is_local), or an empty one, leaves cpu_topology empty
+void cpu_topology_init_from_snapshot(const struct cpuid_snapshot* snapshot);
+#endif
+
+// Get the affinity masks of the logical processors of a domain, such as the physical core of
+// core_id CPU_TOPOLOGY_DOMAIN_CORE, or the L3 cache of l3_id CPU_TOPOLOGY_DOMAIN_L3. There is one
+// mask per processor group the domain spans, in increasing group order. Physical cores are never
+// split between groups, but dies, packages and L3 caches of more than 64 logical processors are.
+// Up to max_affinity_count masks are written to affinities. Returns the count of masks of the
+// domain, which is 0 if it has no logical processor
+s32 cpu_topology_get_affinities(s32 domain, s32 domain_id, struct cpu_affinity* affinities, s32 max_affinity_count);
+
+// Return the NUMA node ID shared by all logical processors of a domain, such as the L3 cache of
+// l3_id CPU_TOPOLOGY_DOMAIN_L3, so that its threads and their memory may be bound to the same node.
+// Returns -1 if the domain has no logical processor, if its node is unknown, or if it spans several
+// nodes, as packages do with sub-NUMA clustering (SNC) or AMD's NPS2 and NPS4 modes
+s32 cpu_topology_get_numa_node_id(s32 domain, s32 domain_id);
@@ -0,0 +1,91 @@
+#include "cpu_tsc.h"
+#include "cpu_specs.h"
+#include "os.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Globals
+struct cpu_tsc cpu_tsc =
+{
+  .is_usable     = 0,
+  .is_calibrated = 0,
+  .frequency     = 0,
+  .ns_mult       = 0,
+  .ns_shift      = 0
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Calibration
+#define CPU_TSC_CALIBRATION_NS 10000000
+
+// Count TSC ticks while the OS clock advances by CPU_TSC_CALIBRATION_NS. Returns the TSC
+// frequency in Hz, or 0 if the OS clock is unavailable
+static u64 cpu_tsc_calibrate(void)
+{
+  u64 os_start = os_get_time_ns();
+  if (os_start == 0)
+  {
+    return 0;
+  }
+
+  u64 tsc_start = cpu_tsc_now();
+  u64 os_end;
+  do
+  {
+    os_end = os_get_time_ns();
+  }
+  while (os_end - os_start < CPU_TSC_CALIBRATION_NS);
+  u64 tsc_end = cpu_tsc_now();
+
+  // The tick count of a few dozen milliseconds fits in 40 bits, so this can't overflow
+  return (tsc_end - tsc_start) * 1000000000 / (os_end - os_start);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Initialization
+u32 cpu_tsc_init(void)
+{
+  cpu_tsc.is_usable     = 0;
+  cpu_tsc.is_calibrated = 0;
+  cpu_tsc.frequency     = cpu_specs.tsc_frequency;
+  cpu_tsc.ns_mult       = 0;
+  cpu_tsc.ns_shift      = 0;
+
+#if !defined(ISA_arm64)
+  // ARM64's generic timer is always available
+  if ((cpu_specs.instructions & TSC) == 0)
+  {
+    return 0;
+  }
+#endif
+
+  if (cpu_tsc.frequency == 0)
+  {
+    cpu_tsc.frequency     = cpu_tsc_calibrate();
+    cpu_tsc.is_calibrated = 1;
+    if (cpu_tsc.frequency == 0)
+    {
+      return 0;
+    }
+  }
+
+  // ns_mult = 10^9 * 2^ns_shift / frequency. Division only happens here, once
+  s32 ns_shift = 32;
+  u64 ns_mult  = ((u64)1000000000 << ns_shift) / cpu_tsc.frequency;
+  while ((ns_mult >> 32) && (ns_shift > 0))
+  {
+    ns_shift--;
+    ns_mult = ((u64)1000000000 << ns_shift) / cpu_tsc.frequency;
+  }
+  if (ns_mult >> 32)
+  {
+    return 0;
+  }
+
+  cpu_tsc.ns_mult   = (u32)ns_mult;
+  cpu_tsc.ns_shift  = ns_shift;
+  cpu_tsc.is_usable = cpu_specs.has_invariant_tsc;
+
+  return cpu_tsc.is_usable;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "isa.h"
+#include "types.h"
+
+// cpu_intrinsics.h isn't included here, as this header is included by user code. On ARM64, the
+// generic timer's virtual count (CNTVCT_EL0) stands for the TSC
+#if defined(ISA_arm64)
+#  if defined(_MSC_VER)
+extern s64 _ReadStatusReg(s32 reg);
+#    define CPU_TSC_READ() ((u64)_ReadStatusReg(0x5F02))
+#  else
+static inline u64 cpu_tsc_read_cntvct(void)
+{
+  u64 count;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(count));
+  return count;
+}
+#    define CPU_TSC_READ() cpu_tsc_read_cntvct()
+#  endif
+#elif defined(_MSC_VER)
+extern u64 __rdtsc(void);
+#  define CPU_TSC_READ() __rdtsc()
+#else
+#  define CPU_TSC_READ() __builtin_ia32_rdtsc()
+#endif
+
+// Time stamp counter (TSC) based timer. Reading the TSC takes a few dozen cycles, compared to
+// QueryPerformanceCounter() which may go through the OS or the hypervisor. Converting ticks to
+// nanoseconds is a fixed-point multiplication, without any division
+
+struct cpu_tsc
+{
+  // Whether the TSC can be used as a wall clock (1) or not (0). This requires an invariant TSC
+  // and a known frequency. Otherwise, cpu_tsc_to_ns() returns 0
+  s32 is_usable;
+
+  // Whether frequency was measured against the OS clock (1) or reported by CPUID (0)
+  s32 is_calibrated;
+
+  // Frequency of the TSC in Hz, or 0 if unknown
+  u64 frequency;
+
+  // Conversion factor from ticks to nanoseconds: ns = (ticks * ns_mult) >> ns_shift. ns_shift is
+  // the highest value in [0, 32] keeping ns_mult below 2^32
+  u32 ns_mult;
+  s32 ns_shift;
+};
+
+extern struct cpu_tsc cpu_tsc;
+
+// Initialize the global cpu_tsc struct. cpu_specs_init() must be called beforehand. When CPUID
+// doesn't report the TSC frequency, as on AMD CPUs, it is calibrated against the OS clock, which
+// takes about 10 ms. Returns cpu_tsc.is_usable
+u32 cpu_tsc_init(void);
+
+// Read the TSC. Only differences between two readings are meaningful. RDTSC isn't serializing, so
+// it may execute before earlier instructions complete
+static inline u64 cpu_tsc_now(void)
+{
+  return CPU_TSC_READ();
+}
+
+// Convert a count of TSC ticks to nanoseconds. The 64x32-bit multiplication is split in two
+// halves so that no intermediate result overflows for realistic durations
+static inline u64 cpu_tsc_to_ns(u64 ticks)
+{
+  u64 high_product = (ticks >> 32) * cpu_tsc.ns_mult;
+  u64 low_product  = (ticks & 0xFFFFFFFF) * cpu_tsc.ns_mult;
+
+  return (high_product << (32 - cpu_tsc.ns_shift)) + (low_product >> cpu_tsc.ns_shift);
+}
@@ -0,0 +1,243 @@
+#include "cpu_tuning.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Helpers
+// Maximum count of cache lines cpu_tuning_pad_row_length() adds. A single line is enough when
+// caches have a power-of-two count of sets
+#define CPU_TUNING_MAX_PADDING_LINES 16
+
+// Return the specs of a data or unified cache level, or 0 if params are invalid or there is no
+// such cache
+static const struct cpu_cache_level_specs* cpu_tuning_get_level_specs(const struct cpu_tuning_params* params, s32 level)
+{
+  if (!params || (params->element_size <= 0) || (level < L1) || (level >= CACHE_LEVEL_COUNT))
+  {
+    return 0;
+  }
+
+  const struct cpu_cache_level_specs* specs = &cpu_specs.cache_level_specs[level];
+  if ((specs->type == CACHE_TYPE_NULL) || (specs->data_cache_size <= 0))
+  {
+    return 0;
+  }
+
+  return specs;
+}
+
+static s32 cpu_tuning_get_line_size(const struct cpu_cache_level_specs* specs)
+{
+  if (specs->line_size > 0)
+  {
+    return specs->line_size;
+  }
+
+  return (cpu_specs.cache_line_size > 0) ? cpu_specs.cache_line_size : 64;
+}
+
+// Count of elements per cache line, which is 1 when elements are larger than lines or don't
+// divide them evenly
+static s32 cpu_tuning_get_line_elements(const struct cpu_tuning_params* params, const struct cpu_cache_level_specs* specs)
+{
+  s32 line_size = cpu_tuning_get_line_size(specs);
+  if ((params->element_size > line_size) || (line_size % params->element_size != 0))
+  {
+    return 1;
+  }
+
+  return line_size / params->element_size;
+}
+
+// Round value down to a multiple of granularity, but not below granularity
+static s64 cpu_tuning_round_down(s64 value, s64 granularity)
+{
+  return (value > granularity) ? (value - value % granularity) : granularity;
+}
+
+static u64 cpu_tuning_gcd(u64 a, u64 b)
+{
+  while (b != 0)
+  {
+    u64 remainder = a % b;
+    a = b;
+    b = remainder;
+  }
+
+  return a;
+}
+
+// Integer square root, rounded down
+static s64 cpu_tuning_sqrt(s64 value)
+{
+  s64 root = 0;
+  for (s64 bit = (s64)1 << 30; bit != 0; bit >>= 1)
+  {
+    s64 candidate = root | bit;
+    if (candidate * candidate <= value)
+    {
+      root = candidate;
+    }
+  }
+
+  return root;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Blocking
+s32 cpu_tuning_get_capacity(const struct cpu_tuning_params* params, s32 level)
+{
+  const struct cpu_cache_level_specs* specs = cpu_tuning_get_level_specs(params, level);
+  if (!specs)
+  {
+    return 0;
+  }
+
+  // attached_core_count counts physical cores, whose SMT siblings share all of their caches
+  s32 threads_per_core     = (cpu_specs.threads_per_core > 0) ? cpu_specs.threads_per_core : 1;
+  s32 sharing_thread_count = (specs->attached_core_count > 0) ? specs->attached_core_count * threads_per_core : threads_per_core;
+  if ((params->thread_count > 0) && (params->thread_count < sharing_thread_count))
+  {
+    sharing_thread_count = params->thread_count;
+  }
+
+  s32 fill_percent = params->fill_percents[level];
+  if (fill_percent <= 0)
+  {
+    fill_percent = CPU_TUNING_DEFAULT_FILL_PERCENT;
+  }
+  else if (fill_percent > 100)
+  {
+    fill_percent = 100;
+  }
+
+  // L3 caches of tens of megabytes times 100 overflow 32 bits
+  s64 line_size = cpu_tuning_get_line_size(specs);
+  s64 capacity  = (s64)specs->data_cache_size * fill_percent / 100 / sharing_thread_count;
+
+  return (s32)(capacity - capacity % line_size);
+}
+
+s32 cpu_tuning_stream(const struct cpu_tuning_params* params, s32 level, s32 stream_count)
+{
+  s32 capacity = cpu_tuning_get_capacity(params, level);
+  if ((capacity == 0) || (stream_count <= 0))
+  {
+    return 0;
+  }
+
+  const struct cpu_cache_level_specs* specs = &cpu_specs.cache_level_specs[level];
+  s64 elements = (s64)capacity / ((s64)stream_count * params->element_size);
+
+  return (s32)cpu_tuning_round_down(elements, cpu_tuning_get_line_elements(params, specs));
+}
+
+struct cpu_tuning_tile cpu_tuning_tile(const struct cpu_tuning_params* params, s32 level, s32 row_length, s32 array_count)
+{
+  struct cpu_tuning_tile tile = {.rows = 0, .columns = 0, .row_stride = 0};
+  s32 capacity = cpu_tuning_get_capacity(params, level);
+  if ((capacity == 0) || (row_length <= 0) || (array_count <= 0))
+  {
+    return tile;
+  }
+
+  // Start from a square tile, then make its rows whole cache lines and give the rounding back to
+  // the row count
+  const struct cpu_cache_level_specs* specs = &cpu_specs.cache_level_specs[level];
+  s64 elements = (s64)capacity / ((s64)array_count * params->element_size);
+  s64 columns  = cpu_tuning_round_down(cpu_tuning_sqrt(elements), cpu_tuning_get_line_elements(params, specs));
+  if (columns > row_length)
+  {
+    columns = row_length;
+  }
+
+  s64 rows = elements / columns;
+
+  tile.rows       = (rows > 0) ? (s32)rows : 1;
+  tile.columns    = (s32)columns;
+  tile.row_stride = cpu_tuning_pad_row_length(params, level, row_length, tile.rows);
+
+  return tile;
+}
+
+struct cpu_tuning_gemm cpu_tuning_gemm(const struct cpu_tuning_params* params, s32 mr, s32 nr)
+{
+  struct cpu_tuning_gemm gemm = {.kc = 0, .mc = 0, .nc = 0};
+  s32 l1_capacity = cpu_tuning_get_capacity(params, L1);
+  if ((l1_capacity == 0) || (mr <= 0) || (nr <= 0))
+  {
+    return gemm;
+  }
+
+  const struct cpu_cache_level_specs* l1_specs = &cpu_specs.cache_level_specs[L1];
+  s64 kc = (s64)l1_capacity / ((s64)(mr + nr) * params->element_size);
+  gemm.kc = (s32)cpu_tuning_round_down(kc, cpu_tuning_get_line_elements(params, l1_specs));
+
+  s64 panel_row_size = (s64)gemm.kc * params->element_size;
+  s32 l2_capacity    = cpu_tuning_get_capacity(params, L2);
+  if (l2_capacity != 0)
+  {
+    gemm.mc = (s32)cpu_tuning_round_down(l2_capacity / panel_row_size, mr);
+  }
+
+  s32 l3_capacity = cpu_tuning_get_capacity(params, L3);
+  if (l3_capacity != 0)
+  {
+    gemm.nc = (s32)cpu_tuning_round_down(l3_capacity / panel_row_size, nr);
+  }
+
+  return gemm;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Padding
+s32 cpu_tuning_pad_row_length(const struct cpu_tuning_params* params, s32 level, s32 row_length, s32 row_count)
+{
+  if (!cpu_tuning_get_level_specs(params, level) || (row_length <= 0))
+  {
+    return row_length;
+  }
+
+  s32 padded_row_length = row_length;
+  for (s32 padding_line_count = 0; padding_line_count <= CPU_TUNING_MAX_PADDING_LINES; padding_line_count++)
+  {
+    s32 has_conflicts = 0;
+    s32 padding_elements = 1;
+    for (s32 cache_level = L1; cache_level <= level; cache_level++)
+    {
+      const struct cpu_cache_level_specs* specs = cpu_tuning_get_level_specs(params, cache_level);
+      if (!specs || (specs->sets <= 0) || (specs->ways <= 0) || specs->has_complex_indexing)
+      {
+        continue;
+      }
+
+      // Rows (row_stride) bytes apart hit (set_span / gcd(row_stride, set_span)) distinct sets,
+      // with set_span the distance between addresses mapping to the same set
+      u64 line_size  = (u64)cpu_tuning_get_line_size(specs);
+      u64 set_span   = line_size * (u64)specs->sets;
+      u64 row_stride = (u64)padded_row_length * (u64)params->element_size;
+      u64 set_count  = set_span / cpu_tuning_gcd(row_stride, set_span);
+      if (set_count > (u64)specs->sets)
+      {
+        set_count = (u64)specs->sets;
+      }
+
+      if ((u64)row_count > set_count * (u64)specs->ways)
+      {
+        has_conflicts = 1;
+        s32 line_elements = cpu_tuning_get_line_elements(params, specs);
+        padding_elements  = (line_elements > padding_elements) ? line_elements : padding_elements;
+      }
+    }
+
+    if (!has_conflicts)
+    {
+      return padded_row_length;
+    }
+
+    padded_row_length += padding_elements;
+  }
+
+  // No padding avoids conflicts, such as with more rows than the cache has lines
+  return row_length;
+}
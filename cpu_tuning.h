@@ -0,0 +1,90 @@
+#pragma once
+
+#include "cpu_specs.h"
+
+// Cache blocking parameters derived from cpu_specs.cache_level_specs, so that kernels agree on how
+// much of each cache level a thread may use. Shared caches are divided between the threads that
+// may run on them, block sizes are rounded to whole cache lines, and row lengths of 2D arrays are
+// padded so that the rows of a block don't evict each other by mapping to the same cache sets
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// enums and structs
+// Percentage of a cache level's per-thread capacity used when cpu_tuning_params leaves it at 0.
+// The rest is left to the data a kernel touches besides its blocks, such as output arrays, the
+// stack, and lines prefetched ahead
+#define CPU_TUNING_DEFAULT_FILL_PERCENT 50
+
+struct cpu_tuning_params
+{
+  // Size of one element of the blocked arrays, in bytes
+  s32 element_size;
+
+  // Count of threads running the kernel at once. A cache shared by n logical processors, which is
+  // its attached_core_count times threads_per_core, is divided by min(thread_count, n), assuming
+  // threads may be packed on the same cache
+  s32 thread_count;
+
+  // Percentage of each cache level's per-thread capacity blocks may fill, from 1 to 100, accessed
+  // with enum cache_level's values. 0 selects CPU_TUNING_DEFAULT_FILL_PERCENT
+  s32 fill_percents[CACHE_LEVEL_COUNT];
+};
+
+// 2D tile of a row-major array, see cpu_tuning_tile()
+struct cpu_tuning_tile
+{
+  // Count of rows and elements per row of a tile, or 0 if there is no such cache level
+  s32 rows;
+  s32 columns;
+
+  // Row length, in elements, the array should be allocated with, which is the row length passed to
+  // cpu_tuning_tile() padded as cpu_tuning_pad_row_length() does
+  s32 row_stride;
+};
+
+// Blocking of a GEMM-style C += A * B kernel, in the loop order of BLIS and GotoBLAS: B is packed
+// in KC x NC panels kept in L3, A in MC x KC blocks kept in L2, and the micro-kernel streams
+// KC x NR slivers of B from L1 while it computes an MR x NR block of C in registers
+struct cpu_tuning_gemm
+{
+  // Depth of the panels: a KC x NR sliver of B and an MR x KC sliver of A fit in L1
+  s32 kc;
+
+  // Rows of the A block, a multiple of MR: an MC x KC block of A fits in L2
+  s32 mc;
+
+  // Columns of the B panel, a multiple of NR: a KC x NC panel of B fits in L3
+  s32 nc;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Implementation
+// All functions below read cpu_specs, so cpu_specs_init() must be called beforehand. On hybrid
+// CPUs, cpu_specs describes the caches of the core type cpu_specs_init() ran on. Sizes are 0 if
+// params are invalid or the cache level is missing, in which case the matching loop needn't be
+// blocked
+
+// Return the count of bytes a thread may use in a data or unified cache level, as an enum
+// cache_level value: the cache size divided between the threads sharing it, scaled by the level's
+// fill percentage, and rounded down to a whole count of cache lines
+s32 cpu_tuning_get_capacity(const struct cpu_tuning_params* params, s32 level);
+
+// Return the count of elements per block of stream_count arrays processed side by side, such as 3
+// for a[i] = b[i] + c[i], so that one block of each fits in a cache level. This is a multiple of
+// the elements per cache line when a line holds a whole count of elements
+s32 cpu_tuning_stream(const struct cpu_tuning_params* params, s32 level, s32 stream_count);
+
+// Return a tile of a row-major array of row_length elements per row, so that one tile of each of
+// array_count arrays fits in a cache level. Tiles are close to square, with whole cache lines per
+// row, and no wider than row_length
+struct cpu_tuning_tile cpu_tuning_tile(const struct cpu_tuning_params* params, s32 level, s32 row_length, s32 array_count);
+
+// Return the GEMM blocking for an mr x nr micro-kernel. mc and nc are 0 without L2 and L3 caches
+// respectively
+struct cpu_tuning_gemm cpu_tuning_gemm(const struct cpu_tuning_params* params, s32 mr, s32 nr);
+
+// Return row_length, in elements, increased by whole cache lines until row_count consecutive rows
+// don't map to the same sets more than the ways of any cache level up to level. Without padding,
+// rows of a power-of-two length of bytes map to a few sets, so a tile evicts its own rows long
+// before the cache is full. Caches with complex indexing aren't affected, so aren't considered
+s32 cpu_tuning_pad_row_length(const struct cpu_tuning_params* params, s32 level, s32 row_length, s32 row_count);
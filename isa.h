@@ -5,6 +5,18 @@
 #    define ISA_x64 1
 #  elif defined(_M_IX86)
 #    define ISA_x86 1
+#  elif defined(_M_ARM64)
+#    define ISA_arm64 1
+#  else
+#    error Unsupported instruction set architecture
+#  endif
+#elif defined(__GNUC__) || defined(__clang__)
+#  if defined(__x86_64__)
+#    define ISA_x64 1
+#  elif defined(__i386__)
+#    define ISA_x86 1
+#  elif defined(__aarch64__)
+#    define ISA_arm64 1
 #  else
 #    error Unsupported instruction set architecture
 #  endif
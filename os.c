@@ -0,0 +1,1240 @@
+#include "os.h"
+#include "cpu_specs.h"
+#include "cpu_intrinsics.h"
+
+#if defined(_WIN32)
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Windows API
+// Declare the few kernel32 functions used below rather than including windows.h. These match the
+// documented prototypes, with the Windows types replaced by types.h's equivalents
+typedef void* os_handle;
+typedef void (__stdcall *os_proc)(void);
+
+extern __declspec(dllimport) os_handle __stdcall GetCurrentProcess(void);
+extern __declspec(dllimport) os_handle __stdcall GetCurrentThread(void);
+extern __declspec(dllimport) s32       __stdcall GetProcessAffinityMask(os_handle process, os_uptr* process_mask, os_uptr* system_mask);
+extern __declspec(dllimport) os_uptr   __stdcall SetThreadAffinityMask(os_handle thread, os_uptr mask);
+extern __declspec(dllimport) os_handle __stdcall GetModuleHandleA(const schar8* module_name);
+extern __declspec(dllimport) os_proc   __stdcall GetProcAddress(os_handle module, const schar8* proc_name);
+extern __declspec(dllimport) os_handle __stdcall CreateThread(void* thread_attributes, os_uptr stack_size, u32 (__stdcall *start_address)(void*), void* parameter, u32 creation_flags, u32* thread_id);
+extern __declspec(dllimport) u32       __stdcall ResumeThread(os_handle thread);
+extern __declspec(dllimport) u32       __stdcall WaitForMultipleObjects(u32 count, const os_handle* handles, s32 wait_all, u32 milliseconds);
+extern __declspec(dllimport) s32       __stdcall CloseHandle(os_handle object);
+extern __declspec(dllimport) s32       __stdcall QueryPerformanceCounter(s64* count);
+extern __declspec(dllimport) s32       __stdcall QueryPerformanceFrequency(s64* frequency);
+
+// Systems with more than 64 logical processors split them into processor groups of up to 64 each
+// (32 for 32-bit processes). Affinity masks only cover a single group, so OS indices are
+// (group * OS_CPU_GROUP_SIZE + index in the group). The functions handling groups appeared in
+// Windows 7, and are looked up at run time so that Windows XP, which has a single group, is still
+// supported. Windows Server 2022's 2048 logical processors make 32 groups
+#define OS_MAX_GROUP_COUNT 32
+
+#define OS_RELATION_PROCESSOR_CORE 0
+#define OS_RELATION_NUMA_NODE      1
+#define OS_RELATION_CACHE          2
+#define OS_RELATION_GROUP          4
+
+// GROUP_AFFINITY
+struct os_group_affinity
+{
+  os_uptr mask;
+  u16     group;
+  u16     reserved[3];
+};
+
+// PROCESSOR_RELATIONSHIP, PROCESSOR_GROUP_INFO and GROUP_RELATIONSHIP. Their trailing arrays have
+// one entry per group
+struct os_processor_relationship
+{
+  u8                       flags;
+  u8                       efficiency_class;
+  u8                       reserved[20];
+  u16                      group_count;
+  struct os_group_affinity group_masks[1];
+};
+
+struct os_processor_group_info
+{
+  u8      maximum_processor_count;
+  u8      active_processor_count;
+  u8      reserved[38];
+  os_uptr active_processor_mask;
+};
+
+struct os_group_relationship
+{
+  u16                            maximum_group_count;
+  u16                            active_group_count;
+  u8                             reserved[20];
+  struct os_processor_group_info group_infos[1];
+};
+
+// CACHE_RELATIONSHIP. group_count is reserved, hence 0, before Windows 11 and Windows Server
+// 2022, which always only report group_masks[0]
+struct os_cache_relationship
+{
+  u8                       level;
+  u8                       associativity;
+  u16                      line_size;
+  u32                      cache_size;
+  s32                      type;
+  u8                       reserved[18];
+  u16                      group_count;
+  struct os_group_affinity group_masks[1];
+};
+
+// NUMA_NODE_RELATIONSHIP, whose group_count is reserved as CACHE_RELATIONSHIP's is
+struct os_numa_node_relationship
+{
+  u32                      node_number;
+  u8                       reserved[18];
+  u16                      group_count;
+  struct os_group_affinity group_masks[1];
+};
+
+// PROCESSOR_NUMBER
+struct os_processor_number
+{
+  u16 group;
+  u8  number;
+  u8  reserved;
+};
+
+// SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX, whose size varies with the relationship
+struct os_logical_processor_information
+{
+  u32 relationship;
+  u32 size;
+  union
+  {
+    struct os_processor_relationship processor;
+    struct os_cache_relationship     cache;
+    struct os_numa_node_relationship numa_node;
+    struct os_group_relationship     group;
+  };
+};
+
+typedef s32 (__stdcall os_get_thread_group_affinity_func)(os_handle thread, struct os_group_affinity* affinity);
+typedef s32 (__stdcall os_set_thread_group_affinity_func)(os_handle thread, const struct os_group_affinity* affinity, struct os_group_affinity* previous_affinity);
+typedef s32 (__stdcall os_get_logical_processor_information_ex_func)(s32 relationship, void* buffer, u32* length);
+typedef void (__stdcall os_get_current_processor_number_ex_func)(struct os_processor_number* number);
+typedef s32 (__stdcall os_get_numa_highest_node_number_func)(u32* highest_node_number);
+
+struct os_group_api
+{
+  s32                                           is_loaded;
+  s32                                           is_available;
+  os_get_thread_group_affinity_func*            GetThreadGroupAffinity;
+  os_set_thread_group_affinity_func*            SetThreadGroupAffinity;
+  os_get_logical_processor_information_ex_func* GetLogicalProcessorInformationEx;
+
+  // Not required by is_available. GetNumaHighestNodeNumber() appeared in Windows XP SP2
+  os_get_current_processor_number_ex_func*      GetCurrentProcessorNumberEx;
+  os_get_numa_highest_node_number_func*         GetNumaHighestNodeNumber;
+};
+
+static struct os_group_api os_group_api;
+
+// Storage for GetLogicalProcessorInformationEx(), large enough for about a thousand cores
+static u64 os_logical_processor_information_buffer[8192];
+
+// Look up the processor group functions once. Returns 1 if they are all available
+static s32 os_load_group_api(void)
+{
+  if (!os_group_api.is_loaded)
+  {
+    os_handle kernel32 = GetModuleHandleA((const schar8*)"kernel32.dll");
+    if (kernel32)
+    {
+      os_group_api.GetThreadGroupAffinity           = (os_get_thread_group_affinity_func*)GetProcAddress(kernel32, (const schar8*)"GetThreadGroupAffinity");
+      os_group_api.SetThreadGroupAffinity           = (os_set_thread_group_affinity_func*)GetProcAddress(kernel32, (const schar8*)"SetThreadGroupAffinity");
+      os_group_api.GetLogicalProcessorInformationEx = (os_get_logical_processor_information_ex_func*)GetProcAddress(kernel32, (const schar8*)"GetLogicalProcessorInformationEx");
+      os_group_api.GetCurrentProcessorNumberEx      = (os_get_current_processor_number_ex_func*)GetProcAddress(kernel32, (const schar8*)"GetCurrentProcessorNumberEx");
+      os_group_api.GetNumaHighestNodeNumber         = (os_get_numa_highest_node_number_func*)GetProcAddress(kernel32, (const schar8*)"GetNumaHighestNodeNumber");
+    }
+
+    os_group_api.is_available = os_group_api.GetThreadGroupAffinity && os_group_api.SetThreadGroupAffinity && os_group_api.GetLogicalProcessorInformationEx;
+    os_group_api.is_loaded    = 1;
+  }
+
+  return os_group_api.is_available;
+}
+
+// Fill os_logical_processor_information_buffer with the entries of a relationship. Returns their
+// total size in bytes, or 0 on failure
+static u32 os_get_logical_processor_information(s32 relationship)
+{
+  u32 size = sizeof(os_logical_processor_information_buffer);
+  if (!os_load_group_api() || !os_group_api.GetLogicalProcessorInformationEx(relationship, os_logical_processor_information_buffer, &size))
+  {
+    return 0;
+  }
+
+  return size;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Affinity
+// Get the mask of logical processors the process may run on in each processor group. Returns the
+// count of groups, or 0 on failure
+static s32 os_get_allowed_group_masks(os_uptr group_masks[OS_MAX_GROUP_COUNT])
+{
+  // The process affinity mask covers the group of the process' threads, and is 0 once they span
+  // several groups
+  os_uptr process_mask;
+  os_uptr system_mask;
+  if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+  {
+    return 0;
+  }
+
+  struct os_group_affinity thread_affinity;
+  u32 size = os_get_logical_processor_information(OS_RELATION_GROUP);
+  if ((size == 0) || !os_group_api.GetThreadGroupAffinity(GetCurrentThread(), &thread_affinity))
+  {
+    group_masks[0] = process_mask;
+    return (process_mask != 0);
+  }
+
+  // Threads may be moved to any active logical processor of the other groups
+  const struct os_group_relationship* groups = &((const struct os_logical_processor_information*)os_logical_processor_information_buffer)->group;
+  s32 group_count = (groups->active_group_count < OS_MAX_GROUP_COUNT) ? groups->active_group_count : OS_MAX_GROUP_COUNT;
+  for (s32 group = 0; group < group_count; group++)
+  {
+    group_masks[group] = groups->group_infos[group].active_processor_mask;
+    if ((group == thread_affinity.group) && (process_mask != 0))
+    {
+      group_masks[group] &= process_mask;
+    }
+  }
+
+  return group_count;
+}
+
+// Set a thread's affinity, which is limited to group 0 before Windows 7. Returns 1 on success
+static s32 os_set_thread_affinity(os_handle thread, const struct os_group_affinity* affinity)
+{
+  if (os_load_group_api())
+  {
+    return os_group_api.SetThreadGroupAffinity(thread, affinity, 0) != 0;
+  }
+
+  return (affinity->group == 0) && (SetThreadAffinityMask(thread, affinity->mask) != 0);
+}
+
+// Pin a thread to a single logical processor. Returns 1 on success
+static s32 os_pin_thread(os_handle thread, s32 os_cpu_index)
+{
+  s32 index_in_group = os_cpu_index % OS_CPU_GROUP_SIZE;
+  if ((os_cpu_index < 0) || (os_cpu_index >= OS_MAX_GROUP_COUNT * OS_CPU_GROUP_SIZE) || (index_in_group >= (s32)(sizeof(os_uptr) * 8)))
+  {
+    return 0;
+  }
+
+  struct os_group_affinity affinity = {.mask = (os_uptr)1 << index_in_group, .group = (u16)(os_cpu_index / OS_CPU_GROUP_SIZE)};
+  return os_set_thread_affinity(thread, &affinity);
+}
+
+s32 os_for_each_cpu(os_cpu_callback* callback, void* user_data)
+{
+  os_uptr group_masks[OS_MAX_GROUP_COUNT];
+  s32 group_count = os_get_allowed_group_masks(group_masks);
+  if (group_count == 0)
+  {
+    return 0;
+  }
+
+  os_handle                thread            = GetCurrentThread();
+  struct os_group_affinity original_affinity = {0};
+  if (os_load_group_api())
+  {
+    if (!os_group_api.GetThreadGroupAffinity(thread, &original_affinity))
+    {
+      return 0;
+    }
+  }
+  else
+  {
+    // SetThreadAffinityMask() returns the previous mask, which is the only way to retrieve it
+    original_affinity.mask = SetThreadAffinityMask(thread, group_masks[0]);
+    if (original_affinity.mask == 0)
+    {
+      return 0;
+    }
+  }
+
+  // Once the affinity is set, the thread runs on the logical processor it is pinned to
+  s32 visited_cpu_count = 0;
+  for (s32 group = 0; group < group_count; group++)
+  {
+    for (s32 index_in_group = 0; index_in_group < (s32)(sizeof(os_uptr) * 8); index_in_group++)
+    {
+      s32 os_cpu_index = group * OS_CPU_GROUP_SIZE + index_in_group;
+      if (((group_masks[group] >> index_in_group) & 0b1) && os_pin_thread(thread, os_cpu_index))
+      {
+        callback(os_cpu_index, user_data);
+        visited_cpu_count++;
+      }
+    }
+  }
+
+  os_set_thread_affinity(thread, &original_affinity);
+
+  return visited_cpu_count;
+}
+
+s32 os_get_current_cpu(void)
+{
+  if (!os_load_group_api() || !os_group_api.GetCurrentProcessorNumberEx)
+  {
+    return -1;
+  }
+
+  struct os_processor_number number;
+  os_group_api.GetCurrentProcessorNumberEx(&number);
+
+  return number.group * OS_CPU_GROUP_SIZE + number.number;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Threads
+#define OS_CREATE_SUSPENDED 0x4
+#define OS_INFINITE         0xFFFFFFFF
+
+struct os_thread_args
+{
+  // 0 when the thread must return without calling anything
+  os_cpu_callback* callback;
+  s32              os_cpu_index;
+  void*            user_data;
+};
+
+static u32 __stdcall os_thread_start(void* parameter)
+{
+  struct os_thread_args* args = (struct os_thread_args*)parameter;
+  if (args->callback)
+  {
+    if (args->os_cpu_index >= 0)
+    {
+      os_pin_thread(GetCurrentThread(), args->os_cpu_index);
+    }
+
+    args->callback(args->os_cpu_index, args->user_data);
+  }
+
+  return 0;
+}
+
+s32 os_run_threads(os_cpu_callback* callback, const s32* os_cpu_indices, void* const* user_data, s32 thread_count)
+{
+  if ((thread_count <= 0) || (thread_count > OS_MAX_THREAD_COUNT))
+  {
+    return 0;
+  }
+
+  // Look up the processor group functions before the threads pin themselves concurrently
+  os_load_group_api();
+
+  // Threads are created suspended, so that none of them runs callback unless all of them can.
+  // Callers typically synchronize the threads with each other, which would never end otherwise
+  os_handle             threads[OS_MAX_THREAD_COUNT];
+  struct os_thread_args args[OS_MAX_THREAD_COUNT];
+  s32 created_thread_count = 0;
+  for (s32 i = 0; i < thread_count; i++)
+  {
+    args[i].callback     = callback;
+    args[i].os_cpu_index = os_cpu_indices[i];
+    args[i].user_data    = user_data[i];
+
+    threads[i] = CreateThread(0, 0, os_thread_start, &args[i], OS_CREATE_SUSPENDED, 0);
+    if (threads[i] == 0)
+    {
+      break;
+    }
+    created_thread_count++;
+  }
+
+  s32 success = (created_thread_count == thread_count);
+  for (s32 i = 0; i < created_thread_count; i++)
+  {
+    if (!success)
+    {
+      args[i].callback = 0;
+    }
+    ResumeThread(threads[i]);
+  }
+
+  if (created_thread_count != 0)
+  {
+    WaitForMultipleObjects((u32)created_thread_count, threads, 1, OS_INFINITE);
+  }
+  for (s32 i = 0; i < created_thread_count; i++)
+  {
+    CloseHandle(threads[i]);
+  }
+
+  return success;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Time
+u64 os_get_time_ns(void)
+{
+  s64 count;
+  s64 frequency;
+  if (!QueryPerformanceCounter(&count) || !QueryPerformanceFrequency(&frequency) || (frequency <= 0))
+  {
+    return 0;
+  }
+
+  // Split the conversion so that count * 1000000000 can't overflow
+  u64 seconds   = (u64)count / (u64)frequency;
+  u64 remainder = (u64)count % (u64)frequency;
+
+  return seconds * 1000000000 + remainder * 1000000000 / (u64)frequency;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Counts
+static s32 os_count_bits(os_uptr mask)
+{
+  s32 count = 0;
+  for (; mask != 0; mask &= mask - 1)
+  {
+    count++;
+  }
+
+  return count;
+}
+
+static s32 os_get_lowest_bit(os_uptr mask)
+{
+  s32 bit = 0;
+  while (((mask >> bit) & 0b1) == 0)
+  {
+    bit++;
+  }
+
+  return bit;
+}
+
+s32 os_get_allowed_core_count(void)
+{
+  os_uptr group_masks[OS_MAX_GROUP_COUNT];
+  s32 group_count = os_get_allowed_group_masks(group_masks);
+  u32 size        = (group_count != 0) ? os_get_logical_processor_information(OS_RELATION_PROCESSOR_CORE) : 0;
+  if (size == 0)
+  {
+    return 0;
+  }
+
+  // There is one entry per physical core, listing its logical processors
+  s32 core_count = 0;
+  u32 offset     = 0;
+  while (offset < size)
+  {
+    const struct os_logical_processor_information* entry = (const struct os_logical_processor_information*)((const u8*)os_logical_processor_information_buffer + offset);
+    if (entry->size == 0)
+    {
+      break;
+    }
+
+    s32 is_allowed = 0;
+    for (s32 i = 0; i < entry->processor.group_count; i++)
+    {
+      const struct os_group_affinity* core_mask = &entry->processor.group_masks[i];
+      is_allowed |= (core_mask->group < group_count) && ((core_mask->mask & group_masks[core_mask->group]) != 0);
+    }
+
+    core_count += is_allowed;
+    offset     += entry->size;
+  }
+
+  return core_count;
+}
+
+// PROCESSOR_CACHE_TYPE values, in enum cache_type's order
+static const s32 os_cache_types[] = {CACHE_TYPE_UNIFIED, CACHE_TYPE_INSTRUCTION, CACHE_TYPE_DATA};
+
+s32 os_get_caches(s32 os_cpu_index, struct os_cache* caches, s32 max_cache_count)
+{
+  u32 size = os_get_logical_processor_information(OS_RELATION_CACHE);
+  s32 group          = os_cpu_index / OS_CPU_GROUP_SIZE;
+  s32 index_in_group = os_cpu_index % OS_CPU_GROUP_SIZE;
+  if ((size == 0) || (os_cpu_index < 0) || (index_in_group >= (s32)(sizeof(os_uptr) * 8)))
+  {
+    return 0;
+  }
+
+  // There is one entry per cache, listing the logical processors sharing it
+  s32 cache_count = 0;
+  u32 offset      = 0;
+  while ((offset < size) && (cache_count < max_cache_count))
+  {
+    const struct os_logical_processor_information* entry = (const struct os_logical_processor_information*)((const u8*)os_logical_processor_information_buffer + offset);
+    if (entry->size == 0)
+    {
+      break;
+    }
+    offset += entry->size;
+
+    const struct os_cache_relationship* cache = &entry->cache;
+    s32 group_count = (cache->group_count != 0) ? cache->group_count : 1;
+    s32 is_shared   = 0;
+    for (s32 i = 0; i < group_count; i++)
+    {
+      is_shared |= (cache->group_masks[i].group == group) && ((cache->group_masks[i].mask >> index_in_group) & 0b1);
+    }
+    if (!is_shared || (cache->type < 0) || (cache->type >= (s32)(sizeof(os_cache_types) / sizeof(os_cache_types[0]))))
+    {
+      continue;
+    }
+
+    // Associativity 0xFF means fully associative
+    struct os_cache* os_cache = &caches[cache_count++];
+    os_cache->level     = cache->level;
+    os_cache->type      = os_cache_types[cache->type];
+    os_cache->size      = (s32)cache->cache_size;
+    os_cache->line_size = cache->line_size;
+    os_cache->ways      = (cache->associativity == 0xFF) ? (cache->line_size ? (s32)cache->cache_size / cache->line_size : 0) : cache->associativity;
+
+    os_cache->shared_logical_processor_count = 0;
+    os_cache->first_shared_os_cpu_index      = -1;
+    for (s32 i = 0; i < group_count; i++)
+    {
+      const struct os_group_affinity* cache_mask = &cache->group_masks[i];
+      os_cache->shared_logical_processor_count += os_count_bits(cache_mask->mask);
+      if ((cache_mask->mask != 0) && (os_cache->first_shared_os_cpu_index < 0))
+      {
+        os_cache->first_shared_os_cpu_index = cache_mask->group * OS_CPU_GROUP_SIZE + os_get_lowest_bit(cache_mask->mask);
+      }
+    }
+  }
+
+  return cache_count;
+}
+
+s32 os_get_cores(struct os_core* cores, s32 max_core_count)
+{
+  os_uptr group_masks[OS_MAX_GROUP_COUNT];
+  s32 group_count = os_get_allowed_group_masks(group_masks);
+  u32 size        = (group_count != 0) ? os_get_logical_processor_information(OS_RELATION_PROCESSOR_CORE) : 0;
+  if (size == 0)
+  {
+    return 0;
+  }
+
+  // Entries are listed in increasing group and index order
+  s32 core_count = 0;
+  u32 offset     = 0;
+  while ((offset < size) && (core_count < max_core_count))
+  {
+    const struct os_logical_processor_information* entry = (const struct os_logical_processor_information*)((const u8*)os_logical_processor_information_buffer + offset);
+    if (entry->size == 0)
+    {
+      break;
+    }
+    offset += entry->size;
+
+    const struct os_group_affinity* core_mask = &entry->processor.group_masks[0];
+    os_uptr allowed_mask = (core_mask->group < group_count) ? (core_mask->mask & group_masks[core_mask->group]) : 0;
+    if (allowed_mask != 0)
+    {
+      struct os_core* core = &cores[core_count++];
+      core->first_os_cpu_index      = core_mask->group * OS_CPU_GROUP_SIZE + os_get_lowest_bit(allowed_mask);
+      core->logical_processor_count = os_count_bits(allowed_mask);
+      core->efficiency_class        = entry->processor.efficiency_class;
+    }
+  }
+
+  return core_count;
+}
+
+s32 os_get_numa_nodes(const s32* os_cpu_indices, s32* node_numbers, s32 count)
+{
+  for (s32 i = 0; i < count; i++)
+  {
+    node_numbers[i] = -1;
+  }
+
+  u32 size = os_get_logical_processor_information(OS_RELATION_NUMA_NODE);
+  if (size == 0)
+  {
+    return 0;
+  }
+
+  // There is one entry per node, listing its logical processors. Nodes without any, which only
+  // have memory, are listed with empty masks
+  s32 node_count = 0;
+  u32 offset     = 0;
+  while (offset < size)
+  {
+    const struct os_logical_processor_information* entry = (const struct os_logical_processor_information*)((const u8*)os_logical_processor_information_buffer + offset);
+    if (entry->size == 0)
+    {
+      break;
+    }
+    offset += entry->size;
+
+    const struct os_numa_node_relationship* numa_node = &entry->numa_node;
+    s32 group_count = (numa_node->group_count != 0) ? numa_node->group_count : 1;
+    for (s32 i = 0; i < count; i++)
+    {
+      s32 group          = os_cpu_indices[i] / OS_CPU_GROUP_SIZE;
+      s32 index_in_group = os_cpu_indices[i] % OS_CPU_GROUP_SIZE;
+      for (s32 j = 0; (j < group_count) && (os_cpu_indices[i] >= 0) && (index_in_group < (s32)(sizeof(os_uptr) * 8)); j++)
+      {
+        if ((numa_node->group_masks[j].group == group) && ((numa_node->group_masks[j].mask >> index_in_group) & 0b1))
+        {
+          node_numbers[i] = (s32)numa_node->node_number;
+        }
+      }
+    }
+
+    node_count = ((s32)numa_node->node_number >= node_count) ? (s32)numa_node->node_number + 1 : node_count;
+  }
+
+  u32 highest_node_number = 0;
+  if (os_group_api.GetNumaHighestNodeNumber && os_group_api.GetNumaHighestNodeNumber(&highest_node_number) && ((s32)highest_node_number >= node_count))
+  {
+    node_count = (s32)highest_node_number + 1;
+  }
+
+  return node_count;
+}
+
+s32 os_get_numa_distances(s32 node_number, u8* distances, s32 max_node_count)
+{
+  // The SLIT is only available to drivers
+  (void)node_number;
+  (void)distances;
+  (void)max_node_count;
+
+  return 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Model-specific registers
+s32 os_read_msr(s32 os_cpu_index, u32 msr_index, u64* value)
+{
+  // RDMSR is privileged, and Windows has no user mode interface to it
+  (void)os_cpu_index;
+  (void)msr_index;
+  (void)value;
+
+  return 0;
+}
+#elif defined(__linux__)
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Linux API
+// Declare the few libc functions used below rather than including the system headers. These match
+// the documented prototypes, with the C types replaced by types.h's equivalents. long is kept where
+// its size differs between 32-bit and 64-bit builds. pthread functions are in libc since glibc
+// 2.34, and require linking with -pthread before
+typedef os_uptr os_pthread;
+
+struct os_timespec
+{
+  long seconds;
+  long nanoseconds;
+};
+
+extern s32  sched_getaffinity(s32 pid, os_uptr cpu_set_size, void* cpu_set);
+extern s32  sched_setaffinity(s32 pid, os_uptr cpu_set_size, const void* cpu_set);
+extern s32  sched_yield(void);
+extern s32  sched_getcpu(void);
+extern s32  pthread_create(os_pthread* thread, const void* attributes, void* (*start_routine)(void*), void* argument);
+extern s32  pthread_join(os_pthread thread, void** return_value);
+extern s32  clock_gettime(s32 clock_id, struct os_timespec* time);
+extern s32  open(const schar8* path, s32 flags, ...);
+extern long read(s32 file, void* buffer, os_uptr size);
+extern long pread64(s32 file, void* buffer, os_uptr size, s64 offset);
+extern s32  close(s32 file);
+
+#define OS_CLOCK_MONOTONIC 1
+#define OS_O_RDONLY        0
+
+// Same size as glibc's cpu_set_t, which covers 1024 logical processors
+#define OS_CPU_SET_WORD_COUNT 16
+#define OS_CPU_SET_MAX_INDEX  (OS_CPU_SET_WORD_COUNT * 64)
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Affinity
+static s32 os_cpu_set_contains(const u64* cpu_set, s32 os_cpu_index)
+{
+  return (cpu_set[os_cpu_index / 64] >> (os_cpu_index % 64)) & 0b1;
+}
+
+// Pin the calling thread (pid 0) to a single logical processor. Returns 1 on success
+static s32 os_pin_thread(s32 os_cpu_index)
+{
+  u64 cpu_set[OS_CPU_SET_WORD_COUNT];
+  for (s32 i = 0; i < OS_CPU_SET_WORD_COUNT; i++)
+  {
+    cpu_set[i] = 0;
+  }
+  cpu_set[os_cpu_index / 64] = (u64)1 << (os_cpu_index % 64);
+
+  return sched_setaffinity(0, sizeof(cpu_set), cpu_set) == 0;
+}
+
+s32 os_for_each_cpu(os_cpu_callback* callback, void* user_data)
+{
+  // The affinity mask only contains online logical processors, which the process is allowed to
+  // run on, for instance by cgroup cpusets in containers
+  u64 allowed_cpu_set[OS_CPU_SET_WORD_COUNT];
+  if (sched_getaffinity(0, sizeof(allowed_cpu_set), allowed_cpu_set) != 0)
+  {
+    return 0;
+  }
+
+  s32 visited_cpu_count = 0;
+  for (s32 os_cpu_index = 0; os_cpu_index < OS_CPU_SET_MAX_INDEX; os_cpu_index++)
+  {
+    if (os_cpu_set_contains(allowed_cpu_set, os_cpu_index) && os_pin_thread(os_cpu_index))
+    {
+      callback(os_cpu_index, user_data);
+      visited_cpu_count++;
+    }
+  }
+
+  sched_setaffinity(0, sizeof(allowed_cpu_set), allowed_cpu_set);
+
+  return visited_cpu_count;
+}
+
+s32 os_get_current_cpu(void)
+{
+  s32 os_cpu_index = sched_getcpu();
+  return (os_cpu_index >= 0) ? os_cpu_index : -1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Threads
+enum os_thread_state
+{
+  OS_THREAD_WAITING = 0,
+  OS_THREAD_RUNNING,
+  OS_THREAD_CANCELLED
+};
+
+struct os_thread_args
+{
+  os_cpu_callback* callback;
+  s32              os_cpu_index;
+  void*            user_data;
+
+  // enum os_thread_state value, shared by all threads and set once by os_run_threads()
+  long volatile*   state;
+};
+
+static void* os_thread_start(void* parameter)
+{
+  struct os_thread_args* args = (struct os_thread_args*)parameter;
+
+  // pthreads can't be created suspended, so threads wait until all of them are created
+  long state;
+  while ((state = cpu_load_acquire(args->state)) == OS_THREAD_WAITING)
+  {
+    sched_yield();
+  }
+
+  if (state == OS_THREAD_RUNNING)
+  {
+    if ((args->os_cpu_index >= 0) && (args->os_cpu_index < OS_CPU_SET_MAX_INDEX))
+    {
+      os_pin_thread(args->os_cpu_index);
+    }
+
+    args->callback(args->os_cpu_index, args->user_data);
+  }
+
+  return 0;
+}
+
+s32 os_run_threads(os_cpu_callback* callback, const s32* os_cpu_indices, void* const* user_data, s32 thread_count)
+{
+  if ((thread_count <= 0) || (thread_count > OS_MAX_THREAD_COUNT))
+  {
+    return 0;
+  }
+
+  os_pthread            threads[OS_MAX_THREAD_COUNT];
+  struct os_thread_args args[OS_MAX_THREAD_COUNT];
+  long volatile         state = OS_THREAD_WAITING;
+  s32 created_thread_count = 0;
+  for (s32 i = 0; i < thread_count; i++)
+  {
+    args[i].callback     = callback;
+    args[i].os_cpu_index = os_cpu_indices[i];
+    args[i].user_data    = user_data[i];
+    args[i].state        = &state;
+
+    if (pthread_create(&threads[i], 0, os_thread_start, &args[i]) != 0)
+    {
+      break;
+    }
+    created_thread_count++;
+  }
+
+  s32 success = (created_thread_count == thread_count);
+  cpu_store_release(&state, success ? OS_THREAD_RUNNING : OS_THREAD_CANCELLED);
+
+  for (s32 i = 0; i < created_thread_count; i++)
+  {
+    pthread_join(threads[i], 0);
+  }
+
+  return success;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Time
+u64 os_get_time_ns(void)
+{
+  struct os_timespec time;
+  if (clock_gettime(OS_CLOCK_MONOTONIC, &time) != 0)
+  {
+    return 0;
+  }
+
+  return (u64)time.seconds * 1000000000 + (u64)time.nanoseconds;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Topology
+static s32 os_append_string(schar8* buffer, s32 length, const schar8* string)
+{
+  while (*string)
+  {
+    buffer[length++] = *string++;
+  }
+  buffer[length] = 0;
+
+  return length;
+}
+
+static s32 os_append_s32(schar8* buffer, s32 length, s32 value)
+{
+  schar8 digits[12];
+  s32    digit_count = 0;
+  do
+  {
+    digits[digit_count++] = (schar8)('0' + value % 10);
+    value /= 10;
+  }
+  while (value != 0);
+
+  while (digit_count != 0)
+  {
+    buffer[length++] = digits[--digit_count];
+  }
+  buffer[length] = 0;
+
+  return length;
+}
+
+// Read a file into text, which is null-terminated. Returns its length, or 0 on failure
+static s32 os_read_file(const schar8* path, schar8* text, s32 text_size)
+{
+  s32 file = open(path, OS_O_RDONLY);
+  if (file < 0)
+  {
+    return 0;
+  }
+
+  long text_length = read(file, text, (os_uptr)(text_size - 1));
+  close(file);
+
+  text_length = (text_length > 0) ? text_length : 0;
+  text[text_length] = 0;
+
+  return (s32)text_length;
+}
+
+// Read the sysfs file /sys/devices/system/cpu/cpu<os_cpu_index>/<directory><index>/<name>, where
+// index is left out if negative, and directory may be empty, into text, which is null-terminated.
+// Returns its length, or 0 on failure
+static s32 os_read_cpu_file(s32 os_cpu_index, const schar8* directory, s32 index, const schar8* name, schar8* text, s32 text_size)
+{
+  schar8 path[128];
+  s32 path_length = 0;
+  path_length = os_append_string(path, path_length, (const schar8*)"/sys/devices/system/cpu/cpu");
+  path_length = os_append_s32(path, path_length, os_cpu_index);
+  path_length = os_append_string(path, path_length, (const schar8*)"/");
+  if (directory[0] != 0)
+  {
+    path_length = os_append_string(path, path_length, directory);
+    if (index >= 0)
+    {
+      path_length = os_append_s32(path, path_length, index);
+    }
+    path_length = os_append_string(path, path_length, (const schar8*)"/");
+  }
+  path_length = os_append_string(path, path_length, name);
+
+  return os_read_file(path, text, text_size);
+}
+
+// Read the sysfs file /sys/devices/system/node/node<node_number>/<name>, or
+// /sys/devices/system/node/<name> if node_number is negative, as os_read_cpu_file() does
+static s32 os_read_node_file(s32 node_number, const schar8* name, schar8* text, s32 text_size)
+{
+  schar8 path[128];
+  s32 path_length = 0;
+  path_length = os_append_string(path, path_length, (const schar8*)"/sys/devices/system/node/");
+  if (node_number >= 0)
+  {
+    path_length = os_append_string(path, path_length, (const schar8*)"node");
+    path_length = os_append_s32(path, path_length, node_number);
+    path_length = os_append_string(path, path_length, (const schar8*)"/");
+  }
+  path_length = os_append_string(path, path_length, name);
+
+  return os_read_file(path, text, text_size);
+}
+
+// Parse the decimal number at text[*position], followed by an optional K or M suffix for sizes such
+// as "32K", and advance *position past it. Returns -1 if there is no number
+static s32 os_parse_s32(const schar8* text, s32* position)
+{
+  s32 value = -1;
+  for (; (text[*position] >= '0') && (text[*position] <= '9'); (*position)++)
+  {
+    value = ((value < 0) ? 0 : value * 10) + (text[*position] - '0');
+  }
+
+  if ((value >= 0) && (text[*position] == 'K'))
+  {
+    value *= 1024;
+    (*position)++;
+  }
+  else if ((value >= 0) && (text[*position] == 'M'))
+  {
+    value *= 1024 * 1024;
+    (*position)++;
+  }
+
+  return value;
+}
+
+// Read a sysfs number, or -1 on failure
+static s32 os_read_cpu_s32(s32 os_cpu_index, const schar8* directory, s32 index, const schar8* name)
+{
+  schar8 text[16];
+  s32    position = 0;
+
+  return os_read_cpu_file(os_cpu_index, directory, index, name, text, sizeof(text)) ? os_parse_s32(text, &position) : -1;
+}
+
+// Parse the range at text[*position] of a sysfs list, which looks like "0,64" or "0-3,8-11", into
+// *first and *last, and advance *position past it and its trailing comma. Returns 0 at the end of
+// the list
+static s32 os_parse_list_range(const schar8* text, s32* position, s32* first, s32* last)
+{
+  *first = os_parse_s32(text, position);
+  *last  = *first;
+  if (text[*position] == '-')
+  {
+    (*position)++;
+    *last = os_parse_s32(text, position);
+  }
+  if ((*first < 0) || (*last < *first))
+  {
+    return 0;
+  }
+
+  *position += (text[*position] == ',');
+  return 1;
+}
+
+// Read a sysfs CPU list and return the count of logical processors it lists, along with the lowest
+// one in *first_os_cpu_index. Returns 0 on failure
+static s32 os_read_cpu_list(s32 os_cpu_index, const schar8* directory, s32 index, const schar8* name, s32* first_os_cpu_index)
+{
+  schar8 text[256];
+  if (!os_read_cpu_file(os_cpu_index, directory, index, name, text, sizeof(text)))
+  {
+    return 0;
+  }
+
+  s32 count    = 0;
+  s32 position = 0;
+  s32 first;
+  s32 last;
+  *first_os_cpu_index = -1;
+  while (os_parse_list_range(text, &position, &first, &last))
+  {
+    *first_os_cpu_index = (*first_os_cpu_index < 0) ? first : *first_os_cpu_index;
+    count += last - first + 1;
+  }
+
+  return count;
+}
+
+// Return the lowest OS index of the logical processors sharing a physical core with os_cpu_index,
+// read from sysfs, or -1 on failure
+static s32 os_get_first_thread_sibling(s32 os_cpu_index)
+{
+  s32 first_sibling = -1;
+  os_read_cpu_list(os_cpu_index, (const schar8*)"topology", -1, (const schar8*)"thread_siblings_list", &first_sibling);
+
+  return first_sibling;
+}
+
+s32 os_get_allowed_core_count(void)
+{
+  u64 allowed_cpu_set[OS_CPU_SET_WORD_COUNT];
+  if (sched_getaffinity(0, sizeof(allowed_cpu_set), allowed_cpu_set) != 0)
+  {
+    return 0;
+  }
+
+  // Each physical core is identified by its first logical processor, even if the process isn't
+  // allowed to run on that one
+  u64 core_set[OS_CPU_SET_WORD_COUNT];
+  for (s32 i = 0; i < OS_CPU_SET_WORD_COUNT; i++)
+  {
+    core_set[i] = 0;
+  }
+
+  s32 core_count = 0;
+  for (s32 os_cpu_index = 0; os_cpu_index < OS_CPU_SET_MAX_INDEX; os_cpu_index++)
+  {
+    if (os_cpu_set_contains(allowed_cpu_set, os_cpu_index))
+    {
+      s32 first_sibling = os_get_first_thread_sibling(os_cpu_index);
+      if ((first_sibling < 0) || (first_sibling >= OS_CPU_SET_MAX_INDEX))
+      {
+        return 0;
+      }
+
+      if (!os_cpu_set_contains(core_set, first_sibling))
+      {
+        core_set[first_sibling / 64] |= (u64)1 << (first_sibling % 64);
+        core_count++;
+      }
+    }
+  }
+
+  return core_count;
+}
+
+s32 os_get_caches(s32 os_cpu_index, struct os_cache* caches, s32 max_cache_count)
+{
+  if ((os_cpu_index < 0) || (os_cpu_index >= OS_CPU_SET_MAX_INDEX))
+  {
+    return 0;
+  }
+
+  // cache/index<K> directories are numbered from 0 without gaps
+  const schar8* directory = (const schar8*)"cache/index";
+  s32 cache_count = 0;
+  for (s32 index = 0; cache_count < max_cache_count; index++)
+  {
+    schar8 type[16];
+    if (!os_read_cpu_file(os_cpu_index, directory, index, (const schar8*)"type", type, sizeof(type)))
+    {
+      break;
+    }
+
+    // type is "Data", "Instruction" or "Unified"
+    s32 cache_type = (type[0] == 'D') ? CACHE_TYPE_DATA : (type[0] == 'I') ? CACHE_TYPE_INSTRUCTION : (type[0] == 'U') ? CACHE_TYPE_UNIFIED : CACHE_TYPE_NULL;
+    s32 level      = os_read_cpu_s32(os_cpu_index, directory, index, (const schar8*)"level");
+    s32 size       = os_read_cpu_s32(os_cpu_index, directory, index, (const schar8*)"size");
+    if ((cache_type == CACHE_TYPE_NULL) || (level <= 0) || (size <= 0))
+    {
+      continue;
+    }
+
+    struct os_cache* cache = &caches[cache_count++];
+    cache->level     = level;
+    cache->type      = cache_type;
+    cache->size      = size;
+    cache->line_size = os_read_cpu_s32(os_cpu_index, directory, index, (const schar8*)"coherency_line_size");
+    cache->ways      = os_read_cpu_s32(os_cpu_index, directory, index, (const schar8*)"ways_of_associativity");
+    cache->line_size = (cache->line_size > 0) ? cache->line_size : 0;
+    cache->ways      = (cache->ways > 0) ? cache->ways : 0;
+
+    cache->shared_logical_processor_count = os_read_cpu_list(os_cpu_index, directory, index, (const schar8*)"shared_cpu_list", &cache->first_shared_os_cpu_index);
+    if (cache->shared_logical_processor_count == 0)
+    {
+      cache->shared_logical_processor_count = 1;
+      cache->first_shared_os_cpu_index      = os_cpu_index;
+    }
+  }
+
+  return cache_count;
+}
+
+// Index in os_get_cores()' output of the core of each first thread sibling
+static s32 os_core_indices[OS_CPU_SET_MAX_INDEX];
+
+s32 os_get_cores(struct os_core* cores, s32 max_core_count)
+{
+  u64 allowed_cpu_set[OS_CPU_SET_WORD_COUNT];
+  if (sched_getaffinity(0, sizeof(allowed_cpu_set), allowed_cpu_set) != 0)
+  {
+    return 0;
+  }
+
+  for (s32 i = 0; i < OS_CPU_SET_MAX_INDEX; i++)
+  {
+    os_core_indices[i] = -1;
+  }
+
+  // Logical processors are visited in increasing OS index order, so a core's first allowed one
+  // comes first. cpu_capacity is the same for all cores unless the CPU is asymmetric, such as ARM's
+  // big.LITTLE
+  s32 core_count = 0;
+  for (s32 os_cpu_index = 0; os_cpu_index < OS_CPU_SET_MAX_INDEX; os_cpu_index++)
+  {
+    if (!os_cpu_set_contains(allowed_cpu_set, os_cpu_index))
+    {
+      continue;
+    }
+
+    s32 first_sibling = os_get_first_thread_sibling(os_cpu_index);
+    if ((first_sibling < 0) || (first_sibling >= OS_CPU_SET_MAX_INDEX))
+    {
+      first_sibling = os_cpu_index;
+    }
+
+    if (os_core_indices[first_sibling] >= 0)
+    {
+      cores[os_core_indices[first_sibling]].logical_processor_count++;
+    }
+    else if (core_count < max_core_count)
+    {
+      s32 capacity = os_read_cpu_s32(os_cpu_index, (const schar8*)"", -1, (const schar8*)"cpu_capacity");
+
+      os_core_indices[first_sibling] = core_count;
+      struct os_core* core = &cores[core_count++];
+      core->first_os_cpu_index      = os_cpu_index;
+      core->logical_processor_count = 1;
+      core->efficiency_class        = (capacity > 0) ? capacity : 0;
+    }
+  }
+
+  return core_count;
+}
+
+s32 os_get_numa_nodes(const s32* os_cpu_indices, s32* node_numbers, s32 count)
+{
+  for (s32 i = 0; i < count; i++)
+  {
+    node_numbers[i] = -1;
+  }
+
+  // possible lists node numbers, which may have gaps, and is missing without NUMA support
+  schar8 text[4096];
+  s32 position = 0;
+  s32 first;
+  s32 last;
+  s32 node_count = 0;
+  if (!os_read_node_file(-1, (const schar8*)"possible", text, sizeof(text)))
+  {
+    return 0;
+  }
+  while (os_parse_list_range(text, &position, &first, &last))
+  {
+    node_count = last + 1;
+  }
+
+  // Offline nodes have no directory. CPU lists of large nodes may be long, such as "0,2,4,..." on
+  // systems numbering SMT siblings apart
+  for (s32 node_number = 0; node_number < node_count; node_number++)
+  {
+    if (!os_read_node_file(node_number, (const schar8*)"cpulist", text, sizeof(text)))
+    {
+      continue;
+    }
+
+    position = 0;
+    while (os_parse_list_range(text, &position, &first, &last))
+    {
+      for (s32 i = 0; i < count; i++)
+      {
+        if ((os_cpu_indices[i] >= first) && (os_cpu_indices[i] <= last))
+        {
+          node_numbers[i] = node_number;
+        }
+      }
+    }
+  }
+
+  return node_count;
+}
+
+s32 os_get_numa_distances(s32 node_number, u8* distances, s32 max_node_count)
+{
+  // distance lists the distances to all possible nodes, such as "10 21"
+  schar8 text[4096];
+  if ((node_number < 0) || !os_read_node_file(node_number, (const schar8*)"distance", text, sizeof(text)))
+  {
+    return 0;
+  }
+
+  s32 distance_count = 0;
+  s32 position       = 0;
+  while (distance_count < max_node_count)
+  {
+    while (text[position] == ' ')
+    {
+      position++;
+    }
+
+    s32 distance = os_parse_s32(text, &position);
+    if (distance < 0)
+    {
+      break;
+    }
+
+    distances[distance_count++] = (u8)((distance < 0xFF) ? distance : 0xFF);
+  }
+
+  return distance_count;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//// Model-specific registers
+s32 os_read_msr(s32 os_cpu_index, u32 msr_index, u64* value)
+{
+  if (os_cpu_index < 0)
+  {
+    return 0;
+  }
+
+  // The msr device reads the register of index the file offset, on the logical processor of the
+  // device, in 8-byte reads
+  schar8 path[64];
+  s32 path_length = 0;
+  path_length = os_append_string(path, path_length, (const schar8*)"/dev/cpu/");
+  path_length = os_append_s32(path, path_length, os_cpu_index);
+  path_length = os_append_string(path, path_length, (const schar8*)"/msr");
+
+  s32 file = open(path, OS_O_RDONLY);
+  if (file < 0)
+  {
+    return 0;
+  }
+
+  long read_size = pread64(file, value, sizeof(*value), (s64)msr_index);
+  close(file);
+
+  return read_size == (long)sizeof(*value);
+}
+#else
+#  error Unsupported operating system
+#endif
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "isa.h"
+#include "types.h"
+
+// Minimal operating system layer used where CPUID alone isn't enough, such as running code on a
+// specific logical processor. OS headers are avoided here as well, see os.c
+
+// Unsigned integer as large as a pointer, which is also the size of Windows' affinity masks
+#if defined(ISA_x64) || defined(ISA_arm64)
+typedef u64 os_uptr;
+#else
+typedef u32 os_uptr;
+#endif
+
+// OS indices of logical processors are (group * OS_CPU_GROUP_SIZE + index in the group), where
+// groups are Windows' processor groups, or the 64-bit words of Linux' CPU sets. On Windows, only
+// systems with more than 64 logical processors have several groups
+#define OS_CPU_GROUP_SIZE 64
+
+// Called by os_for_each_cpu() on each logical processor, with the calling thread pinned to it.
+// os_cpu_index is the OS index of the logical processor
+typedef void os_cpu_callback(s32 os_cpu_index, void* user_data);
+
+// Pin the calling thread to each logical processor the process may run on in turn, in increasing
+// OS index order, and call callback on each one. On Windows 7 and above, this spans all processor
+// groups, with the process affinity mask restricting the group of the calling thread. The calling
+// thread's affinity is restored afterwards. Returns the count of logical processors visited, which
+// is 0 if the thread couldn't be pinned
+s32 os_for_each_cpu(os_cpu_callback* callback, void* user_data);
+
+// Maximum count of threads os_run_threads() can run at once
+#define OS_MAX_THREAD_COUNT 64
+
+// Run callback on thread_count new threads at once. The i-th thread is pinned to the logical
+// processor of OS index os_cpu_indices[i], unless it is negative, and is given user_data[i].
+// Returns once all threads have returned. Returns 1 on success, or 0 if the threads couldn't all
+// be created, in which case callback isn't called at all
+s32 os_run_threads(os_cpu_callback* callback, const s32* os_cpu_indices, void* const* user_data, s32 thread_count);
+
+// Return the OS index of the logical processor the calling thread runs on, or -1 if unknown, such
+// as before Windows 7. The thread may be migrated right after, so this is only a hint
+s32 os_get_current_cpu(void);
+
+// Return a monotonic time in nanoseconds since an unspecified origin, read from the OS' high
+// resolution clock, or 0 on failure. This is too slow for hot paths, see cpu_tsc.h instead
+u64 os_get_time_ns(void);
+
+// Return the count of physical cores with at least one logical processor the process may run on,
+// or 0 if unknown. On Linux, this reflects the affinity mask, restricted by cgroup cpusets in
+// containers, and sysfs' topology. On Windows, this reflects the allowed processors of each group
+// as above, and GetLogicalProcessorInformationEx(), so is 0 before Windows 7
+s32 os_get_allowed_core_count(void);
+
+// Cache as reported by the OS
+struct os_cache
+{
+  // Level, from 1 to 4, and type, as an enum cache_type value of cpu_specs.h
+  s32 level;
+  s32 type;
+
+  // Size and line size in bytes, and count of ways. ways is 0 if unreported
+  s32 size;
+  s32 line_size;
+  s32 ways;
+
+  // Count of logical processors sharing this cache, including the ones the process may not run
+  // on, and the lowest OS index among them, which identifies the cache
+  s32 shared_logical_processor_count;
+  s32 first_shared_os_cpu_index;
+};
+
+// Maximum count of caches of a logical processor os_get_caches() reports
+#define OS_MAX_CACHE_COUNT 8
+
+// Get the caches of the logical processor of OS index os_cpu_index, in no particular order. This
+// reads sysfs on Linux, and GetLogicalProcessorInformationEx() on Windows 7 and above. Writes up
+// to max_cache_count caches, and returns the count written, or 0 if unknown
+s32 os_get_caches(s32 os_cpu_index, struct os_cache* caches, s32 max_cache_count);
+
+// Physical core as reported by the OS
+struct os_core
+{
+  // Lowest OS index and count of the logical processors of this core the process may run on
+  s32 first_os_cpu_index;
+  s32 logical_processor_count;
+
+  // Relative performance of this core, which is higher for faster cores and the same for all cores
+  // of non-hybrid CPUs: Windows' efficiency class, or Linux' cpu_capacity, which is 0 if the
+  // kernel doesn't report it
+  s32 efficiency_class;
+};
+
+// Get the physical cores with at least one logical processor the process may run on, in
+// increasing OS index order. Writes up to max_core_count cores, and returns the count written, or
+// 0 if unknown
+s32 os_get_cores(struct os_core* cores, s32 max_core_count);
+
+// Maximum count of NUMA nodes os_get_numa_distances() reports distances to
+#define OS_MAX_NUMA_NODE_COUNT 64
+
+// Get the NUMA node of each of the count logical processors of OS indices os_cpu_indices into
+// node_numbers, or -1 if unknown. Node numbers are the OS ones, as taken by mbind() or
+// VirtualAllocExNuma(). This reads sysfs on Linux, and GetLogicalProcessorInformationEx() on
+// Windows 7 and above. Returns the highest node number plus 1, or 0 if unknown, such as on kernels
+// built without NUMA support, in which case node_numbers is all -1
+s32 os_get_numa_nodes(const s32* os_cpu_indices, s32* node_numbers, s32 count);
+
+// Get the distances from the NUMA node of number node_number to each node, in node number order,
+// as reported by the ACPI SLIT: 10 to the node itself, and larger values to nodes whose memory is
+// proportionally slower to access. Writes up to max_node_count distances, and returns the count
+// written, or 0 if unknown. Windows doesn't expose distances, so this always returns 0 there
+s32 os_get_numa_distances(s32 node_number, u8* distances, s32 max_node_count);
+
+// Read the model-specific register of index msr_index of the logical processor of OS index
+// os_cpu_index into value. The calling thread doesn't have to run on it. On Linux, this reads
+// /dev/cpu/<os_cpu_index>/msr, which needs the msr module and CAP_SYS_RAWIO, as root has. Windows
+// only lets drivers read MSRs, so this always fails there. Returns 1 on success, or 0
+s32 os_read_msr(s32 os_cpu_index, u32 msr_index, u64* value);
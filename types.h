@@ -4,6 +4,7 @@
 // See https://en.cppreference.com/w/c/language/arithmetic_types#Integer_types
 // TODO: change when BitIn(n) becomes well supported
 
+#if defined(_MSC_VER)
 typedef __int8           s8;
 typedef __int16          s16;
 typedef __int32          s32;
@@ -12,5 +13,16 @@ typedef unsigned __int8  u8;
 typedef unsigned __int16 u16;
 typedef unsigned __int32 u32;
 typedef unsigned __int64 u64;
+#else
+// GCC and Clang predefine the types stdint.h is built on
+typedef __INT8_TYPE__    s8;
+typedef __INT16_TYPE__   s16;
+typedef __INT32_TYPE__   s32;
+typedef __INT64_TYPE__   s64;
+typedef __UINT8_TYPE__   u8;
+typedef __UINT16_TYPE__  u16;
+typedef __UINT32_TYPE__  u32;
+typedef __UINT64_TYPE__  u64;
+#endif
 typedef s8               schar8;
 